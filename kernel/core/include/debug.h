@@ -73,8 +73,10 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 #ifdef VMM_DEBUG
 # undef VMM_DEBUG
 # define VMM_DEBUG      dprintf
+# define VMM_DEBUG_CACHES vmm_list_caches()
 #else
 # define VMM_DEBUG if(0) dprintf
+# define VMM_DEBUG_CACHES if(0)
 #endif
 
 #ifdef XPT_DEBUG
@@ -18,11 +18,37 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 #ifndef _IPC_H
 #define   _IPC_H
 
+/* threads waiting on doorbells are hashed by the physical address of the doorbell
+   word, so processes mapping the same shared page at different addresses meet */
+#define MSG_DOORBELL_BUCKETS   (64)
+#define MSG_DOORBELL_HASH(a)   (((a) >> 2) & (MSG_DOORBELL_BUCKETS - 1))
+
 /* message passing */
 kresult msg_send_signal(process *target, thread *sender, unsigned int signum, unsigned int sigcode);
+kresult msg_send_irq(process *target, unsigned int irq);
+unsigned int msg_take_irqs(process *proc, diosix_irq_set *snapshot, unsigned int flags);
+kresult msg_give_irqs(thread *receiver, diosix_irq_set *snapshot, unsigned int irq, unsigned char nofault);
 kresult msg_send(thread *sender, diosix_msg_info *msg);
 kresult msg_recv(thread *receiver, diosix_msg_info *msg);
 thread *msg_find_receiver(thread *sender, diosix_msg_info *msg);
+kresult msg_recv_queued(thread *receiver, diosix_msg_info *msg, thread *sender);
+void msg_endpoint_link(msg_endpoint *ep, unsigned char queue, thread *victim, unsigned char at_head);
+void msg_endpoint_unlink(thread *victim);
+void msg_endpoint_add(msg_endpoint *ep, unsigned char queue, thread *victim, unsigned char at_head);
+thread *msg_endpoint_pop(msg_endpoint *ep, unsigned char queue);
+kresult msg_endpoint_remove(thread *victim);
+thread *msg_endpoint_block(msg_endpoint *ep, unsigned char queue, unsigned char partners,
+                           thread *victim, thread_state state);
 kresult msg_test_receiver(thread *sender, thread *target, diosix_msg_info *msg);
+unsigned char msg_buffer_checked(thread *owner, unsigned int addr, unsigned int size, unsigned int flags);
+kresult msg_check_buffer(thread *owner, unsigned int addr, unsigned int size, unsigned int flags);
+void msg_grant_priority(thread *receiver, thread *sender);
+unsigned char msg_batch_can_block(unsigned int op, diosix_msg_info *msg);
+thread *msg_find_fast_receiver(thread *sender, diosix_msg_fast_info *msg, unsigned char *queued);
+kresult msg_send_fast(thread *sender, diosix_msg_fast_info *msg);
+kresult msg_recv_fast(thread *receiver, diosix_msg_fast_info *msg);
+kresult msg_doorbell_wait(thread *waiter, unsigned int addr, unsigned int expected);
+kresult msg_doorbell_ring(thread *ringer, unsigned int addr);
+void msg_doorbell_cancel(thread *victim);
 
 #endif
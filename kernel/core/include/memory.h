@@ -71,6 +71,127 @@ struct kpool
 #define KPOOL_MAX_INITCOUNT   (256)
 #define KPOOL_BLOCK_TOTALSIZE(a) (sizeof(kpool_block) + (unsigned int)a)
 
+/* slab caches for the kernel's hot fixed-size objects. each cache carves its
+   objects out of whole pages, called slabs, with a header at the start of the
+   page. each cpu holds a magazine of free objects per cache that it allocates
+   from and frees into without taking a lock, only going to the cache's slabs
+   when its magazine runs empty or overflows. vmm_malloc() is for odd sizes */
+#define KCACHE_THREAD         (0) /* thread structures */
+#define KCACHE_PROCESS        (1) /* process structures */
+#define KCACHE_VMM_TREE       (2) /* nodes in processes' vma trees */
+#define KCACHE_VMM_AREA       (3) /* vmas */
+#define KCACHE_POOL           (4) /* kpool headers */
+#define KCACHE_TYPES          (5)
+
+#define KCACHE_SLAB_MAGIC     (0xd107d107)
+#define KCACHE_MAGAZINE_SIZE  (8) /* free objects a cpu can hold per cache */
+#define KCACHE_MAGAZINE_BATCH (KCACHE_MAGAZINE_SIZE / 2) /* objects moved between a magazine and the slabs at once */
+
+/* round an object up to a slot in a slab: the object plus a link to the next
+   free slot, kept clear of the object so a stray write after a free can't
+   break the free list */
+#define KCACHE_SLOT_SIZE(a)   ((((unsigned int)(a) + sizeof(void *)) + 7) & ~7)
+#define KCACHE_SLOT_LINK(c, a) ((void **)((unsigned int)(a) + (c)->obj_size))
+
+typedef struct kcache_slab kcache_slab;
+struct kcache_slab
+{
+   unsigned int magic; /* KCACHE_SLAB_MAGIC, any other value indicates corruption */
+   unsigned int type;  /* KCACHE_* type of the cache this slab belongs to */
+   unsigned int inuse; /* objects handed out from this slab, including those in magazines */
+   void *free;         /* first free object in the slab, or NULL for none */
+   kcache_slab *previous, *next; /* position in the cache's partial or full list */
+   /* ... object slots follow ... */
+};
+
+/* a cpu's stash of free objects for one cache */
+typedef struct
+{
+   unsigned int count; /* number of objects in the magazine */
+   unsigned int allocs, frees; /* allocations and frees satisfied by the magazine */
+   void *objects[KCACHE_MAGAZINE_SIZE];
+} kcache_magazine;
+
+typedef struct
+{
+   volatile unsigned int lock; /* spinlock for the slab lists and counters */
+   const char *name;
+   unsigned int obj_size; /* size of the objects in bytes */
+   unsigned int per_slab; /* number of object slots in a slab */
+   kcache_slab *partial;  /* slabs with free objects and objects in use */
+   kcache_slab *full;     /* slabs with no free objects */
+   kcache_slab *empty;    /* a single fully free slab held back to save page churn */
+   
+   /* statistics */
+   unsigned int slabs;    /* pages currently held by the cache */
+   unsigned int taken;    /* objects out of the slabs, including those in magazines */
+   unsigned int allocs, frees; /* allocations and frees that missed the magazines */
+   unsigned int grows, shrinks; /* pages claimed and given back */
+} kcache;
+
+/* statistics for a cache, summed across all cpus */
+typedef struct
+{
+   unsigned int obj_size, per_slab, slabs;
+   unsigned int inuse;  /* objects allocated to the kernel */
+   unsigned int cached; /* free objects held in cpus' magazines */
+   unsigned int allocs, frees; /* total objects allocated and freed */
+   unsigned int magazine_allocs, magazine_frees; /* of those, how many were done through a magazine */
+   unsigned int grows, shrinks;
+} kcache_stats;
+
+/* physical page frames are handed out by a binary buddy allocator once the
+   kernel has mapped in physical memory. free blocks of 2^order pages are
+   kept in per-order lists for each zone, and a block's header is written
+   into its first page. DMA-able memory below MEM_DMA_REGION_MARK is kept in
+   its own zone so it isn't used up by requests that don't need it */
+#define PHYS_ZONE_DMA         (0) /* page frames below MEM_DMA_REGION_MARK */
+#define PHYS_ZONE_NORMAL      (1) /* everything else */
+#define PHYS_ZONES            (2)
+
+#define PHYS_MAX_ORDER        (10) /* largest free block is 2^10 pages */
+#define PHYS_ORDERS           (PHYS_MAX_ORDER + 1)
+
+typedef struct phys_pg_block phys_pg_block;
+struct phys_pg_block
+{
+   unsigned int order; /* this free block spans 2^order pages */
+   phys_pg_block *previous, *next; /* kernel logical addresses of neighbours in the free list */
+};
+
+typedef struct
+{
+   phys_pg_block *free[PHYS_ORDERS]; /* lists of free blocks, indexed by order */
+   unsigned int blocks[PHYS_ORDERS]; /* number of blocks in each list */
+   unsigned int free_pages;          /* total pages free in this zone */
+} phys_pg_zone;
+
+/* each cpu keeps a small stash of free page frames from the normal zone so
+   that single-page requests and frees don't have to take vmm_lock. a cpu
+   refills its stash from, and drains it to, the buddy allocator in batches.
+   a stash's lock is only ever contended when a multi-page request that can't
+   be met drains every cpu's stash back into the buddy allocator. vmm_lock is
+   never taken while a stash's lock is held */
+#define PHYS_PG_CACHE_SIZE    (32) /* free page frames a cpu can hold */
+#define PHYS_PG_CACHE_BATCH   (PHYS_PG_CACHE_SIZE / 2) /* frames moved between a stash and the buddy allocator at once */
+
+typedef struct
+{
+   volatile unsigned int lock; /* spinlock for the stash */
+   unsigned int count; /* number of page frames in the stash */
+   void *pages[PHYS_PG_CACHE_SIZE]; /* physical addresses of the free frames */
+} phys_pg_cache;
+
+/* idle cpus zero page frames in advance so page requests needing a clean
+   page don't have to. callers that will overwrite a whole page anyway can
+   or MEM_PG_NOZERO into their vmm_req_phys_pg() preference to skip this */
+#define MEM_PG_NOZERO         (1 << 8)
+#define PHYS_PG_ZEROED_MAX    (64) /* most frames to keep zeroed in advance */
+#define PHYS_PG_ZEROED_BATCH  (8)  /* frames to zero each time a cpu goes idle */
+
+/* vmm_memcpy() and vmm_memset() hand anything this size or larger to the port */
+#define MEM_SMALL_COPY        (16)
+
 /* virtual memory management */
 /* the kernel page management looks to the vmm for help.
    on a fault, these are the possible instructions the vmm will 
@@ -128,6 +249,10 @@ kresult vmm_req_phys_pages(unsigned short pages, void **ptr, unsigned int pref);
 kresult vmm_return_phys_pages(void *addr, unsigned int pages);
 kresult vmm_req_phys_pg(void **addr, int pref);
 kresult vmm_return_phys_pg(void *addr);
+kresult vmm_take_zeroed_pg(void **addr);
+void vmm_drain_page_caches(void);
+void vmm_release_zeroed_pgs(void);
+void vmm_zero_idle_pages(void);
 kresult vmm_enough_pgs(unsigned int size);
 kresult vmm_ensure_pgs(unsigned int size, int type);
 kresult vmm_free(void *addr);
@@ -154,6 +279,10 @@ void *vmm_next_in_pool(void *ptr, kpool *pool);
 kresult vmm_create_free_blocks_in_pool(kpool *pool, unsigned int start, unsigned int end);
 kresult vmm_fixup_moved_pool(kpool *pool, void *prev, void *new);
 unsigned int vmm_count_pool_inuse(kpool *pool);
+kresult vmm_cache_alloc(void **addr, unsigned int type);
+kresult vmm_cache_free(void *addr, unsigned int type);
+kresult vmm_cache_stats(unsigned int type, kcache_stats *stats);
+void vmm_list_caches(void);
 kresult vmm_alter_vma(process *owner, vmm_tree *node, unsigned int flags);
 kresult vmm_resize_vma(process *owner, vmm_tree *node, signed int change);
 vmm_tree *vmm_lookup_vma(thread *caller, unsigned int type);
@@ -77,15 +77,10 @@ typedef struct
    unsigned int sender_uid, sender_gid; /* POSIX-conformant user and group ids of the sender */
 } queued_signal;
 
-/* a queued synchronous message sender */
-typedef struct
-{
-   unsigned int pid, tid; /* process & thread IDs of the sender */
-} queued_sender;
-
 #define THREAD_FLAG_INUSERMODE       (1 << 0)
 #define THREAD_FLAG_ISDRIVER         (1 << 1)
 #define THREAD_FLAG_HASIOBITMAP      (1 << 2)
+#define THREAD_FLAG_HASRUN           (1 << 3) /* thread has been run at least once */
 
 /* needed in the process and thread structs */
 typedef struct kpool kpool;
@@ -94,7 +89,56 @@ typedef struct vmm_tree vmm_tree;
 
 typedef struct process process; /* keep the compiler nice and sweet */
 typedef struct thread thread;
+
+/* a thread remembers the last user buffer it had checked for each type of
+   access, so a server reusing the same buffer for every message doesn't have
+   it walked again. the check only stands while the generation matches the
+   process's mem_generation */
+#define MSG_BUFFER_READ         (0)
+#define MSG_BUFFER_WRITE        (1) /* a writeable buffer is also good for reading */
+#define MSG_BUFFER_TYPES        (2)
+
+typedef struct
+{
+   unsigned int base, size; /* size is zero if nothing's been checked */
+   unsigned int generation;
+} msg_checked_buffer;
+
+/* each process has a message endpoint that all of its threads bind to when they
+   block to receive, so a service can run a pool of worker threads on one endpoint.
+   the endpoint holds a FIFO of blocked receivers for each message type and a FIFO
+   of senders queued with DIOSIX_MSG_QUEUEME, linked through the threads themselves.
+   fast path receivers and callers have their own pair of queues */
+#define MSG_ENDPOINT_GENERIC    (0) /* threads blocked receiving generic messages */
+#define MSG_ENDPOINT_SIGNAL     (1) /* threads blocked receiving signals */
+#define MSG_ENDPOINT_SENDERS    (2) /* threads queued waiting for a receiver */
+#define MSG_ENDPOINT_FAST       (3) /* threads blocked on a fast receive */
+#define MSG_ENDPOINT_FAST_CALLERS (4) /* fast callers queued waiting for a receiver */
+#define MSG_ENDPOINT_QUEUES     (5)
+
+#define MSG_ENDPOINT_BYPRIORITY (1 << 0) /* queue senders by priority rather than arrival */
+
+typedef struct
+{
+   thread *head, *tail;
+} msg_endpoint_queue;
+
+typedef struct
+{
+   volatile unsigned int lock; /* spinlock for the queues */
+   unsigned int flags;
+   msg_endpoint_queue queues[MSG_ENDPOINT_QUEUES];
+} msg_endpoint;
 typedef struct tss_descr tss_descr;
+typedef struct snoozing_thread snoozing_thread; /* in sched.h */
+
+#define THREAD_SNOOZE_ACTIONS (3) /* one scheduler clock timer per sched_snooze_action */
+
+/* cpu time is accounted in cpu cycles, split by what the cpu was doing */
+#define THREAD_CYCLES_USER    (0) /* running the thread's usermode code */
+#define THREAD_CYCLES_KERNEL  (1) /* in the kernel on the thread's behalf, eg: syscalls and faults */
+#define THREAD_CYCLES_IRQ     (2) /* handling hardware interrupts that arrived while the thread ran */
+#define THREAD_CYCLES_TYPES   (3)
 
 /* describe each thread */
 struct thread
@@ -115,10 +159,28 @@ struct thread
                                     then it is bumped up a priority level and rescheduled. */
    
    thread_state state;  /* the running state of the thread */
+   unsigned int last_ran; /* sched_msec_counter when the thread was last switched out */
+   unsigned int last_cpu; /* the cpu the thread last ran on */
+   unsigned int migrations; /* number of times the scheduler has moved the thread between cpus */
+   
+   /* real-time scheduling - rt_period is zero if the thread isn't real-time */
+   unsigned int rt_period, rt_budget; /* in usec, see sched.h */
+   unsigned int rt_remaining; /* usec of budget left in the current period */
+   unsigned int rt_debt; /* usec the thread overran its budget by, paid back from later periods */
+   unsigned long long rt_period_start; /* when the current period began */
+   unsigned long long rt_ran_from; /* when the thread was last charged for running */
+   
+   unsigned long long cycles[THREAD_CYCLES_TYPES]; /* cpu time used, indexed by THREAD_CYCLES_* */
+   volatile unsigned int cycles_seq; /* odd while the cycle counters are being updated */
    
    thread *replysource; /* thread awaiting reply from */
+   msg_endpoint *endpoint; /* the endpoint the thread is queued in, or NULL */
+   unsigned char endpoint_queue; /* which of the endpoint's queues it's in, MSG_ENDPOINT_* */
+   thread *endpoint_prev, *endpoint_next; /* position in the endpoint queue */
    diosix_msg_info msg; /* copy of the message block ptr submitted to syscall msg_send/recv */
    diosix_msg_info *msg_src; /* pointer to the user-supplied msg block ptr */
+   diosix_msg_fast_info fast_msg; /* a fast call queued on an endpoint for a receiver to pick up */
+   msg_checked_buffer checked_buffers[MSG_BUFFER_TYPES]; /* see msg_check_buffer() */
    
    /* simple thread locking mechanism - acquire a lock before modifying
     or reading the thread's structure */
@@ -132,6 +194,13 @@ struct thread
       appear with this particular role */
    unsigned char waiting_for_role;
    
+   /* physical address of the doorbell word the thread is asleep on, or zero */
+   unsigned int doorbell;
+   thread *doorbell_prev, *doorbell_next; /* list of threads waiting on doorbells in the same bucket */
+   
+   /* timers pending on the scheduler clock, indexed by sched_snooze_action, or NULL */
+   snoozing_thread *snoozers[THREAD_SNOOZE_ACTIONS];
+   
    /* thread registers */
    unsigned int stackbase; /* where this thread's user stack should start */
    unsigned int kstackbase, kstackblk; /* kernel stack ptrs */
@@ -203,6 +272,8 @@ struct process
    /* kernel logical address... but contains references
       to physical adresses */
    unsigned int **pgdir;   /* pointer to page directory */
+   volatile unsigned int mem_generation; /* bumped after mappings are removed or write-protected,
+                                            so threads' cached buffer checks are thrown away */
    
    process *hash_prev, *hash_next; /* pid hash double-linked list */
    
@@ -212,6 +283,8 @@ struct process
    /* thread management */
    thread **threads; /* hash table of threads */
    unsigned int thread_count, next_tid;
+   unsigned long long cycles[THREAD_CYCLES_TYPES]; /* cpu time used by threads that have exited */
+   unsigned long long child_cycles[THREAD_CYCLES_TYPES]; /* cpu time used by child processes that have exited */
    unsigned int priority_low, priority_high; /* minimum and maximum scheduling
                                                 priority for this process's threads */ 
    
@@ -263,7 +336,9 @@ struct process
    unsigned int kernel_signals_accepted; /* bitfield for the kernel's signals */
    kpool *system_signals; /* queue of UNIX-compatible and kernel signals */
    kpool *user_signals; /* queue of user defined signals */
-   kpool *msg_queue; /* queue of synchronous messages waiting to be delivered to the process */
+   msg_endpoint endpoint; /* threads blocked receiving and senders queued for this process */
+   diosix_irq_set *irqs_pending; /* IRQs raised for a driver process and not yet collected,
+                                    protected by the endpoint's lock. NULL if not a driver */
 };
 
 #define LAYER_MAX        (255)
@@ -292,6 +367,7 @@ kresult proc_send_group_signal(unsigned int pgid, thread *sender, unsigned int s
 kresult proc_is_valid_pgid(unsigned int pgid, unsigned int sid, process *exclude);
 kresult proc_is_child(process *parent, process *child);
 kresult proc_kill(unsigned int victimpid, process *slayer);
+void proc_sum_cycles(process *proc, unsigned long long *totals);
 kresult proc_layer_up(process *proc);
 kresult proc_clear_rights(process *proc, unsigned int bits);
 thread *thread_new(process *proc);
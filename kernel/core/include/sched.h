@@ -30,22 +30,85 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 #define SCHED_PRIORITY_BASE_POINTS(a) (2 ^ (a))
 #define SCHED_PRIORITY_MAX_POINTS(a) (2 * (2 ^ (a)))
 
+/* each cpu keeps a bitmap of its non-empty run queues, one bit per priority
+   level, so the highest priority queue can be found with a find-first-set */
+#define SCHED_BITMAP_WORD_BITS    (sizeof(unsigned int) * 8)
+#define SCHED_BITMAP_WORDS        ((SCHED_PRIORITY_LEVELS + SCHED_BITMAP_WORD_BITS - 1) / SCHED_BITMAP_WORD_BITS)
+#define SCHED_BITMAP_WORD(a)      ((a) / SCHED_BITMAP_WORD_BITS)
+#define SCHED_BITMAP_BIT(a)       (1 << ((a) % SCHED_BITMAP_WORD_BITS))
+
 #define SCHED_TIMESLICE           (5) /* scheduling quantum for a thread in number of timeslice ticks */
 #define SCHED_FREQUENCY           (DIOSIX_SCHED_TICK) /* timeslice = 1/DIOSIX_SCHED_TICK */
-#define SCHED_CARETAKER           (1000) /* run maintainance every 1000 ticks */
+#define SCHED_CARETAKER           (50) /* run maintainance and rebalance cpus every 50 ticks */
+#define SCHED_MIGRATE_THRESHOLD   (2) /* only place a woken thread away from its preferred cpu if
+                                         that cpu has this many more threads queued than the quietest */
+#define SCHED_CACHE_HOT_MSEC      (SCHED_TIMESLICE * DIOSIX_MSEC_PER_TICK) /* a thread that ran this recently
+                                                                            is likely to still be in its cpu's cache */
+#define SCHED_USEC_PER_TICK       (DIOSIX_USEC_PER_TICK)
+#define SCHED_TIMER_SLACK_USEC    (50) /* fire timers this close to their deadline rather than
+                                          reprogramming the timer hardware for them */
 
 typedef enum
 {
-   wake,  /* wake up a sleeping thread */
-   signal /* send SIGALARM to the thread owner */
+   wake = 0,  /* wake up a sleeping thread */
+   signal,    /* send SIGALARM to the thread owner */
+   replenish  /* top up a real-time thread's budget */
 } sched_snooze_action;
 
-typedef struct
+/* real-time threads run first-in-first-out at the top priority level, alongside
+   interrupt handlers, for up to rt_budget usec in every rt_period usec. once a
+   thread has spent its budget it drops back to its normal priority until the
+   budget is replenished at the start of its next period. the budget is enforced
+   by a one-shot timer where the hardware has one, otherwise at the next tick,
+   and any overrun is taken out of the following periods' budgets */
+#define SCHED_PRIORITY_REALTIME   (SCHED_PRIORITY_INTERRUPTS)
+#define SCHED_RT_MIN_PERIOD       (1000) /* shortest real-time period allowed, in usec */
+#define SCHED_RT_MAX_UTIL         (500)  /* per-mille of each cpu's time real-time threads can reserve, per thread and per cpu */
+
+/* each cpu keeps its snoozing threads in a hierarchical timer wheel: level 0
+   has a slot per tick, each level above has a slot per full turn of the level
+   below. timers are keyed by absolute expiry tick and cascade down a level
+   as their time approaches, giving O(1) insert and cancel. timers that fall
+   due between ticks are moved onto a short deadline-sorted list when their
+   tick comes round, and the cpu's timer is programmed to fire for them */
+#define SCHED_WHEEL_LEVELS        (4)
+#define SCHED_WHEEL_SLOT_BITS     (6)
+#define SCHED_WHEEL_SLOTS         (1 << SCHED_WHEEL_SLOT_BITS)
+#define SCHED_WHEEL_SLOT_MASK     (SCHED_WHEEL_SLOTS - 1)
+#define SCHED_WHEEL_MAX_TIMEOUT   ((1 << (SCHED_WHEEL_LEVELS * SCHED_WHEEL_SLOT_BITS)) - 1) /* in ticks, ~46 hours */
+
+struct snoozing_thread
 {
    thread *sleeper;
-   unsigned int timer;
+   unsigned long long deadline; /* absolute time in usec the timer is due */
+   unsigned int expiry; /* absolute tick of the owning cpu's wheel to fire on */
    sched_snooze_action action;
-} snoozing_thread;
+   unsigned char cpu;   /* id of the cpu whose wheel holds this timer */
+   snoozing_thread **slot; /* head of the wheel slot list this timer is in */
+   snoozing_thread *prev, *next;
+};
+
+typedef struct
+{
+   volatile unsigned int lock; /* spinlock for the wheel and its timers */
+   unsigned int now;   /* the next tick to be processed */
+   unsigned int count; /* number of timers pending in the wheel */
+   snoozing_thread *slots[SCHED_WHEEL_LEVELS][SCHED_WHEEL_SLOTS];
+   snoozing_thread *precise; /* timers due before the next tick or so, soonest first */
+} sched_timer_wheel;
+
+/* wakeup placement hints for sched_wakeup */
+#define SCHED_WAKE_SYNC           (1 << 0) /* the waker is about to block on the woken thread, eg: synchronous IPC */
+
+/* each cpu records scheduler events into its own fixed-size ring buffer.
+   a ring is only ever written by its owning cpu, which runs kernel code with
+   interrupts off, so events are recorded without taking any locks */
+typedef struct
+{
+   volatile unsigned int head; /* number of events recorded, the next goes in
+                                  entries[head % DIOSIX_SCHED_TRACE_ENTRIES] */
+   diosix_sched_trace_entry entries[DIOSIX_SCHED_TRACE_ENTRIES];
+} sched_trace_ring;
 
 typedef enum
 {
@@ -66,6 +129,9 @@ thread *sched_get_next_to_run(unsigned char cpuid);
 void sched_priority_calc(thread *tocalc, sched_priority_request request);
 unsigned char sched_determine_priority(thread *target);
 void sched_add(unsigned char cpu, thread *torun);
+void sched_enqueue(unsigned char cpu, thread *torun);
+void sched_wakeup(thread *towake, unsigned int flags);
+void sched_handoff(thread *from, thread *to);
 void sched_remove(thread *victim, thread_state state);
 void sched_tick(int_registers_block *regs);
 void sched_pick(int_registers_block *regs);
@@ -75,7 +141,21 @@ kresult sched_unlock_proc(process *proc);
 kresult sched_lock_thread(thread *victim);
 kresult sched_unlock_thread(thread *towake);
 unsigned char sched_pick_queue(unsigned char hint);
+kresult sched_migrate(unsigned char from, unsigned char cpu, unsigned char allow_hot);
+unsigned int sched_total_queued(void);
+unsigned int sched_total_migrations(void);
+kresult sched_steal_work(unsigned char cpuid);
+unsigned char sched_work_pending(unsigned char cpuid);
+kresult sched_cancel_snoozer(thread *snoozer, sched_snooze_action action);
 kresult sched_remove_snoozer(thread *snoozer);
 kresult sched_add_snoozer(thread *snoozer, unsigned int timeout, sched_snooze_action action);
+kresult sched_add_timer(thread *snoozer, unsigned int ticks, unsigned int usec, sched_snooze_action action);
+unsigned long long sched_get_usec(void);
+kresult sched_set_realtime(thread *target, unsigned int period, unsigned int budget);
+void sched_account(thread *target, unsigned char type);
+void sched_read_cycles(thread *source, unsigned long long *cycles);
+void sched_cycles_to_cpu_time(unsigned long long *cycles, diosix_cpu_time *block);
+void sched_trace(unsigned short type, thread *subject, unsigned int arg0, unsigned int arg1);
+kresult sched_trace_copy(unsigned int cpuid, diosix_sched_trace *block);
 
 #endif
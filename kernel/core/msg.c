@@ -142,7 +142,7 @@ kresult msg_send_signal(process *target, thread *sender, unsigned int signum, un
       syscall_post_msg_recv(towake, success);
       if(towake->flags & THREAD_FLAG_ISDRIVER)
          sched_priority_calc(towake, priority_reset);
-      sched_add(towake->cpu, towake);
+      sched_wakeup(towake, 0);
 
       MSG_DEBUG("[msg:%i] woke thread %p (tid %i pid %i) to receive signal %i\n",
                 CPU_ID, towake, towake->tid, towake->proc->pid, signum);
@@ -186,6 +186,377 @@ msg_send_signal_exit:
    return err;
 }
 
+/* msg_take_irqs
+   Take IRQs off a driver process's pending set for a thread receiving signals.
+   Call with the process's endpoint lock held
+   => proc = driver process
+      snapshot = structure to copy the whole pending set into, if DIOSIX_MSG_IRQSET is set
+      flags = the receiver's message flags
+   <= the lowest pending IRQ line, or DIOSIX_IRQ_LINES if none are pending
+*/
+unsigned int msg_take_irqs(process *proc, diosix_irq_set *snapshot, unsigned int flags)
+{
+   diosix_irq_set *set = proc->irqs_pending;
+   unsigned int loop, irq;
+   
+   if(!set) return DIOSIX_IRQ_LINES;
+   
+   for(loop = 0; loop < DIOSIX_IRQ_WORDS; loop++)
+      if(set->pending[loop]) break;
+   if(loop == DIOSIX_IRQ_WORDS) return DIOSIX_IRQ_LINES;
+   
+   irq = (loop * 32) + lowlevel_find_first_set(set->pending[loop]);
+   
+   if(flags & DIOSIX_MSG_IRQSET)
+   {
+      /* hand over everything */
+      vmm_memcpy(snapshot, set, sizeof(diosix_irq_set));
+      vmm_memset(set, 0, sizeof(diosix_irq_set));
+   }
+   else
+   {
+      /* just the one line */
+      set->pending[loop] &= ~(1 << (irq & 31));
+      set->counts[irq] = 0;
+   }
+   
+   return irq;
+}
+
+/* msg_give_irqs
+   Complete a thread's receive with a SIGXIRQ signal carrying IRQs taken from its
+   process's pending set. Call with the receiver's lock held
+   => receiver = thread receiving signals
+      snapshot = pending set taken by msg_take_irqs()
+      irq = lowest pending IRQ line
+      nofault = non-zero to only use a receive buffer already checked by
+                msg_check_buffer(), rather than fault pages in, for the IRQ handler
+   <= 0 for success, or an error code passed to the receiver
+*/
+kresult msg_give_irqs(thread *receiver, diosix_irq_set *snapshot, unsigned int irq, unsigned char nofault)
+{
+   diosix_msg_info *msg = &(receiver->msg);
+   kresult err = success;
+   
+   msg->signal.number = SIGXIRQ;
+   msg->signal.extra = irq;
+   msg->pid = msg->tid = RESERVED_PID;
+   msg->uid = msg->gid = DIOSIX_SUPERUSER_ID;
+   msg->role = DIOSIX_ROLE_NONE;
+   msg->recv_size = 0;
+   
+   /* copy the whole set into the receiver's buffer if it asked for it */
+   if(msg->flags & DIOSIX_MSG_IRQSET)
+   {
+      if((nofault && !msg_buffer_checked(receiver, (unsigned int)(msg->recv), sizeof(diosix_irq_set), VMA_WRITEABLE)) ||
+         (!nofault && msg_check_buffer(receiver, (unsigned int)(msg->recv), sizeof(diosix_irq_set), VMA_WRITEABLE)) ||
+         vmm_memcpyuser(msg->recv, receiver->proc, snapshot, NULL, sizeof(diosix_irq_set)))
+         err = e_bad_target_address;
+      else
+         msg->recv_size = sizeof(diosix_irq_set);
+   }
+   
+   syscall_post_msg_recv(receiver, err);
+   
+   MSG_DEBUG("[msg:%i] gave IRQ %i (set %s) to thread %i process %i\n",
+             CPU_ID, irq, (msg->recv_size) ? "copied" : "not copied", receiver->tid, receiver->proc->pid);
+   return err;
+}
+
+/* msg_send_irq
+   Tell a driver process that an IRQ line it has registered for has been raised,
+   without blocking. The IRQ is added to the process's pending set and if one of
+   its threads is blocked receiving signals then it's woken to collect the set,
+   otherwise the IRQ waits in the set, coalescing with any repeats, until a thread
+   next receives. Called from the IRQ handler, so nothing is allocated or faulted
+   in: a receiver's buffer is only written if it's still the one checked when the
+   receiver blocked, otherwise the receiver gets just the lowest line
+   => target = driver process
+      irq = IRQ line that was raised
+   <= 0 for success or an error code
+*/
+kresult msg_send_irq(process *target, unsigned int irq)
+{
+   msg_endpoint *endpoint;
+   diosix_irq_set *set, snapshot;
+   thread *towake;
+   
+   /* sanity checks */
+   if(!target || irq >= DIOSIX_IRQ_LINES) return e_bad_params;
+   set = target->irqs_pending;
+   if(!set) return e_failure;
+   
+   /* is the driver accepting IRQs? */
+   if(!(target->kernel_signals_accepted & (1 << (SIGXIRQ - SIG_KERNEL_MIN))))
+      return e_no_receiver;
+   
+   endpoint = &(target->endpoint);
+   
+   lock_spin(&(endpoint->lock));
+   
+   set->pending[irq >> 5] |= 1 << (irq & 31);
+   if(set->counts[irq] < DIOSIX_IRQ_COUNT_MAX) set->counts[irq]++;
+   
+   /* grab a thread blocked waiting for signals to take the set */
+   towake = endpoint->queues[MSG_ENDPOINT_SIGNAL].head;
+   if(towake)
+   {
+      msg_endpoint_unlink(towake);
+      
+      /* the receiver sees DIOSIX_MSG_IRQSET cleared if it didn't get the whole set */
+      if((towake->msg.flags & DIOSIX_MSG_IRQSET) &&
+         !msg_buffer_checked(towake, (unsigned int)(towake->msg.recv), sizeof(diosix_irq_set), VMA_WRITEABLE))
+         towake->msg.flags &= ~DIOSIX_MSG_IRQSET;
+      
+      irq = msg_take_irqs(target, &snapshot, towake->msg.flags);
+   }
+   
+   unlock_spin(&(endpoint->lock));
+   
+   if(!towake) return success;
+   
+   lock_gate(&(towake->lock), LOCK_WRITE);
+   msg_give_irqs(towake, &snapshot, irq, 1);
+   unlock_gate(&(towake->lock), LOCK_WRITE);
+   
+   /* wake the receiver - reseting its priority if it's a driver thread */
+   if(towake->flags & THREAD_FLAG_ISDRIVER)
+      sched_priority_calc(towake, priority_reset);
+   sched_wakeup(towake, 0);
+   
+   MSG_DEBUG("[msg:%i] woke thread %p (tid %i pid %i) to collect IRQs\n",
+             CPU_ID, towake, towake->tid, towake->proc->pid);
+   
+   return success;
+}
+
+/* ------------------------------ endpoints ------------------------------ */
+
+/* msg_endpoint_link
+   Add a thread to one of an endpoint's queues. Threads join the tail of
+   the queue, or if the endpoint is ordered by priority, go in behind the
+   last thread of the same or better priority. Call with the endpoint's lock held
+   => ep = endpoint to add the thread to
+      queue = MSG_ENDPOINT_* queue to add the thread to
+      victim = thread to add
+      at_head = non-zero to put the thread at the front of the queue
+*/
+void msg_endpoint_link(msg_endpoint *ep, unsigned char queue, thread *victim, unsigned char at_head)
+{
+   msg_endpoint_queue *q = &(ep->queues[queue]);
+   thread *after = NULL;
+   
+   if(!at_head)
+   {
+      after = q->tail;
+      
+      /* walk back from the tail past any threads of a worse priority */
+      if(ep->flags & MSG_ENDPOINT_BYPRIORITY)
+      {
+         unsigned char priority = sched_determine_priority(victim);
+         while(after && sched_determine_priority(after) > priority)
+            after = after->endpoint_prev;
+      }
+   }
+   
+   victim->endpoint = ep;
+   victim->endpoint_queue = queue;
+   victim->endpoint_prev = after;
+   
+   if(after)
+   {
+      victim->endpoint_next = after->endpoint_next;
+      after->endpoint_next = victim;
+   }
+   else
+   {
+      victim->endpoint_next = q->head;
+      q->head = victim;
+   }
+   
+   if(victim->endpoint_next)
+      victim->endpoint_next->endpoint_prev = victim;
+   else
+      q->tail = victim;
+}
+
+/* msg_endpoint_unlink
+   Remove a thread from the endpoint queue it's in. Call with the endpoint's lock held
+   => victim = thread to remove
+*/
+void msg_endpoint_unlink(thread *victim)
+{
+   msg_endpoint_queue *q = &(victim->endpoint->queues[victim->endpoint_queue]);
+   
+   if(victim->endpoint_prev)
+      victim->endpoint_prev->endpoint_next = victim->endpoint_next;
+   else
+      q->head = victim->endpoint_next;
+   
+   if(victim->endpoint_next)
+      victim->endpoint_next->endpoint_prev = victim->endpoint_prev;
+   else
+      q->tail = victim->endpoint_prev;
+   
+   victim->endpoint = NULL;
+   victim->endpoint_prev = victim->endpoint_next = NULL;
+}
+
+/* msg_endpoint_add
+   Add a thread to one of an endpoint's queues
+   => ep = endpoint to add the thread to
+      queue = MSG_ENDPOINT_* queue to add the thread to
+      victim = thread to add, which must not be in any endpoint queue
+      at_head = non-zero to put the thread at the front of the queue
+*/
+void msg_endpoint_add(msg_endpoint *ep, unsigned char queue, thread *victim, unsigned char at_head)
+{
+   lock_spin(&(ep->lock));
+   msg_endpoint_link(ep, queue, victim, at_head);
+   unlock_spin(&(ep->lock));
+}
+
+/* msg_endpoint_pop
+   Take the thread at the front of one of an endpoint's queues
+   => ep = endpoint to search
+      queue = MSG_ENDPOINT_* queue to take the thread from
+   <= pointer to the thread removed from the queue, or NULL if it was empty
+*/
+thread *msg_endpoint_pop(msg_endpoint *ep, unsigned char queue)
+{
+   thread *victim;
+   
+   lock_spin(&(ep->lock));
+   victim = ep->queues[queue].head;
+   if(victim) msg_endpoint_unlink(victim);
+   unlock_spin(&(ep->lock));
+   
+   return victim;
+}
+
+/* msg_endpoint_remove
+   Take a thread out of whichever endpoint queue it's in
+   => victim = thread to remove
+   <= 0 for success, or e_not_found if the thread wasn't queued
+*/
+kresult msg_endpoint_remove(thread *victim)
+{
+   msg_endpoint *ep = victim->endpoint;
+   kresult err = e_not_found;
+   
+   if(!ep) return e_not_found;
+   
+   lock_spin(&(ep->lock));
+   
+   /* make sure nothing took the thread off the endpoint while we were waiting */
+   if(victim->endpoint == ep)
+   {
+      msg_endpoint_unlink(victim);
+      err = success;
+   }
+   
+   unlock_spin(&(ep->lock));
+   return err;
+}
+
+/* msg_endpoint_block
+   Queue a thread on an endpoint and remove it from the scheduler, unless a
+   thread it can pair up with is already waiting on the endpoint. Checking for a
+   partner and blocking are done under the endpoint's lock so a sender and
+   receiver arriving at the same time can't both block waiting for each other
+   => ep = endpoint to block on
+      queue = MSG_ENDPOINT_* queue to add the thread to
+      partners = MSG_ENDPOINT_* queue to take a waiting partner from instead of
+                 blocking, or MSG_ENDPOINT_QUEUES for none
+      victim = thread to block
+      state = scheduler state to block the thread in
+   <= pointer to a partner thread taken off the endpoint, or NULL if the thread blocked
+*/
+thread *msg_endpoint_block(msg_endpoint *ep, unsigned char queue, unsigned char partners,
+                           thread *victim, thread_state state)
+{
+   thread *partner = NULL;
+   
+   lock_spin(&(ep->lock));
+   
+   if(partners < MSG_ENDPOINT_QUEUES) partner = ep->queues[partners].head;
+   
+   if(partner)
+      msg_endpoint_unlink(partner);
+   else
+   {
+      msg_endpoint_link(ep, queue, victim, 0);
+      sched_remove(victim, state);
+   }
+   
+   unlock_spin(&(ep->lock));
+   return partner;
+}
+
+/* msg_buffer_checked
+   See if a thread's message buffer lies inside the last one checked for the
+   thread by msg_check_buffer(), with nothing unmapped or write-protected in its
+   process since. This never touches the page tables
+   => owner = thread that supplied the buffer
+      addr = base address of the buffer
+      size = size of the buffer in bytes
+      flags = VMA_WRITEABLE if the kernel will write to the buffer
+   <= 1 if the buffer is known to be good, 0 if it needs checking
+*/
+unsigned char msg_buffer_checked(thread *owner, unsigned int addr, unsigned int size, unsigned int flags)
+{
+   msg_checked_buffer *checked;
+   unsigned int generation = owner->proc->mem_generation, type;
+   
+   for(type = (flags & VMA_WRITEABLE) ? MSG_BUFFER_WRITE : MSG_BUFFER_READ;
+       type < MSG_BUFFER_TYPES; type++)
+   {
+      checked = &(owner->checked_buffers[type]);
+      if(checked->size && size && checked->generation == generation &&
+         addr >= checked->base && (addr - checked->base) <= checked->size &&
+         size <= checked->size - (addr - checked->base))
+         return 1;
+   }
+   
+   return 0;
+}
+
+/* msg_check_buffer
+   Make sure a thread's message buffer is mapped in with the right access
+   before the kernel uses it, like pg_preempt_fault(), but skip the page table
+   walk if the buffer lies inside the last one checked for the thread and
+   nothing's been unmapped or write-protected in its process since
+   => owner = thread that supplied the buffer
+      addr = base address of the buffer
+      size = size of the buffer in bytes
+      flags = VMA_WRITEABLE if the kernel will write to the buffer
+   <= 0 for success, or an error code
+*/
+kresult msg_check_buffer(thread *owner, unsigned int addr, unsigned int size, unsigned int flags)
+{
+   msg_checked_buffer *checked;
+   unsigned int generation;
+   kresult err;
+   
+   if(!owner) return e_bad_params;
+   
+   /* read the generation before walking so that anything changing the
+      mappings during the walk invalidates what we remember */
+   generation = owner->proc->mem_generation;
+   
+   if(msg_buffer_checked(owner, addr, size, flags)) return success;
+   
+   err = pg_preempt_fault(owner, addr, size, flags);
+   if(err) return err;
+   
+   checked = &(owner->checked_buffers[(flags & VMA_WRITEABLE) ? MSG_BUFFER_WRITE : MSG_BUFFER_READ]);
+   checked->base = addr;
+   checked->size = size;
+   checked->generation = generation;
+   
+   return success;
+}
+
 /* msg_test_receiver
    Check if a given thread is capable of receiving the given message
    => sender = threading trying to send the message, or NULL for the 
@@ -234,10 +605,12 @@ kresult msg_test_receiver(thread *sender, thread *target, diosix_msg_info *msg)
          if((target->proc->layer >= layer) && !(msg->flags & DIOSIX_MSG_REPLY))
             goto msg_test_receiver_failure;
          
-         /* is this message waiting on a reply from this thread? */
+         /* is this message waiting on a reply from this thread? threads
+            waiting on the fast path can only be replied to by the fast path */
          if((target->state == waitingforreply) &&
             (msg->flags & DIOSIX_MSG_REPLY) &&
-            (target->replysource == sender))
+            (target->replysource == sender) &&
+            (target->msg.flags != DIOSIX_MSG_FAST))
             goto msg_test_receiver_success;
 
          /* is the target thread either blocked waiting for a message or running and this is a queued message,
@@ -305,12 +678,35 @@ thread *msg_find_receiver(thread *sender, diosix_msg_info *msg)
    if(msg->tid != DIOSIX_MSG_ANY_THREAD)
    {
       recv = thread_find_thread(proc, msg->tid);
-      if(msg_test_receiver(sender, recv, msg) == success) return recv;
+      if(msg_test_receiver(sender, recv, msg) == success)
+      {
+         /* a thread blocked on receive must be taken off its endpoint, and
+            if another sender beat us to it then it's no longer available */
+         if(recv->state != waitingformsg) return recv;
+         if(msg_endpoint_remove(recv) == success) return recv;
+      }
+   }
+   else if(!(msg->flags & DIOSIX_MSG_REPLY))
+   {
+      /* otherwise take the first thread blocked on the targetted process's
+         endpoint for this type of message */
+      unsigned char queue = MSG_ENDPOINT_GENERIC;
+      if((msg->flags & DIOSIX_MSG_TYPEMASK) == DIOSIX_MSG_SIGNAL) queue = MSG_ENDPOINT_SIGNAL;
+      
+      recv = msg_endpoint_pop(&(proc->endpoint), queue);
+      if(recv)
+      {
+         if(msg_test_receiver(sender, recv, msg) == success) return recv;
+         
+         /* the threads on an endpoint are all in the same process so if
+            this one can't take the message, none can. put it back */
+         msg_endpoint_add(&(proc->endpoint), queue, recv, 1);
+      }
    }
    else
    {
-      /* otherwise search the targetted process for a thread that's blocking on
-       receive */
+      /* a reply to any thread: search the targetted process for the thread
+         that's waiting on the sender */
       unsigned int loop;
       
       /* protect us from process table changes */
@@ -322,9 +718,8 @@ thread *msg_find_receiver(thread *sender, diosix_msg_info *msg)
          
          while(recv)
          {            
-            /* only check threads that are actually waiting for a msg */
-            if((recv->state == waitingforreply) ||
-               (recv->state == waitingformsg))
+            /* only check threads that are actually waiting for a reply */
+            if(recv->state == waitingforreply)
                if(msg_test_receiver(sender, recv, msg) == success)
                {
                   unlock_gate(&proc_lock, LOCK_READ);
@@ -403,6 +798,145 @@ kresult msg_copy(thread *receiver, void *data, unsigned int size, unsigned int *
    return success;
 }
 
+/* msg_can_remap
+   Check whether pages within a vma can be moved between processes by msg_remap()
+   => node = vma tree node covering the pages
+      base = base address of the pages
+      size = size of the range of pages in bytes
+   <= 1 if the pages can be moved, or 0 if not
+*/
+unsigned char msg_can_remap(vmm_tree *node, unsigned int base, unsigned int size)
+{
+   if(!node) return 0;
+   
+   /* the vma must cover the whole range */
+   if((base < node->base) || ((base + size) > (node->base + node->area->size)))
+      return 0;
+   
+   /* the vma must be backed by physical memory owned by just the one process */
+   if((node->area->flags & VMA_SHARED) || !(node->area->flags & VMA_MEMSOURCE))
+      return 0;
+   if(vmm_count_pool_inuse(node->area->mappings) != 1) return 0;
+   
+   return 1;
+}
+
+/* msg_remap
+   Transfer a large message by moving the physical pages behind the sender's buffer
+   into the receiver's buffer rather than copying the data. Pages that cannot be moved,
+   and any partial pages at either end of the buffer, are copied instead
+   => receiver = thread receiving the message
+      data = pointer to data in the sender's address space
+      size = number of bytes to transfer
+      offset = pointer to counter of bytes already in the receiver's buffer, which is
+               updated with the number of bytes transferred
+      sender = thread sending the message
+      moved = pointer to counter to add the number of pages moved to
+   <= 0 for success, or an error code
+*/
+kresult msg_remap(thread *receiver, void *data, unsigned int size, unsigned int *offset,
+                  thread *sender, unsigned int *moved)
+{
+   diosix_msg_info *rmsg;
+   unsigned int recv, recv_base, source = (unsigned int)data;
+   vmm_tree *rnode = NULL, *snode = NULL;
+   unsigned char can_move = 0, vmas_locked = 0;
+   kresult err = success;
+   
+   /* sanity checks - no NULL pointers or zero-byte copies */
+   if(!receiver || !data || !sender || !moved) return e_bad_params;
+   if(!size) return success;
+   
+   /* protect us from metadata changes */
+   if(lock_gate(&(receiver->lock), LOCK_READ)) return e_failure;
+   
+   rmsg = &(receiver->msg);
+   recv = (unsigned int)rmsg->recv;
+   
+   if(!recv)
+   {
+      unlock_gate(&(receiver->lock), LOCK_READ);
+      return e_bad_target_address;
+   }
+   
+   recv_base = recv + *offset;
+   
+   /* stop abusive processes trying to smash out of a recv buffer */
+   if((size > DIOSIX_MSG_REMAP_MAX_SIZE) ||
+      ((recv_base + size) > (recv + rmsg->recv_max_size)))
+   {
+      unlock_gate(&(receiver->lock), LOCK_READ);
+      return e_too_big;
+   }
+   
+   lock_gate(&(sender->lock), LOCK_READ);
+   
+   /* pages can only be moved if the two buffers share the same offset within a page,
+      and both processes have their own private copies of the pages */
+   if(!((recv_base ^ source) & MEM_PGMASK))
+   {
+      rnode = vmm_find_vma(receiver->proc, recv_base, size);
+      snode = vmm_find_vma(sender->proc, source, size);
+      
+      if(msg_can_remap(rnode, recv_base, size) && msg_can_remap(snode, source, size) &&
+         (rnode->area->flags & VMA_WRITEABLE) && (rnode->area != snode->area))
+      {
+         /* stop the vmas being shared with other processes mid-move */
+         lock_gate(&(rnode->area->lock), LOCK_READ);
+         lock_gate(&(snode->area->lock), LOCK_READ);
+         can_move = vmas_locked = 1;
+      }
+   }
+   
+   /* work through the buffer a page at a time, never crossing a page boundary in
+      either process when copying */
+   while(size)
+   {
+      unsigned int chunk = MEM_PGSIZE - (recv_base & MEM_PGMASK);
+      if(chunk > MEM_PGSIZE - (source & MEM_PGMASK)) chunk = MEM_PGSIZE - (source & MEM_PGMASK);
+      if(chunk > size) chunk = size;
+      
+      if(can_move && chunk == MEM_PGSIZE)
+      {
+         unsigned int pages = size >> MEM_PGSHIFT;
+         unsigned int before = *moved;
+         
+         /* move the run of whole pages in one go. if that fails then skip over
+            whatever was moved and fall back to copying the rest */
+         if(pg_move_4K_pages(receiver->proc, recv_base, sender->proc, source, pages, moved))
+         {
+            can_move = 0;
+            pages = *moved - before;
+         }
+         
+         chunk = pages << MEM_PGSHIFT;
+      }
+      else
+      {
+         if(vmm_memcpyuser((void *)recv_base, receiver->proc, (void *)source, sender->proc, chunk))
+         {
+            err = e_bad_address;
+            break;
+         }
+      }
+      
+      recv_base += chunk;
+      source += chunk;
+      size -= chunk;
+      *(offset) += chunk;
+   }
+   
+   if(vmas_locked)
+   {
+      unlock_gate(&(snode->area->lock), LOCK_READ);
+      unlock_gate(&(rnode->area->lock), LOCK_READ);
+   }
+   
+   unlock_gate(&(sender->lock), LOCK_READ);
+   unlock_gate(&(receiver->lock), LOCK_READ);
+   return err;
+}
+
 /* msg_share_mem
    Link a virtual memory area in one process with another process through the inter-process
    messaging system. The entire vma must be linked and it must not collide with any other vmas,
@@ -476,6 +1010,21 @@ kresult msg_share_mem(process *target, diosix_share_request *target_mem,
    return result;
 }
 
+/* msg_grant_priority
+   Bump a message receiver's priority up if the sender has a higher priority,
+   to avoid priority inversion, or drop any previously granted priority
+   => receiver = thread receiving the message
+      sender = thread that sent it
+*/
+void msg_grant_priority(thread *receiver, thread *sender)
+{
+   if(sender->priority < receiver->priority)
+      receiver->priority_granted = sender->priority;
+   else
+      receiver->priority_granted = SCHED_PRIORITY_INVALID;
+   sched_priority_calc(receiver, priority_check);
+}
+
 /* msg_deliver
    Deliver a generic synchronous message between two processes by copying any data
    and fixing up the source and destination pid+tid fields and also fulfilling any
@@ -489,7 +1038,7 @@ kresult msg_share_mem(process *target, diosix_share_request *target_mem,
 kresult msg_deliver(thread *receiver, diosix_msg_info *rmsg, thread *sender, diosix_msg_info *smsg)
 {
    kresult err;
-   unsigned int bytes_copied = 0;
+   unsigned int bytes_copied = 0, pages_moved = 0;
    
    /* assumes locks are in place */
    MSG_DEBUG("[msg:%i] msg_deliver: recvr tid %i pid %i msg %p <- sendr tid %i pid %i msg %p\n",
@@ -536,6 +1085,9 @@ kresult msg_deliver(thread *receiver, diosix_msg_info *rmsg, thread *sender, dio
          if(err || (bytes_copied > DIOSIX_MSG_MAX_SIZE)) break;
       }
    }
+   else if((smsg->flags & DIOSIX_MSG_REMAP) && (smsg->send_size >= DIOSIX_MSG_REMAP_THRESHOLD))
+      /* move the message's pages across if possible */
+      err = msg_remap(receiver, smsg->send, smsg->send_size, &bytes_copied, sender, &pages_moved);
    else
       /* do a simple message copy */
       err = msg_copy(receiver, smsg->send, smsg->send_size, &bytes_copied, sender);
@@ -556,6 +1108,12 @@ kresult msg_deliver(thread *receiver, diosix_msg_info *rmsg, thread *sender, dio
    rmsg->uid = sender->proc->uid.effective;
    rmsg->gid = sender->proc->gid.effective;
    rmsg->role = sender->proc->role;
+   
+   /* let the receiver know if pages were moved into its buffer */
+   if(pages_moved)
+      rmsg->flags |= DIOSIX_MSG_REMAP;
+   else
+      rmsg->flags &= ~DIOSIX_MSG_REMAP;
 
    /* did the message include a share request? */
    if(smsg->flags & DIOSIX_MSG_SHAREVMA)
@@ -596,13 +1154,7 @@ kresult msg_deliver(thread *receiver, diosix_msg_info *rmsg, thread *sender, dio
       /* clear the flag in the receiver in case it was expecting a mapping */
       rmsg->flags &= ~DIOSIX_MSG_SHAREVMA;
    
-   /* bump the receiver's priority up if the sender has a higher priority to
-    avoid priority inversion */
-   if(sender->priority < receiver->priority)
-      receiver->priority_granted = sender->priority;
-   else
-      receiver->priority_granted = SCHED_PRIORITY_INVALID;
-   sched_priority_calc(receiver, priority_check);
+   msg_grant_priority(receiver, sender);
    
    return success;
 }
@@ -628,51 +1180,43 @@ kresult msg_send(thread *sender, diosix_msg_info *msg)
    
    /* identify the receiver */
    receiver = msg_find_receiver(sender, msg);
-   if(!receiver)
+   
+   /* none found, but wait: does this thread wish to be queued until a receiver is ready?
+      note that we can't queue replies. a reply is always sent to a ready receiver.
+      we also can't queue a message sent to a named process (by role) if it isn't registered */
+   if(!receiver && (msg->flags & DIOSIX_MSG_QUEUEME) && !(msg->flags & DIOSIX_MSG_REPLY) && !(msg->role))
    {
-      /* none found, but wait: does this thread wish to be queued until a receiver is ready?
-         note that we can't queue replies. a reply is always sent to a ready receiver.
-         we also can't queue a message sent to a named process (by role) if it isn't registered */
-      if((msg->flags & DIOSIX_MSG_QUEUEME) && !(msg->flags & DIOSIX_MSG_REPLY) && !(msg->role))
+      process *target = proc_find_proc(msg->pid);
+      if(target)
       {
-         process *target = proc_find_proc(msg->pid);
-         if(target)
+         /* take a copy of the message block for the receiver to pick up */
+         lock_gate(&(sender->lock), LOCK_WRITE);
+         vmm_memcpy(&(sender->msg), msg, sizeof(diosix_msg_info));
+         sender->msg_src = msg;
+         sender->replysource = NULL; /* replier not known at this point */
+         unlock_gate(&(sender->lock), LOCK_WRITE);
+         
+         /* queue the sender on the process's endpoint and send it to sleep,
+            unless a receiver has blocked on the endpoint since we looked */
+         receiver = msg_endpoint_block(&(target->endpoint), MSG_ENDPOINT_SENDERS, MSG_ENDPOINT_GENERIC,
+                                       sender, waitingforreply);
+         if(!receiver)
          {
-            queued_sender *entry;
-            
-            lock_gate(&(target->lock), LOCK_WRITE);
-            
-            /* create a new queued message pool if need be */
-            if(!(target->msg_queue))
-               target->msg_queue = vmm_create_pool(sizeof(queued_sender), 4);
-
-            /* create a new queue entry and fill in the details */
-            if(vmm_alloc_pool((void **)&entry, target->msg_queue) == success)
-            {
-               entry->pid = sender->proc->pid;
-               entry->tid = sender->tid;
-               
-               /* send the sender to sleep */
-               sched_remove(sender, waitingforreply);
-               sender->replysource = NULL;
-               
-               /* take a copy of the message block */
-               vmm_memcpy(&(sender->msg), msg, sizeof(diosix_msg_info));
-               sender->msg_src = msg;
-
-               MSG_DEBUG("[msg:%i] queuing thread %i process %i with msg %p in process %i\n",
-                         CPU_ID, sender->tid, sender->proc->pid, msg, target->pid);
-               
-               unlock_gate(&(target->lock), LOCK_WRITE);
-               return success;
-            }
-
-            /* if we're still here then something went wrong */
-            unlock_gate(&(target->lock), LOCK_WRITE);
-            return e_failure;
+            MSG_DEBUG("[msg:%i] queuing thread %i process %i with msg %p in process %i\n",
+                      CPU_ID, sender->tid, sender->proc->pid, msg, target->pid);
+            return success;
+         }
+         
+         if(msg_test_receiver(sender, receiver, msg) != success)
+         {
+            msg_endpoint_add(&(target->endpoint), MSG_ENDPOINT_GENERIC, receiver, 1);
+            return e_no_receiver;
          }
       }
-      
+   }
+   
+   if(!receiver)
+   {
       /* last chance saloon: if the thread is waiting for a named process to appear
          and has set the QUEUEME flag then put the sending thread to sleep and make a
          note of it in the role system to wake it up when the named process appears
@@ -710,12 +1254,14 @@ kresult msg_send(thread *sender, diosix_msg_info *msg)
    rmsg = &(receiver->msg);
 
    /* sanatise the receiver's msg buffer we're about to use */
-   if(pg_preempt_fault(receiver, (unsigned int)(rmsg->recv), rmsg->recv_max_size, VMA_WRITEABLE))
+   if(msg_check_buffer(receiver, (unsigned int)(rmsg->recv), rmsg->recv_max_size, VMA_WRITEABLE))
    {
       unlock_gate(&(receiver->lock), LOCK_WRITE);
       
-      /* let the receiver know about its buffer screw up */
+      /* let the receiver know about its buffer screw up and wake it up. it's
+         already been taken off its endpoint so it can't be picked again */
       syscall_post_msg_recv(receiver, e_bad_target_address);
+      sched_wakeup(receiver, 0);
                      
       MSG_DEBUG("[msg:%i] receiver %p (tid %i pid %i) tried to use invalid address %p for its receive buffer\n",
                 CPU_ID, receiver, receiver->tid, receiver->proc->pid, rmsg->recv);
@@ -736,6 +1282,10 @@ kresult msg_send(thread *sender, diosix_msg_info *msg)
       
       unlock_gate(&(sender->lock), LOCK_WRITE);
       unlock_gate(&(receiver->lock), LOCK_WRITE);
+      
+      /* the receiver is still waiting, so put it back on its endpoint */
+      if(receiver->state == waitingformsg)
+         msg_endpoint_add(&(receiver->proc->endpoint), MSG_ENDPOINT_GENERIC, receiver, 1);
       return err;
    }
    
@@ -760,9 +1310,10 @@ kresult msg_send(thread *sender, diosix_msg_info *msg)
    unlock_gate(&(sender->lock), LOCK_WRITE);
    unlock_gate(&(receiver->lock), LOCK_WRITE);
 
-   /* wake up the receiving thread */
+   /* wake up the receiving thread and switch straight to it on this cpu,
+      where the message is cache-hot, rather than waiting for it to be picked */
    syscall_post_msg_recv(receiver, success);
-   sched_add(receiver->cpu, receiver);
+   sched_handoff(sender, receiver);
    
    MSG_DEBUG("[msg:%x] thread %i of process %i (uid %i gid %i) sent message %x (%i bytes first word %x) to thread %i of process %i\n",
              CPU_ID, sender->tid, sender->proc->pid, sender->proc->uid.effective, sender->proc->gid.effective,
@@ -771,34 +1322,136 @@ kresult msg_send(thread *sender, diosix_msg_info *msg)
    return success;
 }
 
-/* msg_recv
-   Block a thread until a message or signal comes in
-   => receiver = thread waiting to receive
-      info = block to fill with received message details
-   <= success or an error code
+/* msg_recv_queued
+   Deliver the message of a thread that queued up to send before the
+   receiver was ready, and tell the sender how it went. Call with the
+   receiver's lock held
+   => receiver = thread receiving the message
+      msg = receiver's message block
+      sender = thread taken off the receiver's endpoint, or waiting on its role
+   <= 0 for success, e_no_receiver if the sender was turned away and the
+      receiver should look for another message, or an error code for the receiver
 */
-kresult msg_recv(thread *receiver, diosix_msg_info *msg)
+kresult msg_recv_queued(thread *receiver, diosix_msg_info *msg, thread *sender)
 {
-   /* set to 1 to indicate a thread was waiting on a role
-      that was registered by the receiver */
-   unsigned char found_role_waiting_sender = 0;
+   diosix_msg_info *smsg;
+   kresult err;
+   
+   /* bounce a sender that isn't allowed to message this receiver */
+   err = msg_test_receiver(sender, receiver, &(sender->msg));
+   if(err)
+   {
+      syscall_post_msg_send(sender, err);
+      sched_wakeup(sender, 0);
+      return e_no_receiver;
+   }
+   
+   /* we've found the sending thread but the message hasn't been
+      delivered yet. we need to send the message but from the 
+      context of the receiver... */
+   lock_gate(&(sender->lock), LOCK_READ);
+   smsg = &(sender->msg);
+   
+   /* sanatise the sender's msg data pointer we're about to use */
+   if(msg_check_buffer(sender, (unsigned int)(smsg->send), smsg->send_size, VMA_READABLE))
+   {
+      unlock_gate(&(sender->lock), LOCK_READ);
+      
+      /* let the sender know about its buffer screw up and wake it up */
+      syscall_post_msg_send(sender, e_bad_source_address);
+      sched_wakeup(sender, 0);
+      
+      MSG_DEBUG("[msg:%i] sender %p (tid %i pid %i) tried to use invalid address %p for its msg data ptr\n",
+                CPU_ID, sender, sender->tid, sender->proc->pid, smsg->send);
+      return e_no_receiver;
+   }
+   
+   /* bear in mind only non-reply messages are queued because there's no need to queue a reply - 
+      a thread should already be blocked by the kernel awaiting a reply. Tell the sender
+      the result of a delivery attempt and wake it up. */
+   err = msg_deliver(receiver, msg, sender, smsg);
+   if(err)
+   {
+      MSG_DEBUG("[msg:%i] attempt to deliver queued message %x from thread %i process %i to "
+                "thread %i process %i (%x) failed with error code %i\n", CPU_ID,
+                sender->msg_src, sender->tid, sender->proc->pid,
+                receiver->tid, receiver->proc->pid, msg, err);
+      syscall_post_msg_send(sender, err);
+      sched_wakeup(sender, 0);
+   }
+   else
+   {
+      MSG_DEBUG("[msg:%i] thread %i process %i received queued %p message from thread %i process %i "
+                "(uid %i gid %i) [result = %i]\n", CPU_ID, receiver->tid, receiver->proc->pid, sender->msg_src,
+                sender->tid, sender->proc->pid, sender->proc->uid.effective, sender->proc->gid.effective, err);
+      /* record in the sender that it's waiting for a reply from this process */
+      sender->replysource = receiver;
+   }
+   
+   unlock_gate(&(sender->lock), LOCK_READ);
+   return err;
+}
+
+/* msg_recv
+   Block a thread until a message or signal comes in
+   => receiver = thread waiting to receive
+      info = block to fill with received message details
+   <= success or an error code
+*/
+kresult msg_recv(thread *receiver, diosix_msg_info *msg)
+{
+   msg_endpoint *endpoint;
+   thread *sender;
+   kresult err;
    
    /* basic sanity checks */
    if(!receiver || !msg) return e_bad_address;
    if((unsigned int)msg + MEM_CLIP(msg, sizeof(diosix_msg_info)) >= KERNEL_SPACE_BASE)
       return e_bad_address;
 
+   endpoint = &(receiver->proc->endpoint);
+
    if(lock_gate(&(receiver->lock), LOCK_WRITE)) return e_failure;
    
    /* grab a copy of the receiver's details */
    vmm_memcpy(&(receiver->msg), msg, sizeof(diosix_msg_info));
    receiver->msg_src = msg;
    
+   /* a thread collecting its process's pending IRQs needs room to put them, and
+      the buffer is checked now so the IRQ handler can fill it without faulting */
+   if(msg->flags & DIOSIX_MSG_IRQSET)
+   {
+      if(msg->recv_max_size < sizeof(diosix_irq_set))
+         err = e_too_small;
+      else
+         err = msg_check_buffer(receiver, (unsigned int)(msg->recv), sizeof(diosix_irq_set), VMA_WRITEABLE);
+      
+      if(err)
+      {
+         unlock_gate(&(receiver->lock), LOCK_WRITE);
+         return (err == e_too_small) ? err : e_bad_target_address;
+      }
+   }
+   
    /* if receiving a signal, return immediately if one's queued and ready to go */
    if((msg->flags & DIOSIX_MSG_TYPEMASK) == DIOSIX_MSG_SIGNAL)
    {
       queued_signal *sig = NULL;
       kpool *pool = receiver->proc->system_signals; /* the default pool */
+      diosix_irq_set snapshot;
+      unsigned int irq;
+      
+      /* pending IRQs go first */
+      lock_spin(&(endpoint->lock));
+      irq = msg_take_irqs(receiver->proc, &snapshot, msg->flags);
+      unlock_spin(&(endpoint->lock));
+      
+      if(irq < DIOSIX_IRQ_LINES)
+      {
+         err = msg_give_irqs(receiver, &snapshot, irq, 0);
+         unlock_gate(&(receiver->lock), LOCK_WRITE);
+         return err;
+      }
       
       /* check kernel and unix signals first */
       if(receiver->proc->system_signals)
@@ -855,45 +1508,24 @@ kresult msg_recv(thread *receiver, diosix_msg_info *msg)
    /* if not a signal, then check to see if a non-reply message is queued */
    else if((msg->flags & DIOSIX_MSG_TYPEMASK) == DIOSIX_MSG_GENERIC)
    {
-      queued_sender *queued = NULL;
-      process *sender_proc = NULL;
-      thread *sender = NULL;
-      diosix_msg_info *smsg;
-      unsigned char search_done = 0; /* set to non-zero to end search */
-
-      /* search for a suitable message */
-      while(!search_done)
+      /* the endpoint orders its queues as its receivers ask */
+      lock_spin(&(endpoint->lock));
+      if(msg->flags & DIOSIX_MSG_BYPRIORITY)
+         endpoint->flags |= MSG_ENDPOINT_BYPRIORITY;
+      else
+         endpoint->flags &= ~MSG_ENDPOINT_BYPRIORITY;
+      unlock_spin(&(endpoint->lock));
+      
+      /* take the first sender queued on the endpoint, turning away any
+         that can't deliver to this receiver */
+      while((sender = msg_endpoint_pop(endpoint, MSG_ENDPOINT_SENDERS)))
       {
-         queued = vmm_next_in_pool(queued, receiver->proc->msg_queue);
-         if(queued)
-         {
-            /* translate pid+tid into a thread structure pointer */
-            sender_proc = proc_find_proc(queued->pid);
-            if(!sender_proc)
-            {
-               /* bin the duff queued sender block */
-               vmm_free_pool(queued, receiver->proc->msg_queue);
-               queued = NULL; /* continue searching from the head */
-            }
-            else
-            {
-               sender = thread_find_thread(sender_proc, queued->tid);
-               if(!sender)
-               {
-                  /* bin the duff queued sender block */
-                  vmm_free_pool(queued, receiver->proc->msg_queue);
-                  queued = NULL; /* continue searching from the head */
-               }
-               else
-                  /* time to test the sender v receiver */
-                  if(msg_test_receiver(sender, receiver, &(sender->msg)) == success)
-                     search_done = 1;
-            }
-         } else break; /* exit loop if vmm_next_in_pool() returns NULL */
+         err = msg_recv_queued(receiver, msg, sender);
+         if(err != e_no_receiver) goto msg_recv_delivered;
       }
       
       /* if nothing is queued then maybe a thread is waiting on a role */
-      if(!queued && receiver->proc->role)
+      if(receiver->proc->role)
       {
          sender = proc_role_wakeup(receiver->proc->role);
          if(sender)
@@ -901,83 +1533,473 @@ kresult msg_recv(thread *receiver, diosix_msg_info *msg)
             MSG_DEBUG("[msg:%i] tid %i pid %i called recv, found tid %i pid %i waiting on its role\n",
                       CPU_ID, receiver->tid, receiver->proc->pid, sender->tid, sender->proc->pid);
             
-            found_role_waiting_sender = 1;
-            
-            /* update the sender now that we've discovered a receiver for it */
-            lock_gate(&(sender->lock), LOCK_WRITE);
-            sender->replysource = receiver;
-            unlock_gate(&(sender->lock), LOCK_WRITE);
+            err = msg_recv_queued(receiver, msg, sender);
+            if(err != e_no_receiver) goto msg_recv_delivered;
          }
       }
-      
-      /* queued is either NULL for no queued message found or a suitable pointer */
-      if(queued || found_role_waiting_sender)
-      {
-         kresult err;
+   }
+   
+   /* if we're still here then block and wait for a message to arrive */
 
-         /* don't forget to free the queued_sender block */
-         if(queued) vmm_free_pool(queued, receiver->proc->msg_queue);
-         
-         /* we've found the sending thread but the message hasn't been
-            delivered yet. we need to send the message but from the 
-            context of the receiver... */
-         lock_gate(&(sender->lock), LOCK_READ);
-         smsg = &(sender->msg);
-         
-         /* sanatise the sender's msg data pointer we're about to use */
-         if(pg_preempt_fault(sender, (unsigned int)(smsg->send), smsg->send_size, VMA_READABLE))
+msg_recv_block:
+   unlock_gate(&(receiver->lock), LOCK_WRITE);
+   
+   /* bind the receiver to its process's endpoint and remove it from the queue
+      until a message comes in - unless a sender queued itself in the meantime */
+   switch(msg->flags & DIOSIX_MSG_TYPEMASK)
+   {
+      case DIOSIX_MSG_GENERIC:
+         sender = msg_endpoint_block(endpoint, MSG_ENDPOINT_GENERIC, MSG_ENDPOINT_SENDERS,
+                                     receiver, waitingformsg);
+         if(sender)
          {
-            unlock_gate(&(sender->lock), LOCK_READ);
-            
-            /* let the sender know about its buffer screw up and wake it up */
-            syscall_post_msg_send(sender, e_bad_source_address);
-            sched_add(sender->cpu, sender);
-            
-            MSG_DEBUG("[msg:%i] sender %p (tid %i pid %i) tried to use invalid address %p for its msg data ptr\n",
-                      CPU_ID, sender, sender->tid, sender->proc->pid, smsg->send);
-            goto msg_recv_block; /* bail out */
+            lock_gate(&(receiver->lock), LOCK_WRITE);
+            err = msg_recv_queued(receiver, msg, sender);
+            if(err != e_no_receiver) goto msg_recv_delivered;
+            goto msg_recv_block;
          }
+         break;
          
-         /* bear in mind only non-reply messages are queued because there's no need to queue a reply - 
-            a thread should already be blocked by the kernel awaiting a reply. Tell the sender
-            the result of a delivery attempt and wake it up. */
-         err = msg_deliver(receiver, msg, sender, smsg);
-         if(err)
-         {
-            MSG_DEBUG("[msg:%i] attempt to deliver queued message %x from thread %i process %i to "
-                      "thread %i process %i (%x) failed with error code %i\n", CPU_ID,
-                      sender->msg_src, sender->tid, sender->proc->pid,
-                      receiver->tid, receiver->proc->pid, msg, err);
-            syscall_post_msg_send(sender, err);
-            sched_add(sender->cpu, sender);
-         }
-         else
+      case DIOSIX_MSG_SIGNAL:
          {
-            MSG_DEBUG("[msg:%i] thread %i process %i received queued %p message from thread %i process %i "
-                      "(uid %i gid %i) [result = %i]\n", CPU_ID, receiver->tid, receiver->proc->pid, sender->msg_src,
-                      sender->tid, sender->proc->pid, sender->proc->uid.effective, sender->proc->gid.effective, err);
-            /* record in the sender that it's waiting for a reply from this process */
-            sender->replysource = receiver;
+            diosix_irq_set snapshot;
+            unsigned int irq;
+            
+            /* check for IRQs that came in since we last looked under the endpoint lock
+               so the IRQ handler can't miss the receiver */
+            lock_spin(&(endpoint->lock));
+            irq = msg_take_irqs(receiver->proc, &snapshot, receiver->msg.flags);
+            if(irq == DIOSIX_IRQ_LINES)
+            {
+               msg_endpoint_link(endpoint, MSG_ENDPOINT_SIGNAL, receiver, 0);
+               sched_remove(receiver, waitingformsg);
+            }
+            unlock_spin(&(endpoint->lock));
+            
+            if(irq < DIOSIX_IRQ_LINES)
+            {
+               lock_gate(&(receiver->lock), LOCK_WRITE);
+               err = msg_give_irqs(receiver, &snapshot, irq, 0);
+               goto msg_recv_delivered;
+            }
          }
+         break;
+      
+      default:
+         sched_remove(receiver, waitingformsg);
+   }
 
-         unlock_gate(&(sender->lock), LOCK_READ);
-         unlock_gate(&(receiver->lock), LOCK_WRITE);
-         
-         /* don't block, return the result immediately to the receiver */
-         return err;
-      }
+   MSG_DEBUG("[msg:%i] tid %i pid %i blocked and waiting to receive (%p)\n",
+             CPU_ID, receiver->tid, receiver->proc->pid, msg);
+
+   return success;
+   
+   /* don't block, return the result immediately to the receiver */
+msg_recv_delivered:
+   unlock_gate(&(receiver->lock), LOCK_WRITE);
+   return err;
+}
+
+/* msg_batch_can_block
+   Work out whether an entry in a batch of messages could block the thread
+   submitting it: a send that isn't a reply or signal, a reply that goes on
+   to receive, or any receive
+   => op = DIOSIX_MSG_BATCH_SEND or DIOSIX_MSG_BATCH_RECV
+      msg = the entry's message block, already checked to be in userspace
+   <= 1 if the entry could block, 0 if not
+*/
+unsigned char msg_batch_can_block(unsigned int op, diosix_msg_info *msg)
+{
+   if(op != DIOSIX_MSG_BATCH_SEND) return 1;
+   if(msg->flags & DIOSIX_MSG_SIGNAL) return 0;
+   if((msg->flags & DIOSIX_MSG_REPLY) && !(msg->flags & DIOSIX_MSG_RECVONREPLY)) return 0;
+   return 1;
+}
+
+/* msg_find_fast_receiver
+   Identify the thread a fast message is for: a caller blocked waiting on a
+   fast reply from the sender, or a thread blocked on a fast receive in a
+   layer below the sender. Threads on the fast path have their msg.flags
+   set to exactly DIOSIX_MSG_FAST, which no normal message type matches.
+   Fast receivers wait on their process's endpoint, and if none is free for
+   a call then the caller is queued on the endpoint and put to sleep until
+   a receiver picks it up. The check and the queuing are done under the
+   endpoint's lock so a caller and a receiver can't both end up waiting
+   => sender = thread sending the message
+      msg = the message: its tag is the DIOSIX_MSG_FAST_TAG() of the target,
+            its pid a role if DIOSIX_MSG_FAST_BYROLE is set
+      queued = set to 1 if the sender was queued, otherwise 0
+   <= pointer to the receiving thread, or NULL for none
+*/
+thread *msg_find_fast_receiver(thread *sender, diosix_msg_fast_info *msg, unsigned char *queued)
+{
+   process *proc;
+   msg_endpoint *ep;
+   thread *recv = NULL;
+   unsigned char layer;
+   unsigned int tid = DIOSIX_MSG_FAST_TID(msg->tag);
+   unsigned int op = msg->control & DIOSIX_MSG_FAST_OPMASK;
+   
+   *queued = 0;
+   
+   if(msg->control & DIOSIX_MSG_FAST_BYROLE)
+      proc = proc_role_lookup(DIOSIX_MSG_FAST_PID(msg->tag));
+   else
+      proc = proc_find_proc(DIOSIX_MSG_FAST_PID(msg->tag));
+   if(!proc || !(proc->threads)) return NULL;
+   
+   /* replies must name the caller */
+   if(op != DIOSIX_MSG_FAST_CALL)
+   {
+      recv = thread_find_thread(proc, tid);
+      if(recv && recv->state == waitingforreply && recv->replysource == sender &&
+         recv->msg.flags == DIOSIX_MSG_FAST)
+         return recv;
+      return NULL;
    }
    
-   /* if we're still here then block and wait for a message to arrive */
+   /* messages can only go down the layers, as with msg_test_receiver() */
+   if((sender->proc->flags & PROC_FLAG_CANMSGASUSR) && (msg->control & DIOSIX_MSG_SENDASUSR))
+      layer = LAYER_MAX;
+   else
+      layer = sender->proc->layer;
+   if(proc->layer >= layer) return NULL;
+   
+   if(tid != DIOSIX_MSG_ANY_THREAD)
+   {
+      recv = thread_find_thread(proc, tid);
+      if(!recv) return NULL;
+   }
+   
+   /* take a copy of the call in case the sender has to be queued */
+   lock_gate(&(sender->lock), LOCK_WRITE);
+   vmm_memcpy(&(sender->fast_msg), msg, sizeof(diosix_msg_fast_info));
+   sender->msg.flags = DIOSIX_MSG_FAST;
+   sender->replysource = NULL; /* replier not known at this point */
+   unlock_gate(&(sender->lock), LOCK_WRITE);
+   
+   ep = &(proc->endpoint);
+   lock_spin(&(ep->lock));
+   
+   /* take the named thread off the endpoint if it's waiting there, or
+      otherwise the first thread waiting */
+   if(recv)
+   {
+      if(recv->endpoint != ep || recv->endpoint_queue != MSG_ENDPOINT_FAST) recv = NULL;
+   }
+   else
+      recv = ep->queues[MSG_ENDPOINT_FAST].head;
+   
+   if(recv)
+      msg_endpoint_unlink(recv);
+   else
+   {
+      msg_endpoint_link(ep, MSG_ENDPOINT_FAST_CALLERS, sender, 0);
+      sched_remove(sender, waitingforreply);
+      *queued = 1;
+   }
+   
+   unlock_spin(&(ep->lock));
+   return recv;
+}
 
-msg_recv_block:
+/* msg_send_fast
+   Send a message of up to DIOSIX_MSG_FAST_MAX_WORDS words straight into the
+   saved registers of a thread blocked on the fast path. Nothing is copied
+   through memory and nothing is allocated. A call blocks the sender until a
+   fast reply arrives, queuing it until a receiver is free if need be; a reply
+   can optionally block the replier on a fast receive for the next call.
+   => sender = thread sending the message
+      msg = the message's target tag, DIOSIX_MSG_FAST_* operation, word count
+            and flags, and words. if a reply-and-receive picks up a queued call
+            straight away, the call is returned in here as for msg_recv_fast()
+   <= 0 for success, or an error code
+*/
+kresult msg_send_fast(thread *sender, diosix_msg_fast_info *msg)
+{
+   thread *receiver;
+   unsigned int op;
+   unsigned char queued;
+   
+   if(!sender || !msg) return e_bad_params;
+   if(DIOSIX_MSG_FAST_GET_WORDS(msg->control) > DIOSIX_MSG_FAST_MAX_WORDS) return e_too_big;
+   
+   op = msg->control & DIOSIX_MSG_FAST_OPMASK;
+   
+   receiver = msg_find_fast_receiver(sender, msg, &queued);
+   if(queued)
+   {
+      MSG_DEBUG("[msg:%i] queuing thread %i process %i with fast call for tag %x\n",
+                CPU_ID, sender->tid, sender->proc->pid, msg->tag);
+      return success;
+   }
+   if(!receiver) return e_no_receiver;
+   
+   lock_gate(&(receiver->lock), LOCK_WRITE);
+   
+   /* the receiver may have been woken or killed while we weren't looking */
+   if(receiver->msg.flags != DIOSIX_MSG_FAST ||
+      (receiver->state != waitingformsg && receiver->state != waitingforreply))
+   {
+      unlock_gate(&(receiver->lock), LOCK_WRITE);
+      return e_no_receiver;
+   }
+   
+   /* write the message into the receiver's registers for when it next runs */
+   syscall_post_msg_fast(receiver, success, DIOSIX_MSG_FAST_TAG(sender->proc->pid, sender->tid),
+                         (msg->control & ~(DIOSIX_MSG_FAST_BYROLE | DIOSIX_MSG_SENDASUSR)), msg->words);
+   receiver->msg.flags = 0;
+   
+   if(op == DIOSIX_MSG_FAST_CALL)
+      msg_grant_priority(receiver, sender);
+   
    unlock_gate(&(receiver->lock), LOCK_WRITE);
    
-   /* remove receiver from the queue until a message comes in */
-   sched_remove(receiver, waitingformsg);
+   lock_gate(&(sender->lock), LOCK_WRITE);
+   
+   if(op == DIOSIX_MSG_FAST_CALL)
+   {
+      /* wait on a fast reply from the receiver */
+      sender->msg.flags = DIOSIX_MSG_FAST;
+      sender->replysource = receiver;
+   }
+   else
+   {
+      /* drop any priority the replier was granted to answer the call */
+      sender->priority_granted = SCHED_PRIORITY_INVALID;
+      sched_priority_calc(sender, priority_check);
+   }
+   
+   unlock_gate(&(sender->lock), LOCK_WRITE);
+   
+   if(op == DIOSIX_MSG_FAST_CALL) sched_remove(sender, waitingforreply);
+   if(op == DIOSIX_MSG_FAST_REPLY_RECV) msg_recv_fast(sender, msg);
+   
+   sched_handoff(sender, receiver);
+   
+   MSG_DEBUG("[msg:%i] thread %i of process %i sent %i word fast message (op %i) to thread %i of process %i\n",
+             CPU_ID, sender->tid, sender->proc->pid, DIOSIX_MSG_FAST_GET_WORDS(msg->control), op,
+             receiver->tid, receiver->proc->pid);
+   
+   return success;
+}
 
-   MSG_DEBUG("[msg:%i] tid %i pid %i blocked and waiting to receive (%p)\n",
-             CPU_ID, receiver->tid, receiver->proc->pid, msg);
+/* msg_recv_fast
+   Block a thread on its process's endpoint until a fast call arrives, unless
+   a caller is already queued there for it, in which case the call is taken
+   straight away and the caller left waiting on the thread's reply
+   => receiver = thread waiting to receive
+      msg = filled in with the caller's tag, the call's control word and its
+            words if a queued call was taken, otherwise its control is set
+            to DIOSIX_MSG_FAST_RECV and the thread is blocked
+   <= success or an error code
+*/
+kresult msg_recv_fast(thread *receiver, diosix_msg_fast_info *msg)
+{
+   msg_endpoint *ep;
+   thread *caller;
+   unsigned int tid;
+   
+   if(!receiver || !msg) return e_bad_params;
+   
+   if(lock_gate(&(receiver->lock), LOCK_WRITE)) return e_failure;
+   receiver->msg.flags = DIOSIX_MSG_FAST;
+   unlock_gate(&(receiver->lock), LOCK_WRITE);
+   
+   ep = &(receiver->proc->endpoint);
+   lock_spin(&(ep->lock));
+   
+   /* take the first queued caller that named this thread or any thread */
+   for(caller = ep->queues[MSG_ENDPOINT_FAST_CALLERS].head; caller; caller = caller->endpoint_next)
+   {
+      tid = DIOSIX_MSG_FAST_TID(caller->fast_msg.tag);
+      if(tid == DIOSIX_MSG_ANY_THREAD || tid == receiver->tid) break;
+   }
+   
+   if(caller)
+      msg_endpoint_unlink(caller);
+   else
+   {
+      msg_endpoint_link(ep, MSG_ENDPOINT_FAST, receiver, 0);
+      sched_remove(receiver, waitingformsg);
+   }
+   
+   unlock_spin(&(ep->lock));
+   
+   if(!caller)
+   {
+      msg->control = DIOSIX_MSG_FAST_RECV;
+      
+      MSG_DEBUG("[msg:%i] tid %i pid %i blocked and waiting to receive a fast message\n",
+                CPU_ID, receiver->tid, receiver->proc->pid);
+      return success;
+   }
+   
+   /* hand the call to the receiver and have the caller wait on its reply */
+   lock_gate(&(caller->lock), LOCK_WRITE);
+   msg->tag = DIOSIX_MSG_FAST_TAG(caller->proc->pid, caller->tid);
+   msg->control = caller->fast_msg.control & ~(DIOSIX_MSG_FAST_BYROLE | DIOSIX_MSG_SENDASUSR);
+   vmm_memcpy(msg->words, caller->fast_msg.words, sizeof(msg->words));
+   caller->replysource = receiver;
+   unlock_gate(&(caller->lock), LOCK_WRITE);
+   
+   lock_gate(&(receiver->lock), LOCK_WRITE);
+   receiver->msg.flags = 0;
+   msg_grant_priority(receiver, caller);
+   unlock_gate(&(receiver->lock), LOCK_WRITE);
+   
+   MSG_DEBUG("[msg:%i] tid %i pid %i took a queued fast call from tid %i pid %i\n",
+             CPU_ID, receiver->tid, receiver->proc->pid, caller->tid, caller->proc->pid);
+   
+   return success;
+}
+
+/* ---------------------------------------------------------------------------
+   doorbells - let threads in different processes sleep on and wake each other
+   through a word in a shared page, without exchanging messages
+   ------------------------------------------------------------------------ */
 
+thread *msg_doorbells[MSG_DOORBELL_BUCKETS];
+volatile unsigned int msg_doorbell_slock = 0;
+
+/* msg_doorbell_key
+   Resolve a doorbell word into the physical address that identifies it in
+   every process sharing its page
+   => owner = thread using the doorbell
+      addr = address of the doorbell word in the thread's process
+      key = pointer to word to store the physical address in
+   <= 0 for success or an error code
+*/
+kresult msg_doorbell_key(thread *owner, unsigned int addr, unsigned int *key)
+{
+   if(!owner || !key) return e_bad_params;
+   
+   /* doorbells must be aligned words in userspace */
+   if(!addr || (addr & (sizeof(unsigned int) - 1)) ||
+      ((addr + MEM_CLIP(addr, sizeof(unsigned int))) >= KERNEL_SPACE_BASE))
+      return e_bad_address;
+   
+   /* make sure there's a physical page behind the word */
+   if(pg_preempt_fault(owner, addr, sizeof(unsigned int), VMA_READABLE))
+      return e_bad_address;
+   *(key) = 0;
+   if(pg_user2phys(key, owner->proc->pgdir, addr) || !*(key))
+      return e_bad_address;
+   
    return success;
 }
+
+/* msg_doorbell_wait
+   Block a thread until a doorbell is rung, unless the doorbell word no longer
+   holds the value the thread expects, in which case it has already been rung
+   => waiter = thread to block
+      addr = address of the doorbell word in the thread's process
+      expected = value the thread last saw in the doorbell word
+   <= 0 for success or an error code
+*/
+kresult msg_doorbell_wait(thread *waiter, unsigned int addr, unsigned int expected)
+{
+   unsigned int key, bucket;
+   kresult err;
+   
+   if(!waiter) return e_bad_params;
+   
+   err = msg_doorbell_key(waiter, addr, &key);
+   if(err) return err;
+   bucket = MSG_DOORBELL_HASH(key);
+   
+   lock_spin(&msg_doorbell_slock);
+   
+   /* checking the word under the lock means a ring can't slip in unnoticed */
+   if(*((volatile unsigned int *)KERNEL_PHYS2LOG(key)) != expected)
+   {
+      unlock_spin(&msg_doorbell_slock);
+      return success;
+   }
+   
+   waiter->doorbell = key;
+   waiter->doorbell_prev = NULL;
+   waiter->doorbell_next = msg_doorbells[bucket];
+   if(msg_doorbells[bucket]) msg_doorbells[bucket]->doorbell_prev = waiter;
+   msg_doorbells[bucket] = waiter;
+   
+   sched_remove(waiter, sleeping);
+   
+   unlock_spin(&msg_doorbell_slock);
+   
+   MSG_DEBUG("[msg:%i] tid %i pid %i waiting on doorbell %x (phys %x)\n",
+             CPU_ID, waiter->tid, waiter->proc->pid, addr, key);
+   
+   return success;
+}
+
+/* msg_doorbell_unlink
+   Take a thread off its doorbell's wait list - call with msg_doorbell_slock held
+   => victim = thread to unlink
+*/
+void msg_doorbell_unlink(thread *victim)
+{
+   if(victim->doorbell_next)
+      victim->doorbell_next->doorbell_prev = victim->doorbell_prev;
+   if(victim->doorbell_prev)
+      victim->doorbell_prev->doorbell_next = victim->doorbell_next;
+   else
+      msg_doorbells[MSG_DOORBELL_HASH(victim->doorbell)] = victim->doorbell_next;
+   
+   victim->doorbell = 0;
+   victim->doorbell_prev = victim->doorbell_next = NULL;
+}
+
+/* msg_doorbell_ring
+   Wake up every thread waiting on a doorbell
+   => ringer = thread ringing the doorbell
+      addr = address of the doorbell word in the ringer's process
+   <= 0 for success or an error code
+*/
+kresult msg_doorbell_ring(thread *ringer, unsigned int addr)
+{
+   unsigned int key;
+   thread *search;
+   kresult err;
+   
+   if(!ringer) return e_bad_params;
+   
+   err = msg_doorbell_key(ringer, addr, &key);
+   if(err) return err;
+   
+   lock_spin(&msg_doorbell_slock);
+   
+   search = msg_doorbells[MSG_DOORBELL_HASH(key)];
+   while(search)
+   {
+      thread *next = search->doorbell_next;
+      
+      if(search->doorbell == key)
+      {
+         msg_doorbell_unlink(search);
+         sched_wakeup(search, 0);
+         
+         MSG_DEBUG("[msg:%i] tid %i pid %i rang doorbell %x (phys %x) for tid %i pid %i\n",
+                   CPU_ID, ringer->tid, ringer->proc->pid, addr, key, search->tid, search->proc->pid);
+      }
+      
+      search = next;
+   }
+   
+   unlock_spin(&msg_doorbell_slock);
+   
+   return success;
+}
+
+/* msg_doorbell_cancel
+   Remove a dying thread from any doorbell it is waiting on
+   => victim = thread to remove
+*/
+void msg_doorbell_cancel(thread *victim)
+{
+   if(!victim) return;
+   
+   lock_spin(&msg_doorbell_slock);
+   if(victim->doorbell) msg_doorbell_unlink(victim);
+   unlock_spin(&msg_doorbell_slock);
+}
@@ -480,7 +480,7 @@ process *proc_new(process *current, thread *caller)
    kresult err;
    
    /* grab memory to hold the process structure and zero-fill it */
-   err = vmm_malloc((void **)&new, sizeof(process));
+   err = vmm_cache_alloc((void **)&new, KCACHE_PROCESS);
    if(err) return NULL; /* fail if we can't even alloc a process */
 
    vmm_memset(new, 0, sizeof(process));
@@ -491,7 +491,7 @@ process *proc_new(process *current, thread *caller)
    if(proc_count >= PROC_MAX_NR)
    {
       unlock_gate(&proc_lock, LOCK_WRITE);
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_PROCESS);
       return NULL;
    }
 
@@ -530,7 +530,7 @@ process *proc_new(process *current, thread *caller)
    
       if(lock_gate(&(current->lock), LOCK_WRITE))
       {
-         vmm_free(new);
+         vmm_cache_free(new, KCACHE_PROCESS);
          return NULL;         
       }
       
@@ -554,7 +554,7 @@ process *proc_new(process *current, thread *caller)
       if(proc_attach_child(current, new))
       {
          unlock_gate(&(current->lock), LOCK_WRITE);
-         vmm_free(new);
+         vmm_cache_free(new, KCACHE_PROCESS);
          return NULL;
       }
 
@@ -562,7 +562,7 @@ process *proc_new(process *current, thread *caller)
       if(thread_new_hash(new))
       {
          proc_remove_child(current, new);
-         vmm_free(new); /* tidy up */
+         vmm_cache_free(new, KCACHE_PROCESS); /* tidy up */
          unlock_gate(&(current->lock), LOCK_WRITE);
          return NULL;
       }
@@ -576,7 +576,7 @@ process *proc_new(process *current, thread *caller)
       if(!dupthread)
       {
          proc_remove_child(current, new);
-         vmm_free(new); /* tidy up */
+         vmm_cache_free(new, KCACHE_PROCESS); /* tidy up */
          unlock_gate(&(current->lock), LOCK_WRITE);
          return NULL;
       }
@@ -620,6 +620,35 @@ process *proc_new(process *current, thread *caller)
    return new;
 }
 
+/* proc_sum_cycles
+   Total up the cpu time used by a process's threads, living and dead
+   => proc = process to examine
+      totals = array of THREAD_CYCLES_TYPES counters to fill in
+*/
+void proc_sum_cycles(process *proc, unsigned long long *totals)
+{
+   unsigned int loop, type;
+   unsigned long long cycles[THREAD_CYCLES_TYPES];
+   thread *search;
+   
+   lock_gate(&(proc->lock), LOCK_READ);
+   
+   for(type = 0; type < THREAD_CYCLES_TYPES; type++)
+      totals[type] = proc->cycles[type];
+   
+   /* the threads may be running on other cpus, adding to their counters */
+   if(proc->threads)
+      for(loop = 0; loop < THREAD_HASH_BUCKETS; loop++)
+         for(search = proc->threads[loop]; search; search = search->hash_next)
+         {
+            sched_read_cycles(search, cycles);
+            for(type = 0; type < THREAD_CYCLES_TYPES; type++)
+               totals[type] += cycles[type];
+         }
+   
+   unlock_gate(&(proc->lock), LOCK_READ);
+}
+
 /* proc_kill
    Request to kill the given process
    => victimpid = PID of process to destroy (USER-SUPPLIED)
@@ -628,6 +657,7 @@ process *proc_new(process *current, thread *caller)
 kresult proc_kill(unsigned int victimpid, process *slayer)
 {
    process *victim, *parent;
+   thread *sender;
    unsigned int loop;
    
    /* sanity checks */
@@ -685,6 +715,15 @@ do_proc_kill:
    /* destroy the threads */
    thread_kill(victim, NULL);
    
+   /* hand the process's cpu time, and its children's, to the parent */
+   if(parent)
+   {
+      lock_gate(&(parent->lock), LOCK_WRITE);
+      for(loop = 0; loop < THREAD_CYCLES_TYPES; loop++)
+         parent->child_cycles[loop] += victim->cycles[loop] + victim->child_cycles[loop];
+      unlock_gate(&(parent->lock), LOCK_WRITE);
+   }
+   
    /* won't someone think of the children? */
    if(victim->children)
    {
@@ -705,30 +744,17 @@ do_proc_kill:
    /* remove the message pools */
    if(victim->system_signals) vmm_destroy_pool(victim->system_signals);
    if(victim->user_signals) vmm_destroy_pool(victim->user_signals);
-   if(victim->msg_queue)
+   
+   /* wake up each thread queued to send to the process to tell them it's game over */
+   while((sender = msg_endpoint_pop(&(victim->endpoint), MSG_ENDPOINT_SENDERS)))
    {
-      /* wake up each waiting process to tell them it's game over */
-      queued_sender *sender = NULL;
-      for(;;)
-      {
-         sender = vmm_next_in_pool(sender, victim->msg_queue);
-         if(sender)
-         {
-            process *sender_proc = proc_find_proc(sender->pid);
-            if(sender_proc)
-            {
-               thread *sender_thread = thread_find_thread(sender_proc, sender->tid);
-               if(sender_thread)
-               {
-                  syscall_post_msg_send(sender_thread, e_no_receiver);
-                  sched_add(sender_thread->cpu, sender_thread);
-               }
-            }
-         }
-         else break; /* no more senders queued */
-      }
-      
-      vmm_destroy_pool(victim->msg_queue);
+      syscall_post_msg_send(sender, e_no_receiver);
+      sched_wakeup(sender, 0);
+   }
+   while((sender = msg_endpoint_pop(&(victim->endpoint), MSG_ENDPOINT_FAST_CALLERS)))
+   {
+      syscall_post_msg_send(sender, e_no_receiver);
+      sched_wakeup(sender, 0);
    }
    
    /* teardown the process's virtual memory structures */
@@ -748,9 +774,10 @@ do_proc_kill:
       irq_deregister_driver(entry->irq_num, entry->flags & IRQ_DRIVER_TYPEMASK,
                             entry->proc, entry->func);
    }
+   if(victim->irqs_pending) vmm_free(victim->irqs_pending);
    
    /* give up the space held by the process structure */
-   vmm_free(victim);
+   vmm_cache_free(victim, KCACHE_PROCESS);
    
    /* don't forget to dispatch a signal to the parent and
       don't fret if the parent shuns its moment of mourning */
@@ -758,6 +785,7 @@ do_proc_kill:
    
    PROC_DEBUG("[proc:%i] killed process %i (%p) [current tid %i pid %i]\n", CPU_ID, victim->pid, victim,
               cpu_table[CPU_ID].current->tid, cpu_table[CPU_ID].current->proc->pid);
+   VMM_DEBUG_CACHES;
    
    return success;
 }
@@ -19,37 +19,66 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 
 /* maintain a rough msec counter since scheduler start up */ 
 volatile unsigned int sched_msec_counter = 0;
+unsigned long long sched_msec_stamp = 0; /* usec clock reading the counter was last synced with */
 unsigned int sched_caretaker_tick = SCHED_CARETAKER;
-kpool *sched_bedroom; /* queued pool of sleeping threads waiting for an alarm timeout */
+kpool *sched_bedroom; /* pool of timer blocks for threads waiting on the scheduler clock */
+
+/* the cpu responsible for the msec counter and caretaker - handed over
+   to a ticking cpu when the keeper goes idle with its tick stopped */
+volatile unsigned char sched_timekeeper = 0;
 
 /* provide spinlocking around critical sections */
-volatile unsigned int sched_next_queue_slock = 0;
-volatile unsigned int sched_total_queued_slock = 0;
+volatile unsigned int sched_timekeeper_slock = 0;
+
+/* per-cpu rings of scheduler trace events, NULL until the scheduler starts */
+sched_trace_ring *sched_trace_rings = NULL;
 
-/* act as a 'clock arm' selecting cpu queues one by one */
-unsigned char sched_next_queue = 0;
-unsigned int sched_total_queued = 0; /* number of threads queued */
+/* keep the compiler from reordering writes and reads around the sequence
+   numbers that guard trace entries and cpu time counters. the cpu keeps
+   stores and loads in order on x86, and the arm port is uniprocessor */
+#define SCHED_BARRIER() __asm__ __volatile__("" : : : "memory")
 
-/* sched_inc_queued_threads
- Increment the number of queued threads total in a thread-safe manner */
-void sched_inc_queued_threads(void)
+/* per-mille of a cpu's time reserved by real-time threads across the system */
+unsigned int sched_rt_reserved = 0;
+volatile unsigned int sched_rt_slock = 0;
+
+/* sched_total_queued
+   Sum the per-cpu counts of queued threads. The counters are read without
+   taking the cpus' locks so the total is approximate, which is good enough
+   for balancing decisions and avoids a global lock on the enqueue path.
+   <= approximate number of threads queued across the system
+*/
+unsigned int sched_total_queued(void)
 {
-   lock_spin(&(sched_total_queued_slock));
-   sched_total_queued++;
-   unlock_spin(&(sched_total_queued_slock));
+   unsigned int loop, total = 0;
    
-   SCHED_DEBUG("[sched:%i] total queued threads now: %i (up one)\n", CPU_ID, sched_total_queued);
+   for(loop = 0; loop < mp_cpus; loop++)
+      total += cpu_table[loop].queued;
+   
+   return total;
 }
 
-/* sched_dec_queued_threads
-   Decrement the number of queued threads total in a thread-safe manner */
-void sched_dec_queued_threads(void)
+/* sched_total_migrations
+   Sum the per-cpu counts of threads moved between cpus
+   <= approximate number of thread migrations since boot
+*/
+unsigned int sched_total_migrations(void)
 {
-   lock_spin(&(sched_total_queued_slock));
-   sched_total_queued--;
-   unlock_spin(&(sched_total_queued_slock));
+   unsigned int loop, total = 0;
+   
+   for(loop = 0; loop < mp_cpus; loop++)
+      total += cpu_table[loop].migrations;
    
-   SCHED_DEBUG("[sched:%i] total queued threads now: %i (down one)\n", CPU_ID, sched_total_queued);
+   return total;
+}
+
+/* sched_get_usec
+   <= time since boot in microseconds from the high-resolution clock, or the
+      scheduler's msec counter converted to usec if there isn't one
+*/
+unsigned long long sched_get_usec(void)
+{
+   return lowlevel_read_usec();
 }
 
 /* sched_determine_priority
@@ -58,6 +87,15 @@ unsigned char sched_determine_priority(thread *target)
 {
    unsigned char priority;
    
+   /* real-time threads with budget left run ahead of everything else */
+   if(target->rt_period)
+   {
+      if(target->rt_remaining) return SCHED_PRIORITY_REALTIME;
+      
+      /* a driver that's spent its budget mustn't sit above normal threads */
+      if(target->flags & THREAD_FLAG_ISDRIVER) return SCHED_PRIORITY_MIN;
+   }
+   
    /* driver threads always get priority 0 (or 1 if punished) */
    if(target->flags & THREAD_FLAG_ISDRIVER) return target->priority;
    
@@ -87,6 +125,12 @@ thread *sched_get_next_to_run(unsigned char cpuid)
    volatile thread *torun;
 
    lock_gate(&(cpu->lock), LOCK_READ);
+   
+   /* this look at the queues answers any reschedule IPI sent to this cpu so far.
+      wakeups set resched_pending with a write lock on the cpu, so one that
+      lands after this will see it clear and send another */
+   if(cpuid == CPU_ID) cpu->resched_pending = 0;
+   
    cpu_queue = &(cpu->queues[cpu->lowest_queue_filled]);
    torun = (volatile thread *)(cpu_queue->queue_head);
    unlock_gate(&(cpu->lock), LOCK_READ);
@@ -105,6 +149,7 @@ thread *sched_get_next_to_run(unsigned char cpuid)
 void sched_priority_calc(thread *tocalc, sched_priority_request request)
 {
    unsigned int priority, priority_low_limit, priority_high_limit;
+   unsigned char old_priority;
    
    /* sanatise input */
    if(!tocalc)
@@ -120,6 +165,7 @@ void sched_priority_calc(thread *tocalc, sched_priority_request request)
    if(tocalc->flags & THREAD_FLAG_ISDRIVER)
    {
       lock_gate(&(tocalc->lock), LOCK_WRITE);
+      old_priority = tocalc->priority;
       
       if(request == priority_expiry_punish)
          /* a punished driver thread sits in priority queue above the
@@ -128,11 +174,15 @@ void sched_priority_calc(thread *tocalc, sched_priority_request request)
       else
          tocalc->priority = SCHED_PRIORITY_INTERRUPTS;
 
+      if(tocalc->priority != old_priority)
+         sched_trace(DIOSIX_TRACE_PRIORITY, tocalc, old_priority, tocalc->priority);
+
       unlock_gate(&(tocalc->lock), LOCK_WRITE);
       return;
    }
    
    lock_gate(&(tocalc->lock), LOCK_WRITE);
+   old_priority = tocalc->priority;
    
    /* get the correct priority level to use */
    priority = sched_determine_priority(tocalc);
@@ -212,9 +262,373 @@ void sched_priority_calc(thread *tocalc, sched_priority_request request)
                      CPU_ID, request, tocalc);
    }
    
+   if(tocalc->priority != old_priority)
+      sched_trace(DIOSIX_TRACE_PRIORITY, tocalc, old_priority, tocalc->priority);
+   
    unlock_gate(&(tocalc->lock), LOCK_WRITE);
 }
 
+/* sched_set_hrtimer
+   Program this cpu's timer to interrupt it after the given time, unless
+   it's already due to go off sooner. The periodic tick is paused until then.
+   A cpu idling tickless isn't woken for these
+   => usec = microseconds from now, less than a tick
+*/
+void sched_set_hrtimer(unsigned int usec)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   unsigned long long due = sched_get_usec() + usec;
+   
+   if(cpu->tickless || (cpu->hrtimer && cpu->hrtimer_due <= due)) return;
+   
+   if(lowlevel_timer_oneshot_usec(usec) == success)
+   {
+      cpu->hrtimer = 1;
+      cpu->hrtimer_due = due;
+   }
+}
+
+/* sched_rt_util
+   <= per-mille of a cpu's time taken up by a real-time reservation, erring on the high side
+*/
+unsigned int sched_rt_util(unsigned int period, unsigned int budget)
+{
+   unsigned int util;
+   
+   /* stick to 32-bit arithmetic: there's no runtime support for 64-bit divides.
+      keep budget * 1000 in range, rounding the budget up and the period down */
+   while(budget > 0x3fffff)
+   {
+      budget = (budget >> 1) + (budget & 1);
+      period = period >> 1;
+   }
+   
+   /* round up so a tiny budget can't slip past admission control */
+   util = (budget * 1000) / period;
+   if(util * period < budget * 1000) util++;
+   
+   return util;
+}
+
+/* sched_set_realtime
+   Move a thread into or out of the real-time scheduling class. A thread may
+   only join if its reservation fits within SCHED_RT_MAX_UTIL of one cpu, as
+   it can only run on one cpu at a time, and there's enough unreserved cpu
+   time left in the system.
+   => target = thread to operate on
+      period = length of the thread's scheduling period in usec, or 0 to leave the class
+      budget = usec of cpu time the thread may use at real-time priority each period
+   <= 0 for success, or an error code
+*/
+kresult sched_set_realtime(thread *target, unsigned int period, unsigned int budget)
+{
+   unsigned int util = 0, old_util = 0;
+   unsigned long long now;
+   
+   if(!target) return e_bad_params;
+   
+   if(period)
+   {
+      if(period < SCHED_RT_MIN_PERIOD || !budget || budget > period) return e_bad_params;
+      util = sched_rt_util(period, budget);
+      
+      /* a thread mustn't be able to hog its cpu at real-time priority */
+      if(util > SCHED_RT_MAX_UTIL) return e_too_big;
+   }
+   
+   lock_spin(&sched_rt_slock);
+   
+   if(target->rt_period) old_util = sched_rt_util(target->rt_period, target->rt_budget);
+   if(sched_rt_reserved - old_util + util > SCHED_RT_MAX_UTIL * mp_cpus)
+   {
+      unlock_spin(&sched_rt_slock);
+      return e_too_big;
+   }
+   sched_rt_reserved = sched_rt_reserved - old_util + util;
+   
+   unlock_spin(&sched_rt_slock);
+   
+   now = sched_get_usec();
+   
+   lock_gate(&(target->lock), LOCK_WRITE);
+   target->rt_period       = period;
+   target->rt_budget       = budget;
+   target->rt_remaining    = budget;
+   target->rt_debt         = 0;
+   target->rt_period_start = now;
+   target->rt_ran_from     = now;
+   unlock_gate(&(target->lock), LOCK_WRITE);
+   
+   if(!period) sched_cancel_snoozer(target, replenish);
+   
+   SCHED_DEBUG("[sched:%i] thread %i of process %i real-time period %i usec budget %i usec (%i/%i reserved)\n",
+               CPU_ID, target->tid, target->proc->pid, period, budget, sched_rt_reserved, SCHED_RT_MAX_UTIL * mp_cpus);
+   
+   return success;
+}
+
+/* sched_rt_charge
+   Deduct the time a real-time thread has spent running from its budget,
+   giving it a fresh budget if it's moved into a new period.
+   => target = real-time thread to charge
+      now = current time in usec
+   <= non-zero if the thread has run out of budget
+*/
+unsigned char sched_rt_charge(thread *target, unsigned long long now)
+{
+   unsigned long long used;
+   unsigned char exhausted = 0;
+   
+   lock_gate(&(target->lock), LOCK_WRITE);
+   
+   used = now - target->rt_ran_from;
+   target->rt_ran_from = now;
+   
+   /* throttled threads are replenished by timer instead */
+   if(target->rt_remaining && now >= target->rt_period_start + target->rt_period)
+   {
+      target->rt_period_start = now;
+      target->rt_remaining = target->rt_budget;
+   }
+   
+   if(used >= target->rt_remaining)
+   {
+      /* the budget's only checked when the cpu is interrupted, so make
+         the thread pay back any time it ran over */
+      used -= target->rt_remaining;
+      if(target->rt_debt + used < target->rt_debt || used > 0xffffffff)
+         target->rt_debt = 0xffffffff;
+      else
+         target->rt_debt += (unsigned int)used;
+      
+      target->rt_remaining = 0;
+      exhausted = 1;
+   }
+   else
+      target->rt_remaining -= (unsigned int)used;
+   
+   unlock_gate(&(target->lock), LOCK_WRITE);
+   
+   return exhausted;
+}
+
+/* sched_rt_throttle
+   Arrange for a real-time thread that's spent its budget to have it topped
+   up when its current period ends. Until then it runs at its normal priority.
+   => target = real-time thread to throttle
+      now = current time in usec
+*/
+void sched_rt_throttle(thread *target, unsigned long long now)
+{
+   unsigned long long end = target->rt_period_start + target->rt_period;
+   
+   SCHED_DEBUG("[sched:%i] real-time thread %i of process %i out of budget\n",
+               CPU_ID, target->tid, target->proc->pid);
+   
+   sched_add_timer(target, 0, (end > now) ? (unsigned int)(end - now) : 1, replenish);
+}
+
+/* sched_rt_replenish
+   Start a new period for a throttled real-time thread, restoring its budget
+   and returning it to real-time priority if it's waiting to run
+   => target = thread to replenish
+*/
+void sched_rt_replenish(thread *target)
+{
+   unsigned char requeue;
+   unsigned long long now;
+   
+   lock_gate(&(target->lock), LOCK_WRITE);
+   
+   /* the thread may have left the class since the timer was set */
+   if(!target->rt_period)
+   {
+      unlock_gate(&(target->lock), LOCK_WRITE);
+      return;
+   }
+   
+   now = target->rt_period_start = target->rt_ran_from = sched_get_usec();
+   
+   /* pay off any overrun before the thread gets its budget back */
+   if(target->rt_debt >= target->rt_budget)
+   {
+      target->rt_debt -= target->rt_budget;
+      target->rt_remaining = 0;
+   }
+   else
+   {
+      target->rt_remaining = target->rt_budget - target->rt_debt;
+      target->rt_debt = 0;
+   }
+   
+   requeue = (target->state == running || target->state == inrunqueue);
+   
+   unlock_gate(&(target->lock), LOCK_WRITE);
+   
+   /* still in the red means sitting out another period */
+   if(!(target->rt_remaining))
+   {
+      sched_rt_throttle(target, now);
+      return;
+   }
+   
+   if(requeue) sched_move_to_end(target->cpu, target);
+}
+
+/* sched_rt_stop
+   Charge a real-time thread that's leaving the cpu for the time it ran and,
+   if it's spent its budget, throttle it and move it out of the real-time
+   run queue if it's still waiting to run
+   => target = thread leaving the cpu
+*/
+void sched_rt_stop(thread *target)
+{
+   unsigned long long now;
+   
+   if(!(target->rt_period) || !(target->rt_remaining)) return;
+   
+   now = sched_get_usec();
+   if(!sched_rt_charge(target, now)) return;
+   
+   sched_rt_throttle(target, now);
+   if(target->state == running || target->state == inrunqueue)
+      sched_move_to_end(target->cpu, target);
+}
+
+/* sched_rt_arm
+   Make sure the cpu is interrupted when the real-time thread it's about to
+   run spends its budget, if that's sooner than the next tick
+   => target = thread about to run on this cpu
+*/
+void sched_rt_arm(thread *target)
+{
+   if(target->rt_period && target->rt_remaining &&
+      target->rt_remaining < SCHED_USEC_PER_TICK)
+      sched_set_hrtimer(target->rt_remaining);
+}
+
+/* sched_account
+   Charge the cycles this cpu has spent since it last charged a thread to the
+   given thread, and note what the cpu is going to be doing from now on. The
+   counters are only written by the cpu running the thread, so no locks needed,
+   but other cpus reading them must use sched_read_cycles
+   => target = thread to charge, or NULL if the cpu was idle
+      type = THREAD_CYCLES_* bucket the cpu's cycles should go into from now on
+*/
+void sched_account(thread *target, unsigned char type)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   unsigned long long now = lowlevel_read_cyclecount();
+   
+   if(target)
+   {
+      /* an odd sequence number warns readers the counters are changing */
+      target->cycles_seq++;
+      SCHED_BARRIER();
+      target->cycles[cpu->acct_type] += now - cpu->acct_stamp;
+      SCHED_BARRIER();
+      target->cycles_seq++;
+   }
+   
+   cpu->acct_stamp = now;
+   cpu->acct_type  = type;
+}
+
+/* sched_read_cycles
+   Take a consistent copy of a thread's cpu time counters, which may be
+   being updated by another cpu. A 64-bit counter takes two writes on a
+   32-bit cpu, so keep trying until a copy is made without a write landing
+   => source = thread to read
+      cycles = array of THREAD_CYCLES_TYPES counters to fill in
+*/
+void sched_read_cycles(thread *source, unsigned long long *cycles)
+{
+   unsigned int seq, type;
+   
+   do
+   {
+      seq = source->cycles_seq;
+      SCHED_BARRIER();
+      
+      for(type = 0; type < THREAD_CYCLES_TYPES; type++)
+         cycles[type] = source->cycles[type];
+      
+      SCHED_BARRIER();
+   }
+   while((seq & 1) || seq != source->cycles_seq);
+}
+
+/* sched_cycles_to_cpu_time
+   Fill in a userspace cpu time block from a set of cycle counters
+   => cycles = array of THREAD_CYCLES_TYPES counters
+      block = structure to fill in
+*/
+void sched_cycles_to_cpu_time(unsigned long long *cycles, diosix_cpu_time *block)
+{
+   block->user        = cycles[THREAD_CYCLES_USER];
+   block->kernel      = cycles[THREAD_CYCLES_KERNEL];
+   block->irq         = cycles[THREAD_CYCLES_IRQ];
+   block->user_usec   = lowlevel_cycles_to_usec(cycles[THREAD_CYCLES_USER]);
+   block->kernel_usec = lowlevel_cycles_to_usec(cycles[THREAD_CYCLES_KERNEL]);
+   block->irq_usec    = lowlevel_cycles_to_usec(cycles[THREAD_CYCLES_IRQ]);
+}
+
+/* sched_lock_cpus
+   Take the write locks on two cpus' structures, lowest cpu id first. The
+   scheduler always locks a cpu before any thread queued on it, and a pair
+   of cpus in this order, so threads can be moved between cpus without
+   deadlocking
+   => a, b = ids of the cpus to lock, which may be the same
+*/
+void sched_lock_cpus(unsigned char a, unsigned char b)
+{
+   if(a > b)
+   {
+      lock_gate(&(cpu_table[b].lock), LOCK_WRITE);
+      lock_gate(&(cpu_table[a].lock), LOCK_WRITE);
+   }
+   else
+   {
+      lock_gate(&(cpu_table[a].lock), LOCK_WRITE);
+      if(b != a) lock_gate(&(cpu_table[b].lock), LOCK_WRITE);
+   }
+}
+
+/* sched_unlock_cpus
+   Release the locks taken by sched_lock_cpus
+   => a, b = ids of the cpus to unlock, which may be the same
+*/
+void sched_unlock_cpus(unsigned char a, unsigned char b)
+{
+   if(b != a) unlock_gate(&(cpu_table[b].lock), LOCK_WRITE);
+   unlock_gate(&(cpu_table[a].lock), LOCK_WRITE);
+}
+
+/* sched_lock_queued_thread
+   Lock a thread and the cpu it's queued on, along with a second cpu, in
+   the scheduler's lock order. The thread may move while we wait for the
+   cpus, so keep trying until it's still on the cpu we locked
+   => victim = thread to lock
+      other = id of a second cpu to lock, or the same cpu as the thread's
+   <= id of the cpu the thread is on
+*/
+unsigned char sched_lock_queued_thread(thread *victim, unsigned char other)
+{
+   unsigned char cpu;
+   
+   for(;;)
+   {
+      cpu = victim->cpu;
+      sched_lock_cpus(cpu, (other < mp_cpus) ? other : cpu);
+      lock_gate(&(victim->lock), LOCK_WRITE);
+      
+      if(victim->cpu == cpu) return cpu;
+      
+      unlock_gate(&(victim->lock), LOCK_WRITE);
+      sched_unlock_cpus(cpu, (other < mp_cpus) ? other : cpu);
+   }
+}
+
 /* sched_lock_thread
    Stop a thread from running, remove it from the queue and lock
    it out until it is unlocked. This will momentarily block until
@@ -227,7 +641,7 @@ void sched_priority_calc(thread *tocalc, sched_priority_request request)
  */
 kresult sched_lock_thread(thread *victim)
 {
-   unsigned char id = CPU_ID;
+   unsigned char id = CPU_ID, cpu;
    
    if(!victim) return e_failure;
    
@@ -242,12 +656,13 @@ kresult sched_lock_thread(thread *victim)
    unlock_gate(&(cpu_table[id].lock), LOCK_READ);
    
    /* if the process is running then interrupt the other cpu */
-   lock_gate(&(victim->lock), LOCK_READ);
+   cpu = sched_lock_queued_thread(victim, mp_cpus);
    
    if(victim->state == inrunqueue)
       sched_remove(victim, held);
    
-   unlock_gate(&(victim->lock), LOCK_READ);
+   unlock_gate(&(victim->lock), LOCK_WRITE);
+   sched_unlock_cpus(cpu, cpu);
    
    return success;
 }
@@ -325,7 +740,7 @@ kresult sched_lock_proc(process *proc)
  */
 kresult sched_unlock_thread(thread *towake)
 {
-   unsigned char id = CPU_ID;
+   unsigned char id = CPU_ID, cpu;
    
    if(!towake) return e_failure;
    
@@ -339,165 +754,716 @@ kresult sched_unlock_thread(thread *towake)
    
    unlock_gate(&(cpu_table[id].lock), LOCK_READ);
    
-   lock_gate(&(towake->lock), LOCK_READ);
+   /* choose where the thread will run and lock that cpu before the thread */
+   cpu = sched_pick_queue(towake->proc->cpu);
+   lock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
+   lock_gate(&(towake->lock), LOCK_WRITE);
    
    /* if the thread is held then put it back on the run queue, but 
       don't requeue if the whole process is blocked */
    if(towake->state == held && !(towake->proc->flags & PROC_FLAG_RUNLOCKED))
-      sched_add(towake->proc->cpu, towake);
+      sched_enqueue(cpu, towake);
    else
    {
-      unlock_gate(&(towake->lock), LOCK_READ);
+      unlock_gate(&(towake->lock), LOCK_WRITE);
+      unlock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
+      return e_failure;
+   }
+
+   unlock_gate(&(towake->lock), LOCK_WRITE);
+   unlock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
+   
+   return success;
+}
+
+/* sched_unlock_proc
+   Release a previously process from a held state and allow its threads to
+   run again. It is not appropriate for the currently running process to
+   somehow wake itself up.
+   => proc = process to release
+   <= success or a failure code
+*/
+kresult sched_unlock_proc(process *proc)
+{
+   thread *t;
+   unsigned int loop, tfound;
+   unsigned char id = CPU_ID;
+   
+   if(!proc) return e_failure;
+   
+   lock_gate(&(cpu_table[id].lock), LOCK_READ);
+   lock_gate(&(cpu_table[id].current->lock), LOCK_READ);
+   
+   if(proc == cpu_table[id].current->proc)
+   {
+      unlock_gate(&(cpu_table[id].current->lock), LOCK_READ);
+      unlock_gate(&(cpu_table[id].lock), LOCK_READ);
       return e_failure;
    }
-
-   unlock_gate(&(towake->lock), LOCK_READ);
    
-   return success;
+   unlock_gate(&(cpu_table[id].current->lock), LOCK_READ);
+   unlock_gate(&(cpu_table[id].lock), LOCK_READ);
+   
+   SCHED_DEBUG("[sched:%i] unlocking process %i (%p)\n", CPU_ID, proc->pid, proc);
+   
+   lock_gate(&(proc->lock), LOCK_WRITE);
+   
+   /* clear the blocked flag */
+   proc->flags &= ~PROC_FLAG_RUNLOCKED;
+   
+   /* loop through the threads to run any that are held */
+   for(loop = 0; loop < THREAD_HASH_BUCKETS; loop++)
+   {
+      t = proc->threads[loop];
+      while(t)
+      {
+         sched_unlock_thread(t);
+         tfound++;
+         
+         /* try the next thread */
+         lock_gate(&(t->lock), LOCK_READ);
+         t = t->hash_next;
+         unlock_gate(&(t->lock), LOCK_READ);
+      }
+      
+      /* avoid scanning the whole hash space */
+      if(tfound >= proc->thread_count) break;
+   }
+   
+   unlock_gate(&(proc->lock), LOCK_WRITE);
+   
+   return success;
+}
+
+/* sched_wheel_insert
+   Link a timer into the correct slot of a cpu's timer wheel, going by how
+   far away its expiry is from the wheel's current tick.
+   Assumes the wheel's spinlock is held.
+   => wheel = timer wheel to add the timer to
+      snoozer = timer to add, with its expiry set
+*/
+void sched_wheel_insert(sched_timer_wheel *wheel, snoozing_thread *snoozer)
+{
+   unsigned int delta = snoozer->expiry - wheel->now;
+   unsigned int level = 0, shift = 0;
+   
+   /* timers that are already due go in the next slot to be processed */
+   if((signed int)delta < 0)
+   {
+      snoozer->expiry = wheel->now;
+      delta = 0;
+   }
+   
+   /* find the level whose range covers this timer */
+   while(level < (SCHED_WHEEL_LEVELS - 1) &&
+         delta >= (1 << (shift + SCHED_WHEEL_SLOT_BITS)))
+   {
+      level++;
+      shift += SCHED_WHEEL_SLOT_BITS;
+   }
+   
+   snoozer->slot = &(wheel->slots[level][(snoozer->expiry >> shift) & SCHED_WHEEL_SLOT_MASK]);
+   snoozer->prev = NULL;
+   snoozer->next = *(snoozer->slot);
+   if(snoozer->next) snoozer->next->prev = snoozer;
+   *(snoozer->slot) = snoozer;
+}
+
+/* sched_precise_insert
+   Link a timer into a cpu's list of timers due within the next tick or so,
+   keeping the list sorted soonest deadline first.
+   Assumes the wheel's spinlock is held.
+   => wheel = timer wheel to add the timer to
+      snoozer = timer to add, with its deadline set
+*/
+void sched_precise_insert(sched_timer_wheel *wheel, snoozing_thread *snoozer)
+{
+   snoozing_thread *prev = NULL, *next = wheel->precise;
+   
+   while(next && next->deadline <= snoozer->deadline)
+   {
+      prev = next;
+      next = next->next;
+   }
+   
+   /* sched_wheel_unlink works on this list too */
+   snoozer->slot = &(wheel->precise);
+   snoozer->prev = prev;
+   snoozer->next = next;
+   if(next) next->prev = snoozer;
+   if(prev)
+      prev->next = snoozer;
+   else
+      wheel->precise = snoozer;
+}
+
+/* sched_wheel_unlink
+   Remove a timer from its slot in a cpu's timer wheel.
+   Assumes the wheel's spinlock is held.
+   => snoozer = timer to unlink
+*/
+void sched_wheel_unlink(snoozing_thread *snoozer)
+{
+   if(snoozer->next) snoozer->next->prev = snoozer->prev;
+   if(snoozer->prev)
+      snoozer->prev->next = snoozer->next;
+   else
+      *(snoozer->slot) = snoozer->next;
+   
+   snoozer->slot = NULL;
+   snoozer->prev = snoozer->next = NULL;
+}
+
+/* sched_wheel_cascade
+   Redistribute the timers in a slot down to the levels below now that
+   the wheel has turned far enough for them to be within range.
+   Assumes the wheel's spinlock is held.
+   => wheel = timer wheel to operate on
+      level = level of the slot to empty, must be greater than zero
+   <= index of the slot that was emptied
+*/
+unsigned int sched_wheel_cascade(sched_timer_wheel *wheel, unsigned int level)
+{
+   unsigned int index = (wheel->now >> (level * SCHED_WHEEL_SLOT_BITS)) & SCHED_WHEEL_SLOT_MASK;
+   snoozing_thread *snoozer = wheel->slots[level][index], *next;
+   
+   wheel->slots[level][index] = NULL;
+   
+   while(snoozer)
+   {
+      next = snoozer->next;
+      sched_wheel_insert(wheel, snoozer);
+      snoozer = next;
+   }
+   
+   return index;
+}
+
+/* sched_wheel_tick
+   Advance a cpu's timer wheel by one tick and detach the timers that
+   expire on it, cascading timers down from the higher levels as needed.
+   Timers on this tick with part of a tick still to go until their deadline
+   are moved onto the wheel's high-resolution list instead.
+   Assumes the wheel's spinlock is held.
+   => wheel = timer wheel to operate on
+      now = current time in usec
+   <= linked list of expired timers, now disowned by their threads, or NULL
+*/
+snoozing_thread *sched_wheel_tick(sched_timer_wheel *wheel, unsigned long long now)
+{
+   snoozing_thread *expired = NULL, *snoozer, *next;
+   unsigned int index, level;
+   
+   /* pull timers down from the higher levels every time a level turns over */
+   index = wheel->now & SCHED_WHEEL_SLOT_MASK;
+   for(level = 1; index == 0 && level < SCHED_WHEEL_LEVELS; level++)
+      index = sched_wheel_cascade(wheel, level);
+   
+   /* detach the list of timers expiring on this tick */
+   index = wheel->now & SCHED_WHEEL_SLOT_MASK;
+   snoozer = wheel->slots[0][index];
+   wheel->slots[0][index] = NULL;
+   wheel->now++;
+   
+   while(snoozer)
+   {
+      next = snoozer->next;
+      
+      if(snoozer->deadline > now + SCHED_TIMER_SLACK_USEC)
+         sched_precise_insert(wheel, snoozer);
+      else
+      {
+         /* disown the timer so it can't be cancelled while we act on it */
+         snoozer->sleeper->snoozers[snoozer->action] = NULL;
+         snoozer->slot = NULL;
+         snoozer->prev = NULL;
+         snoozer->next = expired;
+         expired = snoozer;
+         wheel->count--;
+      }
+      
+      snoozer = next;
+   }
+   
+   return expired;
+}
+
+/* sched_fire_snoozers
+   Carry out the actions of a list of expired timers and free them
+   => snoozer = linked list of timers disowned by their threads
+*/
+void sched_fire_snoozers(snoozing_thread *snoozer)
+{
+   snoozing_thread *next;
+   
+   while(snoozer)
+   {
+      next = snoozer->next;
+      
+      switch(snoozer->action)
+      {
+         case wake:
+            /* wake up the thread */
+            sched_wakeup(snoozer->sleeper, 0);
+            
+            SCHED_DEBUG("[sched:%i] woke up snoozing thread %p (tid %i pid %i)\n",
+                        CPU_ID, snoozer->sleeper, snoozer->sleeper->tid, snoozer->sleeper->proc->pid);
+            break;
+            
+         case signal:
+            /* poke the owning process as a SIGALARM signal from the kernel */
+            msg_send_signal(snoozer->sleeper->proc, NULL, SIGALRM, 0);
+            
+            SCHED_DEBUG("[sched:%i] sent SIGALRM to process %p pid %i\n",
+                        CPU_ID, snoozer->sleeper, snoozer->sleeper->proc->pid);
+            break;
+            
+         case replenish:
+            /* start a real-time thread's next period */
+            sched_rt_replenish(snoozer->sleeper);
+      }
+      
+      /* and bin the pool block */
+      vmm_free_pool(snoozer, sched_bedroom);
+      snoozer = next;
+   }
+}
+
+/* sched_check_snoozers
+   Advance a cpu's timer wheel tick by tick and fire any timers that
+   expire. Call on the cpu that owns the wheel once per scheduling tick,
+   or with the number of ticks that passed while the cpu was idle.
+   => cpuid = CPU_ID of the core owning the wheel
+      ticks = number of ticks to advance the wheel by
+*/
+void sched_check_snoozers(unsigned char cpuid, unsigned int ticks)
+{
+   sched_timer_wheel *wheel = &(cpu_table[cpuid].timers);
+   unsigned long long now = sched_get_usec();
+   snoozing_thread *expired;
+   
+   while(ticks)
+   {
+      lock_spin(&(wheel->lock));
+      
+      /* nothing to do but keep time if there are no timers */
+      if(!wheel->count)
+      {
+         wheel->now += ticks;
+         unlock_spin(&(wheel->lock));
+         return;
+      }
+      
+      expired = sched_wheel_tick(wheel, now);
+      ticks--;
+      
+      unlock_spin(&(wheel->lock));
+      
+      sched_fire_snoozers(expired);
+   }
+}
+
+/* sched_check_precise
+   Fire the timers on a cpu's high-resolution list that are now due, then
+   program the cpu's timer hardware to fire for the next one if it falls
+   before the next tick. Otherwise it's checked again next tick.
+   Must be called on the cpu that owns the wheel.
+   => cpuid = CPU_ID of the core owning the wheel
+*/
+void sched_check_precise(unsigned char cpuid)
+{
+   mp_core *cpu = &cpu_table[cpuid];
+   sched_timer_wheel *wheel = &(cpu->timers);
+   snoozing_thread *snoozer, *expired = NULL;
+   unsigned long long now, delta = 0;
+   
+   /* only this cpu adds to the list, so it's safe to peek without the lock */
+   if(!wheel->precise) return;
+   
+   lock_spin(&(wheel->lock));
+   
+   now = sched_get_usec();
+   while(wheel->precise && wheel->precise->deadline <= now + SCHED_TIMER_SLACK_USEC)
+   {
+      snoozer = wheel->precise;
+      sched_wheel_unlink(snoozer);
+      
+      /* disown the timer so it can't be cancelled while we act on it */
+      snoozer->sleeper->snoozers[snoozer->action] = NULL;
+      snoozer->next = expired;
+      expired = snoozer;
+      wheel->count--;
+   }
+   
+   if(wheel->precise) delta = wheel->precise->deadline - now;
+   
+   unlock_spin(&(wheel->lock));
+   
+   sched_fire_snoozers(expired);
+   
+   if(delta && delta < SCHED_USEC_PER_TICK) sched_set_hrtimer((unsigned int)delta);
+}
+
+/* sched_ticks_to_next_snoozer
+   Work out how many ticks a cpu can sleep for before its timer wheel
+   needs attention. Timers in the higher levels of the wheel aren't
+   inspected: instead the cpu is woken when level 0 next turns over and
+   pulls them down, which is no more than SCHED_WHEEL_SLOTS ticks away.
+   => cpuid = CPU_ID of the core owning the wheel
+   <= number of ticks until the next timer needs processing, or 0 for no timers pending
+*/
+unsigned int sched_ticks_to_next_snoozer(unsigned char cpuid)
+{
+   sched_timer_wheel *wheel = &(cpu_table[cpuid].timers);
+   unsigned int offset, index, ticks = 0;
+   
+   lock_spin(&(wheel->lock));
+   
+   if(wheel->precise)
+      ticks = 1; /* due before or on the next tick */
+   else if(wheel->count)
+      for(offset = 0; offset < SCHED_WHEEL_SLOTS; offset++)
+      {
+         index = (wheel->now + offset) & SCHED_WHEEL_SLOT_MASK;
+         
+         /* stop at the first slot with timers or where a cascade is due */
+         if(wheel->slots[0][index] || !index)
+         {
+            ticks = offset + 1;
+            break;
+         }
+      }
+   
+   unlock_spin(&(wheel->lock));
+   
+   return ticks;
+}
+
+/* sched_find_busiest
+   Find the cpu with the most threads queued, other than the given cpu.
+   The queue counters are only read, not locked, so the answer is a hint.
+   => exclude = id of a cpu to ignore, or mp_cpus to consider all of them
+   <= id of the busiest cpu, or mp_cpus if there are no other cpus
+*/
+unsigned char sched_find_busiest(unsigned char exclude)
+{
+   unsigned char loop, busiest = mp_cpus;
+   
+   for(loop = 0; loop < mp_cpus; loop++)
+      if(loop != exclude &&
+         (busiest == mp_cpus || cpu_table[loop].queued > cpu_table[busiest].queued))
+         busiest = loop;
+   
+   return busiest;
+}
+
+/* sched_find_waiting
+   Find a thread queued on a cpu that's waiting to run and so can be moved
+   to another cpu. Threads are considered from the highest priority queue
+   down, and from the tail of each queue, where they've waited longest.
+   Threads that ran on the cpu recently are passed over unless allowed as
+   they're likely to still have data in that cpu's caches. Call with the
+   cpu's lock held, and keep holding it while the thread is used, so that
+   it can't be removed from the queue and freed in the meantime
+   => cpuid = id of the cpu to search
+      allow_hot = non-zero to accept a thread that ran recently
+   <= pointer to thread, or NULL for none found
+*/
+thread *sched_find_waiting(unsigned char cpuid, unsigned char allow_hot)
+{
+   mp_core *cpu = &cpu_table[cpuid];
+   unsigned int priority;
+   thread *search, *found = NULL;
+   
+   for(priority = cpu->lowest_queue_filled; priority < SCHED_PRIORITY_LEVELS && !found; priority++)
+   {
+      search = cpu->queues[priority].queue_tail;
+      while(search)
+      {
+         if(search->state == inrunqueue && search != cpu->current &&
+            (allow_hot || (sched_msec_counter - search->last_ran) >= SCHED_CACHE_HOT_MSEC))
+         {
+            found = search;
+            break;
+         }
+         
+         search = search->queue_prev;
+      }
+   }
+   
+   return found;
+}
+
+/* sched_migrate
+   Pick a thread waiting in a cpu's run queues and move it onto another
+   cpu's run queue. Both cpus are locked for the whole search and move, so
+   the thread can't be killed and freed once it's picked, and the thread's
+   own cpu claims a thread to run with its lock held (see sched_claim), so
+   a thread that's about to run can't be moved from under it
+   => from = id of the cpu to take a waiting thread from
+      cpu = id of the cpu to move it to
+      allow_hot = non-zero to accept a thread that ran recently on from
+   <= success, or e_not_found if no thread could be moved
+*/
+kresult sched_migrate(unsigned char from, unsigned char cpu, unsigned char allow_hot)
+{
+   thread *tomove;
+   
+   if(from >= mp_cpus || cpu >= mp_cpus || from == cpu) return e_bad_params;
+   
+   sched_lock_cpus(from, cpu);
+   
+   tomove = sched_find_waiting(from, allow_hot);
+   if(!tomove)
+   {
+      sched_unlock_cpus(from, cpu);
+      return e_not_found;
+   }
+   
+   lock_gate(&(tomove->lock), LOCK_WRITE);
+   sched_remove(tomove, held);
+   sched_enqueue(cpu, tomove);
+   
+   SCHED_DEBUG("[sched:%i] migrated thread %i (%p) of process %i from cpu %i to %i\n",
+               CPU_ID, tomove->tid, tomove, tomove->proc->pid, from, cpu);
+   
+   unlock_gate(&(tomove->lock), LOCK_WRITE);
+   sched_unlock_cpus(from, cpu);
+   
+   return success;
+}
+
+/* sched_steal_work
+   Called by a cpu with nothing to run: take a thread waiting to run on the
+   busiest cpu and queue it here instead. Threads that are still likely to
+   be cache-hot on their cpu are only taken if there's nothing else.
+   => cpuid = id of the idle cpu
+   <= success if a thread was stolen, or e_not_found
+*/
+kresult sched_steal_work(unsigned char cpuid)
+{
+   unsigned char busiest;
+   
+   if(mp_cpus < 2) return e_not_found;
+   
+   busiest = sched_find_busiest(cpuid);
+   
+   /* there must be at least one thread waiting behind a running one */
+   if(busiest >= mp_cpus || cpu_table[busiest].queued < 2) return e_not_found;
+   
+   if(sched_migrate(busiest, cpuid, 0) == success) return success;
+   return sched_migrate(busiest, cpuid, 1);
+}
+
+/* sched_caretaker
+   Run maintenance over the queues to ensure even load across
+   cpus by moving waiting threads from the busiest cpu to the
+   quietest. don't move running threads around, nor threads
+   that ran recently, for fear of cache performance issues. */
+void sched_caretaker(void)
+{
+   unsigned char loop, busiest, quietest, cpu;
+   
+   SCHED_DEBUG("[sched:%i] caretaker tick\n", CPU_ID);
+   
+   if(mp_cpus < 2) return;
+   
+   /* move at most one thread per cpu each time round */
+   for(loop = 0; loop < mp_cpus; loop++)
+   {
+      busiest = sched_find_busiest(mp_cpus);
+      
+      quietest = busiest;
+      for(cpu = 0; cpu < mp_cpus; cpu++)
+         if(cpu_table[cpu].queued < cpu_table[quietest].queued)
+            quietest = cpu;
+      
+      /* give up once the load is as even as it's going to get */
+      if(cpu_table[busiest].queued < cpu_table[quietest].queued + 2) return;
+      
+      if(sched_migrate(busiest, quietest, 0) != success) return;
+   }
+}
+
+/* sched_sync_msec_counter
+   Bring the rough msec counter up to date with the high-resolution clock,
+   so that no time goes missing while the timekeeper's role changes hands.
+   Only the timekeeper may call this, and only if the clock is calibrated
+*/
+void sched_sync_msec_counter(void)
+{
+   unsigned long long elapsed = sched_get_usec() - sched_msec_stamp;
+   unsigned int msec;
+   
+   /* stick to 32-bit divides: there's no runtime support for 64-bit ones */
+   while(elapsed >= 1000)
+   {
+      if(elapsed > 0xffffffff)
+         msec = 0xffffffff / 1000;
+      else
+         msec = (unsigned int)elapsed / 1000;
+      
+      sched_msec_counter += msec;
+      sched_msec_stamp += (unsigned long long)msec * 1000;
+      elapsed -= (unsigned long long)msec * 1000;
+   }
+}
+
+/* sched_advance_clock
+   Account for scheduler ticks passing on a cpu: turn its timer wheel and,
+   if it's the system's timekeeper, update the msec counter and run the
+   caretaker when it's due.
+   => cpuid = CPU_ID of the core the ticks passed on
+      ticks = number of ticks that passed
+*/
+void sched_advance_clock(unsigned char cpuid, unsigned int ticks)
+{
+   if(cpuid == sched_timekeeper)
+   {
+      /* update the rough msec counter  - only the timekeeper has write
+         access to it. without a high-resolution clock to follow, count the
+         ticks: the role never moves on the uniprocessor ports that lack one */
+      if(lowlevel_usec_calibrated())
+         sched_sync_msec_counter();
+      else
+         sched_msec_counter += ticks * DIOSIX_MSEC_PER_TICK;
+      
+      /* check to run the caretaker */
+      if(sched_caretaker_tick > ticks)
+         sched_caretaker_tick -= ticks;
+      else
+      {
+         sched_caretaker();
+         sched_caretaker_tick = SCHED_CARETAKER;
+      }
+   }
+   
+   /* turn this cpu's timer wheel and wake up any threads that are due */
+   sched_check_snoozers(cpuid, ticks);
 }
 
-/* sched_unlock_proc
-   Release a previously process from a held state and allow its threads to
-   run again. It is not appropriate for the currently running process to
-   somehow wake itself up.
-   => proc = process to release
-   <= success or a failure code
+/* sched_work_pending
+   Check without locking whether a cpu has been given something to do, so
+   work done in its idle time can stop early. The answer is only a hint
+   => cpuid = CPU_ID of the core to check
+   <= 1 if a thread is queued or a reschedule is pending, 0 if not
 */
-kresult sched_unlock_proc(process *proc)
+unsigned char sched_work_pending(unsigned char cpuid)
 {
-   thread *t;
-   unsigned int loop, tfound;
-   unsigned char id = CPU_ID;
+   mp_core *cpu = &cpu_table[cpuid];
+   unsigned int loop;
    
-   if(!proc) return e_failure;
+   if(cpu->resched_pending) return 1;
    
-   lock_gate(&(cpu_table[id].lock), LOCK_READ);
-   lock_gate(&(cpu_table[id].current->lock), LOCK_READ);
+   for(loop = 0; loop < SCHED_BITMAP_WORDS; loop++)
+      if(*((volatile unsigned int *)&(cpu->queue_bitmap[loop]))) return 1;
    
-   if(proc == cpu_table[id].current->proc)
+   return 0;
+}
+
+/* sched_idle_enter
+   Called when a cpu has nothing to run: stop its periodic tick and program
+   a one-shot timer for its next snoozer deadline, if the hardware allows.
+   The cpu is then woken by this timer or by any other interrupt.
+   The run queues are checked one last time with the cpu's lock held. A
+   wakeup on another cpu takes the same lock, so either it sees this cpu
+   idle and sends it a reschedule IPI, or its work is spotted here
+   => cpuid = CPU_ID of the core going idle, which must have no current thread
+   <= 1 if the cpu can go to sleep, or 0 if work has been queued for it
+*/
+unsigned char sched_idle_enter(unsigned char cpuid)
+{
+   mp_core *cpu = &cpu_table[cpuid];
+   unsigned int ticks = 0, loop;
+   unsigned char idle = 1;
+   
+   /* a paused tick will restart when its high-resolution timer fires */
+   if(!(cpu->tickless) && !(cpu->hrtimer))
    {
-      unlock_gate(&(cpu_table[id].current->lock), LOCK_READ);
-      unlock_gate(&(cpu_table[id].lock), LOCK_READ);
-      return e_failure;
+      /* no timers pending means sleep for as long as the timer can count */
+      ticks = sched_ticks_to_next_snoozer(cpuid);
+      if(!ticks) ticks = 0xffffffff;
+      
+      /* it's not worth going tickless if we're due to wake up next tick */
+      if(ticks < 2) ticks = 0;
    }
    
-   unlock_gate(&(cpu_table[id].current->lock), LOCK_READ);
-   unlock_gate(&(cpu_table[id].lock), LOCK_READ);
-   
-   SCHED_DEBUG("[sched:%i] unlocking process %i (%p)\n", CPU_ID, proc->pid, proc);
-   
-   lock_gate(&(proc->lock), LOCK_WRITE);
+   lock_gate(&(cpu->lock), LOCK_WRITE);
    
-   /* clear the blocked flag */
-   proc->flags &= ~PROC_FLAG_RUNLOCKED;
+   for(loop = 0; loop < SCHED_BITMAP_WORDS; loop++)
+      if(cpu->queue_bitmap[loop]) idle = 0;
    
-   /* loop through the threads to run any that are held */
-   for(loop = 0; loop < THREAD_HASH_BUCKETS; loop++)
+   if(idle && ticks && lowlevel_timer_oneshot(ticks) == success)
    {
-      t = proc->threads[loop];
-      while(t)
-      {
-         sched_unlock_thread(t);
-         tfound++;
-         
-         /* try the next thread */
-         lock_gate(&(t->lock), LOCK_READ);
-         t = t->hash_next;
-         unlock_gate(&(t->lock), LOCK_READ);
-      }
-      
-      /* avoid scanning the whole hash space */
-      if(tfound >= proc->thread_count) break;
+      cpu->tickless = 1;
+      SCHED_DEBUG("[sched:%i] idling tickless for up to %i ticks\n", cpuid, ticks);
    }
    
-   unlock_gate(&(proc->lock), LOCK_WRITE);
+   unlock_gate(&(cpu->lock), LOCK_WRITE);
    
-   return success;
-}
-
-/* sched_check_snoozers
-   Check to see if there are snoozing threads that need waking up.
-   Call once per scheduling tick */
-void sched_check_snoozers(void)
-{
-   /* start the search from the top of the queued pool */
-   snoozing_thread *snoozer = vmm_next_in_pool(NULL, sched_bedroom);
-
-   while(snoozer)
-   {
-      /* step through the sleeping threads and decrease their timer values */
-      snoozer->timer--;
-      if(snoozer->timer == 0)
-      {
-         switch(snoozer->action)
-         {
-            case wake:
-               /* wake up the thread */
-               sched_add(snoozer->sleeper->cpu, snoozer->sleeper);
-               
-               SCHED_DEBUG("[sched:%i] woke up snoozing thread %p (tid %i pid %i)\n",
-                           CPU_ID, snoozer->sleeper, snoozer->sleeper->tid, snoozer->sleeper->proc->pid);
-               break;
-
-            case signal:
-               /* poke the owning process as a SIGALARM signal from the kernel */
-               msg_send_signal(snoozer->sleeper->proc, NULL, SIGALRM, 0);
-               
-               SCHED_DEBUG("[sched:%i] sent SIGALRM to process %p pid %i\n",
-                           CPU_ID, snoozer->sleeper, snoozer->sleeper->proc->pid);
-         }
-         
-         /* and bin the pool block */
-         vmm_free_pool(snoozer, sched_bedroom);
-         snoozer = NULL; /* pointer no longer valid, so start from the front */
-      }
-      
-      snoozer = vmm_next_in_pool(snoozer, sched_bedroom);
-   }
+   return idle;
 }
 
-/* sched_caretaker
-   Run maintenance over the queues to ensure even load across
-   cpus by adjusting the cpu id for waiting threads. if a
-   thread is to wake up on a loaded cpu, then move it to a
-   quieter one. don't move running threads around for fear of
-   cache performance issues. if debug is enabled then check
-   the sanity of the queues */
-void sched_caretaker(void)
+/* sched_idle_exit
+   Called when a cpu wakes from idle: restart its periodic tick if it was
+   stopped and catch up on the ticks that passed while it slept.
+   => cpuid = CPU_ID of the core waking up
+*/
+void sched_idle_exit(unsigned char cpuid)
 {
-   SCHED_DEBUG("[sched:%i] caretaker tick\n", CPU_ID);
+   mp_core *cpu = &cpu_table[cpuid];
+   unsigned int ticks;
+   
+   if(!cpu->tickless) return;
+   
+   ticks = lowlevel_timer_periodic();
+   cpu->tickless = 0;
+   
+   SCHED_DEBUG("[sched:%i] woke from tickless idle after %i ticks\n", cpuid, ticks);
+   
+   if(ticks) sched_advance_clock(cpuid, ticks);
 }
 
 /* sched_tick
-   Called 100 times a second (SCHED_FREQUENCY). Pick a new
-   thread, if necessary.
+   Called 100 times a second (SCHED_FREQUENCY) while a cpu is busy, or
+   once when a tickless idle cpu's one-shot timer expires, or when a
+   high-resolution timer fires between ticks. Pick a new thread, if necessary.
 */
 void sched_tick(int_registers_block *regs)
 {
    if(!cpu_table) return; /* give up now if the system isn't ready yet */
    
-   mp_core *cpu = &cpu_table[CPU_ID];
-   
-   /* check to see if it's time for maintanence */
-   /* make sure only the boot cpu runs this? */
-   if(CPU_ID == mp_boot_cpu)
+   unsigned char id = CPU_ID;
+   mp_core *cpu = &cpu_table[id];
+   unsigned int ticks = 1;
+   unsigned char punish = 0;
+   
+   if(cpu->tickless)
+      /* account for all the ticks that passed while we were idle */
+      sched_idle_exit(id);
+   else if(cpu->hrtimer)
    {
-      /* update the rough msec counter  - only one processor has write
-         access to it */
-      sched_msec_counter += DIOSIX_MSEC_PER_TICK;
-      
-      /* check to run the caretaker */
-      if(sched_caretaker_tick)
-         sched_caretaker_tick--;
-      else
+      /* the tick was paused for a timer deadline between ticks: restart it
+         and account for any whole ticks that passed in the meantime */
+      ticks = lowlevel_timer_periodic();
+      cpu->hrtimer = 0;
+      if(ticks) sched_advance_clock(id, ticks);
+   }
+   else
+   {
+      /* take over timekeeping if the keeper has stopped ticking */
+      if(sched_timekeeper != id && cpu_table[sched_timekeeper].tickless)
       {
-         sched_caretaker();
-         sched_caretaker_tick = SCHED_CARETAKER;
+         lock_spin(&sched_timekeeper_slock);
+         if(cpu_table[sched_timekeeper].tickless) sched_timekeeper = id;
+         unlock_spin(&sched_timekeeper_slock);
       }
       
-      /* are there any sleeping threads? */
-      if(vmm_count_pool_inuse(sched_bedroom)) sched_check_snoozers();
+      sched_advance_clock(id, 1);
    }
+   
+   /* fire the timers due before the next tick, or set the hardware to catch them */
+   sched_check_precise(id);
       
    /* find a thread if we're not running anything */
    if(!(cpu->current))
@@ -508,14 +1474,38 @@ void sched_tick(int_registers_block *regs)
       return;
    }
    
+   /* hold real-time threads to their budgets, otherwise they run first-in-first-out.
+      throttled real-time threads are timesliced like any other until replenished */
+   if(cpu->current->rt_period && cpu->current->rt_remaining)
+   {
+      unsigned long long now = sched_get_usec();
+      
+      if(sched_rt_charge(cpu->current, now))
+      {
+         sched_rt_throttle(cpu->current, now);
+         sched_move_to_end(CPU_ID, cpu->current);
+         sched_pick(regs);
+      }
+      else
+         sched_rt_arm(cpu->current);
+      return;
+   }
+   
+   /* only charge the running thread for whole ticks */
+   if(!ticks) return;
+   
    SCHED_DEBUG("[sched:%i] tick for thread %i of process %i (state %i)\n",
                CPU_ID, cpu->current->tid, cpu->current->proc->pid, cpu->current->state);
    
    lock_gate(&(cpu->current->lock), LOCK_WRITE);
 
-   /* decrement timeslice */
+   /* decrement timeslice. a thread with none left at all gave it away in
+      an IPC handoff (see sched_handoff) rather than using it up */
    if(cpu->current->timeslice)
+   {
       cpu->current->timeslice--;
+      punish = !(cpu->current->timeslice);
+   }
    
    /* reschedule if thread is out of time */
    if(cpu->current->timeslice == 0)
@@ -526,7 +1516,7 @@ void sched_tick(int_registers_block *regs)
       unlock_gate(&(cpu->current->lock), LOCK_WRITE);
       
       /* punish the thread for using up all its timeslice */
-      sched_priority_calc(cpu->current, priority_expiry_punish);
+      if(punish) sched_priority_calc(cpu->current, priority_expiry_punish);
       sched_move_to_end(CPU_ID, cpu->current);
 
       sched_pick(regs);
@@ -535,35 +1525,64 @@ void sched_tick(int_registers_block *regs)
       unlock_gate(&(cpu->current->lock), LOCK_WRITE);
 }
 
+/* sched_cancel_snoozer
+   Cancel a thread's pending timer for the given action, if it has one
+   => snoozer = thread to operate on
+      action = timer to cancel
+   <= 0 for success, or e_not_found if there was no timer pending
+*/
+kresult sched_cancel_snoozer(thread *snoozer, sched_snooze_action action)
+{
+   snoozing_thread *timer;
+   sched_timer_wheel *wheel;
+   unsigned char cpuid;
+   
+   for(;;)
+   {
+      /* neither the thread's timer pointer nor the timer's cpu can be trusted
+         until its wheel is locked: the timer may fire on its cpu and its block
+         be freed and reused for a timer on another cpu. so read them afresh
+         each time around, lock the wheel the timer appears to be on and start
+         over if it's no longer the thread's pending timer on that wheel */
+      timer = *((snoozing_thread * volatile *)&(snoozer->snoozers[action]));
+      if(!timer) return e_not_found;
+      
+      cpuid = *((volatile unsigned char *)&(timer->cpu));
+      if(cpuid >= mp_cpus) continue;
+      wheel = &(cpu_table[cpuid].timers);
+      
+      lock_spin(&(wheel->lock));
+      if(snoozer->snoozers[action] == timer && timer->cpu == cpuid)
+         break; /* timer is pinned to this wheel while we hold its lock */
+      unlock_spin(&(wheel->lock));
+   }
+   
+   sched_wheel_unlink(timer);
+   snoozer->snoozers[action] = NULL;
+   wheel->count--;
+   
+   unlock_spin(&(wheel->lock));
+   
+   vmm_free_pool(timer, sched_bedroom);
+   return success;
+}
+
 /* sched_remove_snoozer
-   Remove a snoozing thread from the queued pool of sleepers
+   Cancel all of a thread's timers waiting on the scheduler clock
    => snoozer = sleeping thread
    <= 0 for success, or an error code
 */
 kresult sched_remove_snoozer(thread *snoozer)
 {
    kresult result = e_not_found;
+   sched_snooze_action action;
    
    /* sanity check */
    if(!snoozer) return e_bad_params;
    
-   snoozing_thread *search = NULL;
-   
-   for(;;)
-   {
-      /* step through the sleeping threads to find the given thread */
-      search = vmm_next_in_pool(search, sched_bedroom);
-      if(search)
-      {
-         if(search->sleeper == snoozer)
-         {
-            /* bin the pool block */
-            vmm_free_pool(search, sched_bedroom);
-            search = NULL; /* pointer no longer valid */
-            result = success;
-         }
-      } else break; /* escape the loop if no more sleepers */
-   }
+   for(action = wake; action < THREAD_SNOOZE_ACTIONS; action++)
+      if(sched_cancel_snoozer(snoozer, action) == success)
+         result = success;
    
    SCHED_DEBUG("[sched:%i] removed thread %p (tid %i pid %i) from bedroom (result %i)\n",
                CPU_ID, snoozer, snoozer->tid, snoozer->proc->pid, result);
@@ -572,7 +1591,8 @@ kresult sched_remove_snoozer(thread *snoozer)
 }
 
 /* sched_add_snoozer
-   Add a thread to the queued pool of threads waiting on the scheduler clock
+   Set a timer for a thread on this cpu, given in scheduler ticks.
+   A wrapper around sched_add_timer for the tick-based interfaces.
    => snoozer = thread to work on
       timeout = number of scheduling ticks to count down from, or 0 to cancel
       action = wake: put calling thread to sleep and wake it when timeout reaches zero
@@ -580,35 +1600,93 @@ kresult sched_remove_snoozer(thread *snoozer)
    <= 0 for success, or an error code
 */
 kresult sched_add_snoozer(thread *snoozer, unsigned int timeout, sched_snooze_action action)
+{
+   return sched_add_timer(snoozer, timeout, 0, action);
+}
+
+/* sched_add_timer
+   Add a thread to this cpu's wheel of threads waiting on the scheduler clock.
+   The wheel brings the timer to within a tick of its deadline and the cpu's
+   high-resolution timer, if it has one, takes care of the rest.
+   A thread has at most one timer per action: setting a new one replaces the old.
+   => snoozer = thread to work on
+      ticks = number of scheduling ticks to wait
+      usec = number of microseconds to wait on top of the ticks
+             (both zero cancels the thread's sleep and alarm timers)
+      action = wake: put calling thread to sleep and wake it when the time is up
+               signal: send a SIGALARM to the thread's owner process when the time is up
+               replenish: top up a real-time thread's budget when the time is up
+   <= 0 for success, or an error code
+*/
+kresult sched_add_timer(thread *snoozer, unsigned int ticks, unsigned int usec, sched_snooze_action action)
 {
    snoozing_thread *new;
+   sched_timer_wheel *wheel;
+   unsigned char cpuid = CPU_ID;
    kresult err;
    
    /* sanity check */
-   if(!snoozer) return e_bad_params;
+   if(!snoozer || action >= THREAD_SNOOZE_ACTIONS) return e_bad_params;
+   
+   if(!ticks && !usec)
+   {
+      /* cancel the thread's sleep and alarm timers */
+      err = sched_cancel_snoozer(snoozer, wake);
+      if(sched_cancel_snoozer(snoozer, signal) == success) err = success;
+      return err;
+   }
    
-   if(!timeout)
-      /* cancel all the timers for this thread */
-      return sched_remove_snoozer(snoozer);
+   /* split the timeout into whole ticks and a fraction of a tick */
+   if(ticks > SCHED_WHEEL_MAX_TIMEOUT) ticks = SCHED_WHEEL_MAX_TIMEOUT;
+   ticks += usec / SCHED_USEC_PER_TICK;
+   usec = usec % SCHED_USEC_PER_TICK;
+   if(ticks > SCHED_WHEEL_MAX_TIMEOUT) ticks = SCHED_WHEEL_MAX_TIMEOUT;
+   
+   /* any previous timer for this action is superseded */
+   sched_cancel_snoozer(snoozer, action);
    
    /* allocate the new block to store the thread's details */
    err = vmm_alloc_pool((void **)&new, sched_bedroom);
    if(err) return err;
    
-   new->sleeper = snoozer;
-   new->timer   = timeout;
-   new->action  = action;
+   wheel = &(cpu_table[cpuid].timers);
+   
+   new->sleeper  = snoozer;
+   new->action   = action;
+   new->cpu      = cpuid;
+   new->deadline = sched_get_usec() + ((unsigned long long)ticks * SCHED_USEC_PER_TICK) + usec;
+   
+   lock_spin(&(wheel->lock));
+   
+   if(ticks)
+   {
+      /* the timer leaves the wheel when it processes its ticks'th tick from now */
+      new->expiry = wheel->now + ticks - 1;
+      sched_wheel_insert(wheel, new);
+   }
+   else
+      sched_precise_insert(wheel, new);
+   
+   snoozer->snoozers[action] = new;
+   wheel->count++;
    
-   SCHED_DEBUG("[sched:%i] added thread %p (tid %i pid %i) to bedroom: timeout %i ticks action %i\n",
-               CPU_ID, snoozer, snoozer->tid, snoozer->proc->pid, timeout, action);
+   unlock_spin(&(wheel->lock));
+   
+   SCHED_DEBUG("[sched:%i] added thread %p (tid %i pid %i) to bedroom: timeout %i ticks %i usec action %i\n",
+               CPU_ID, snoozer, snoozer->tid, snoozer->proc->pid, ticks, usec, action);
    
    if(action == wake) sched_remove(snoozer, sleeping);
+   
+   /* set the timer hardware going if the deadline is before the next tick */
+   if(!ticks) sched_check_precise(cpuid);
 
    return success;
 }
 
 /* sched_rescan_queues
- Run through a CPU's queues and determine the highest-priority queue with threads waiting in it.
+ Determine the highest-priority queue with threads waiting in it using the CPU's
+ bitmap of non-empty run queues. Runs in time proportional to the number of bitmap
+ words rather than the number of priority levels.
  => cpuid = CPU_ID of core to scan
  */
 void sched_rescan_queues(unsigned char cpuid)
@@ -617,14 +1695,78 @@ void sched_rescan_queues(unsigned char cpuid)
    mp_core *cpu = &cpu_table[cpuid];
    unsigned int loop;
    
-   for(loop = 0; loop < SCHED_PRIORITY_LEVELS; loop++)
-      if(cpu->queues[loop].queue_head)
+   for(loop = 0; loop < SCHED_BITMAP_WORDS; loop++)
+      if(cpu->queue_bitmap[loop])
       {
-         cpu->lowest_queue_filled = loop;
+         cpu->lowest_queue_filled = (loop * SCHED_BITMAP_WORD_BITS) +
+                                    lowlevel_find_first_set(cpu->queue_bitmap[loop]);
          break;
       }
 }
 
+/* sched_update_queue_bitmap
+   Mark a run queue as empty or non-empty in its CPU's bitmap and
+   recalculate the highest-priority queue with threads waiting in it.
+   Call after linking or unlinking a thread into or out of a queue.
+   => cpuid = CPU_ID of the core owning the queue
+      priority = priority level of the queue
+*/
+void sched_update_queue_bitmap(unsigned char cpuid, unsigned char priority)
+{
+   /* assumes a write lock on the CPU's structure */
+   mp_core *cpu = &cpu_table[cpuid];
+   
+   if(cpu->queues[priority].queue_head)
+      cpu->queue_bitmap[SCHED_BITMAP_WORD(priority)] |= SCHED_BITMAP_BIT(priority);
+   else
+      cpu->queue_bitmap[SCHED_BITMAP_WORD(priority)] &= ~SCHED_BITMAP_BIT(priority);
+   
+   sched_rescan_queues(cpuid);
+}
+
+/* sched_claim
+   Mark the thread a cpu is about to switch to as running, and keep the
+   thread it's switching away from marked as running until its state has
+   been saved (see sched_release), so that neither can be moved to another
+   cpu in the meantime. sched_migrate only moves threads waiting in a run
+   queue, and picks them with the same lock held.
+   => next = thread picked to run on this cpu
+      now = thread being switched out, or NULL for none
+   <= success, or e_failure if next was moved or removed since it was picked
+*/
+kresult sched_claim(thread *next, thread *now)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   kresult result = e_failure;
+   
+   lock_gate(&(cpu->lock), LOCK_WRITE);
+   
+   if(next->cpu == CPU_ID && next->queue && next->state == inrunqueue)
+   {
+      next->state = running;
+      if(now && now->state == inrunqueue) now->state = running;
+      result = success;
+   }
+   
+   unlock_gate(&(cpu->lock), LOCK_WRITE);
+   
+   return result;
+}
+
+/* sched_release
+   Let a switched-out thread that's still in a run queue be picked up again
+   now its state has been saved
+   => now = thread that was switched out
+*/
+void sched_release(thread *now)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   
+   lock_gate(&(cpu->lock), LOCK_WRITE);
+   if(now->state == running && now->queue) now->state = inrunqueue;
+   unlock_gate(&(cpu->lock), LOCK_WRITE);
+}
+
 /* sched_pick
    Check the run queues for new higher prority threads to run
    and perform a task switch if one is present
@@ -636,19 +1778,36 @@ void sched_pick(int_registers_block *regs)
 
    mp_core *cpu = &cpu_table[CPU_ID];
    
+   /* restart the tick if we've been woken from a tickless idle */
+   sched_idle_exit(CPU_ID);
+   
    SCHED_DEBUG_QUEUES;
    
    /* this is the currently running thread or NULL for none */
    now = cpu->current;
 
+   /* a thread handed the cpu by synchronous IPC runs next, unless something
+      more important has been queued in the meantime */
+   next = cpu->handoff;
+   cpu->handoff = NULL;
+   if(next && (next->cpu != CPU_ID || !(next->queue) ||
+               next->queue->priority > cpu->lowest_queue_filled))
+      next = NULL;
+   
    /* see if there's another thread to run */
-   next = sched_get_next_to_run(CPU_ID);
+   if(!next) next = sched_get_next_to_run(CPU_ID);
    if(!next)
    {
       /* avoid running out of any work to do
          so check all queues for lingering threads */
       sched_rescan_queues(CPU_ID);
       next = sched_get_next_to_run(CPU_ID);
+      
+      /* and if this cpu is about to go idle then try to
+         take on work from a busier cpu */
+      if(!next && (!now || now->state != running) &&
+         sched_steal_work(CPU_ID) == success)
+         next = sched_get_next_to_run(CPU_ID);
    }
       
    /* how the next part plays out depends on whether or not
@@ -672,19 +1831,37 @@ void sched_pick(int_registers_block *regs)
          return; /* easy quick switch back to where we were */
       }
    
-      if(now && now->state == running)
+      /* don't let a low priority thread trump the current one
+         (don't forget that higher the value, the lower the priority */
+      if(now && now->state == running && next->priority > now->priority) return;
+      
+      /* bill real-time threads for their time on the cpu */
+      if(now) sched_rt_stop(now);
+      
+      /* take the next thread before another cpu can steal it. if it's
+         already gone then have another look */
+      if(sched_claim(next, now) != success)
       {
-         /* don't let a low priority thread trump the current one
-            (don't forget that higher the value, the lower the priority */
-         if(next->priority > now->priority) return;
+         sched_pick(regs);
+         return;
+      }
+      
+      /* note when the outgoing thread last had the cpu, for cache affinity */
+      if(now) now->last_ran = sched_msec_counter;
       
-         /* update thread state if it's about to be switched out */
-         now->state = inrunqueue;
+      /* start the real-time clock running on the incoming thread */
+      if(next->rt_period)
+      {
+         next->rt_ran_from = sched_get_usec();
+         sched_rt_arm(next);
       }
       
+      sched_trace(DIOSIX_TRACE_SWITCH, next, now ? now->proc->pid : 0, now ? now->tid : 0);
+      
       /* put the next thread in the driving seat */   
       next->cpu = CPU_ID;
-      next->state = running;
+      next->last_cpu = CPU_ID;
+      next->flags |= THREAD_FLAG_HASRUN;
    }
    
    /* at this point, next may be NULL, indicating we should sleep
@@ -694,11 +1871,33 @@ void sched_pick(int_registers_block *regs)
       lock-unlock pairs for a given kernel thread. so we have to use a
       basic low-level spin lock on the cpu's gate while we update this */   
    cpu->current = next;
+   if(next) cpu->current_priority = sched_determine_priority(next);
+   
+   /* charge the outgoing thread for its time up to the switch */
+   sched_account(now, cpu->acct_type);
    
    lowlevel_thread_switch(now, next, regs);
    
-   /* sleep until the timer wakes us up and restarts the scheduling process */
-   if(!next) lowlevel_cpu_sleep(regs); /* doesn't return */
+   /* the outgoing thread can be run elsewhere now it's been saved */
+   if(now) sched_release(now);
+   
+   /* sleep until the timer wakes us up and restarts the scheduling process,
+      stopping the periodic tick if possible */
+   if(!next)
+   {
+      if(now) sched_rt_stop(now);
+      if(now) sched_trace(DIOSIX_TRACE_SWITCH, NULL, now->proc->pid, now->tid);
+      
+      /* put the spare time to use cleaning pages for later */
+      vmm_zero_idle_pages();
+      
+      if(sched_idle_enter(CPU_ID))
+         lowlevel_cpu_sleep(regs); /* doesn't return */
+      
+      /* a thread was queued for us on the way to sleep, so go round again */
+      sched_pick(regs);
+      return;
+   }
    
    SCHED_DEBUG("[sched:%i] switched thread %i of process %i (%p) for thread %i of process %i (%p)\n",
            CPU_ID, now->tid, now->proc->pid, now, next->tid, next->proc->pid, next);
@@ -712,18 +1911,16 @@ void sched_pick(int_registers_block *regs)
 void sched_move_to_end(unsigned char cpu, thread *toqueue)
 {
    mp_thread_queue *cpu_queue;
-   unsigned char priority;
+   unsigned char priority, from;
    
-   if((cpu > mp_cpus) || !toqueue)
+   if((cpu >= mp_cpus) || !toqueue)
       return; /* bail if parameters are insane */
    
-   lock_gate(&(toqueue->lock), LOCK_WRITE);
+   from = sched_lock_queued_thread(toqueue, cpu);
       
    /* remove from the run queue if present */
    if(toqueue->state == running || toqueue->state == inrunqueue)
       sched_remove(toqueue, held);
-   
-   lock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
 
    priority = sched_determine_priority(toqueue);
    cpu_queue = &(cpu_table[cpu].queues[priority]);
@@ -745,19 +1942,18 @@ void sched_move_to_end(unsigned char cpu, thread *toqueue)
    if(toqueue->state != running && toqueue->state != inrunqueue)
    {
       cpu_table[cpu].queued++;
-      sched_inc_queued_threads();
    }
 
    toqueue->state     = inrunqueue;
    toqueue->timeslice = SCHED_TIMESLICE;
+   toqueue->cpu       = cpu;
    toqueue->queue     = cpu_queue;
 
    /* determine the highest priority thread queue to run */
-   if(cpu_table[cpu].lowest_queue_filled != priority)
-      sched_rescan_queues(cpu);
+   sched_update_queue_bitmap(cpu, priority);
    
-   unlock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
    unlock_gate(&(toqueue->lock), LOCK_WRITE);
+   sched_unlock_cpus(from, cpu);
    
    SCHED_DEBUG("[sched:%i] moved thread %i (%p) of process %i to end of cpu %i queue, priority %i\n",
            CPU_ID, toqueue->tid, toqueue, toqueue->proc->pid, cpu, priority);
@@ -765,7 +1961,8 @@ void sched_move_to_end(unsigned char cpu, thread *toqueue)
 
 /* sched_add
    Add a thread to a run queue for a cpu at the priority
-   level set in the thread's structure
+   level set in the thread's structure, balancing the load
+   across cpus if need be
    => cpu = id of the requested per-cpu run queue
       torun = the thread to add
 */
@@ -774,11 +1971,23 @@ void sched_add(unsigned char cpu, thread *torun)
    if((cpu > mp_cpus) || !torun)
       return; /* bail if parameters are insane */
    
-   unsigned char priority;
-   mp_thread_queue *cpu_queue;
-      
    /* perform some load balancing */
-   cpu = sched_pick_queue(cpu);
+   sched_enqueue(sched_pick_queue(cpu), torun);
+}
+
+/* sched_enqueue
+   Add a thread to the given cpu's run queue at the priority
+   level set in the thread's structure, without balancing
+   => cpu = id of the per-cpu run queue to use
+      torun = the thread to add
+*/
+void sched_enqueue(unsigned char cpu, thread *torun)
+{
+   if((cpu >= mp_cpus) || !torun)
+      return; /* bail if parameters are insane */
+   
+   unsigned char priority, resched = 0;
+   mp_thread_queue *cpu_queue;
       
    lock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
    lock_gate(&(torun->lock), LOCK_WRITE);
@@ -807,7 +2016,13 @@ void sched_add(unsigned char cpu, thread *torun)
    if(torun->state != running && torun->state != inrunqueue)
    {
       cpu_table[cpu].queued++;
-      sched_inc_queued_threads();
+   }
+
+   /* keep count of threads that have been moved away from where they last ran */
+   if((torun->flags & THREAD_FLAG_HASRUN) && torun->last_cpu != cpu)
+   {
+      torun->migrations++;
+      cpu_table[cpu].migrations++;
    }
 
    torun->state     = inrunqueue;
@@ -816,12 +2031,25 @@ void sched_add(unsigned char cpu, thread *torun)
    torun->queue     = cpu_queue;
    
    /* take a note of the highest priority level ready to run */
-   cpu_queue = &(cpu_table[cpu].queues[cpu_table[cpu].lowest_queue_filled]);
-   if(cpu_table[cpu].lowest_queue_filled > priority || !cpu_queue->queue_head)
-      cpu_table[cpu].lowest_queue_filled = priority;
+   sched_update_queue_bitmap(cpu, priority);
+   
+   sched_trace(DIOSIX_TRACE_WAKEUP, torun, cpu, priority);
+   
+   /* another cpu won't notice the new work until its next tick, so poke it
+      now if it's idle or running something less important. if an earlier
+      IPI hasn't been answered yet then that one will do */
+   if(cpu != CPU_ID && !(cpu_table[cpu].resched_pending) &&
+      (cpu_table[cpu].tickless || !(cpu_table[cpu].current) ||
+       priority < cpu_table[cpu].current_priority))
+   {
+      cpu_table[cpu].resched_pending = 1;
+      resched = 1;
+   }
    
    unlock_gate(&(torun->lock), LOCK_WRITE);
    unlock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
+   
+   if(resched) mp_interrupt_cpu(cpu, INT_IPI_RESCHED);
       
    SCHED_DEBUG("[sched:%i] added thread %i (%p) of process %i to cpu %i queue, priority %i\n",
            CPU_ID, torun->tid, torun, torun->proc->pid, cpu, priority);
@@ -834,12 +2062,9 @@ void sched_add(unsigned char cpu, thread *torun)
 */
 void sched_remove(thread *victim, thread_state state)
 {
-   unsigned int cpu = victim->cpu;
+   unsigned int cpu = sched_lock_queued_thread(victim, mp_cpus);
    mp_thread_queue *cpu_queue;
    
-   lock_gate(&(cpu_table[cpu].lock), LOCK_WRITE);
-   lock_gate(&(victim->lock), LOCK_WRITE);
-   
    cpu_queue = victim->queue;
    if(!cpu_queue)
    {
@@ -868,17 +2093,20 @@ void sched_remove(thread *victim, thread_state state)
    if(victim->state == running || victim->state == inrunqueue)
    {
       cpu_table[cpu].queued--;
-      sched_dec_queued_threads();
    }
 
    /* warn another processor that its thread has been removed */
    if(victim->state == running) mp_interrupt_thread(victim, INT_IPI_RESCHED);
+   
+   /* and make sure it's not picked to run straight after an IPC handoff */
+   if(cpu_table[cpu].handoff == victim) cpu_table[cpu].handoff = NULL;
 
    victim->state = state; /* update the state; it might be dying or just blocked */
    
+   sched_trace(DIOSIX_TRACE_BLOCK, victim, state, cpu);
+   
    /* determine the highest priority run queue that's non-empty */
-   if(cpu_table[cpu].lowest_queue_filled >= victim->queue->priority)
-      sched_rescan_queues(cpu);
+   sched_update_queue_bitmap(cpu, cpu_queue->priority);
 
    SCHED_DEBUG("[sched:%i] removed thread %i (%p) of process %i from cpu %i queue, priority %i\n",
                CPU_ID, victim->tid, victim, victim->proc->pid, cpu, victim->queue->priority);
@@ -891,71 +2119,193 @@ void sched_remove(thread *victim, thread_state state)
 
 /* sched_pick_queue
    Balance load across the per-cpu queues by picking a queue to schedule a thread
-   to run on, biased in favour of the hinted cpu queue
+   to run on, biased in favour of the hinted cpu queue. The hinted queue is used
+   unless it has SCHED_MIGRATE_THRESHOLD or more threads queued than the quietest
+   queue, in which case the quietest is used. The queue counters are read without
+   taking the cpus' locks: they're only a hint and the caretaker and idle cpus
+   even out any misjudgement later.
    => hint = hinted cpu queue 
    <= cpu queue to use
 */
 unsigned char sched_pick_queue(unsigned char hint)
 {
-   unsigned char picked;
-   unsigned int max_fair_share, original_sched_next;
+   unsigned char loop, quietest;
    
    /* use the boot cpu queue if it's the only cpu */
    if(mp_cpus == 1) return mp_boot_cpu;
    
    /* use the boot cpu queue if the hint is wild */
    if(hint >= mp_cpus) hint = mp_boot_cpu;
+   
+   quietest = hint;
+   for(loop = 0; loop < mp_cpus; loop++)
+      if(cpu_table[loop].queued < cpu_table[quietest].queued)
+         quietest = loop;
+   
+   SCHED_DEBUG("[sched:%i] load balancing: hint: %i (%i) quietest: %i (%i) total queued: %i\n",
+               CPU_ID, hint, cpu_table[hint].queued, quietest, cpu_table[quietest].queued,
+               sched_total_queued());
+   
+   if(cpu_table[hint].queued >= cpu_table[quietest].queued + SCHED_MIGRATE_THRESHOLD)
+      return quietest;
+   
+   return hint;
+}
 
-   /* the number of threads per cpu queue that's 'fair' to run
-      is simply the total number of threads divided by cpu queues 
-      available */
-   lock_spin(&(sched_total_queued_slock));
-   max_fair_share = sched_total_queued / mp_cpus;
-   unlock_spin(&(sched_total_queued_slock));
+/* sched_wakeup
+   Put a thread that's been blocked back on a run queue, choosing the cpu
+   with its cache in mind: a thread woken by synchronous IPC is placed on the
+   waker's cpu, which is about to block and has the message data in its cache,
+   otherwise the thread goes back to the cpu it last ran on. It's only placed
+   elsewhere if the chosen cpu is overloaded (see sched_pick_queue)
+   => towake = thread to wake up
+      flags = SCHED_WAKE_SYNC if the calling thread is about to block on towake
+*/
+void sched_wakeup(thread *towake, unsigned int flags)
+{
+   unsigned char preferred;
+   
+   if(!towake) return;
    
-   if(!max_fair_share) max_fair_share = 1; /* ensure a sane value */
+   if(flags & SCHED_WAKE_SYNC)
+      preferred = CPU_ID;
+   else if(towake->flags & THREAD_FLAG_HASRUN)
+      preferred = towake->last_cpu;
+   else
+      preferred = towake->cpu;
+   
+   SCHED_DEBUG("[sched:%i] waking thread %i (%p) of process %i, prefers cpu %i (last ran on %i %i msec ago)\n",
+               CPU_ID, towake->tid, towake, towake->proc->pid, preferred, towake->last_cpu,
+               sched_msec_counter - towake->last_ran);
+   
+   sched_enqueue(sched_pick_queue(preferred), towake);
+}
 
-   /* ensure next_queue is sane */
-   lock_spin(&(sched_next_queue_slock));
-   if(sched_next_queue >= mp_cpus) sched_next_queue = 0;
+/* sched_handoff
+   Hand this cpu straight to a thread woken by synchronous IPC, skipping the
+   usual choice of run queue so the receiver runs next on this cpu, where the
+   message is cache-hot. The rest of the sender's timeslice moves to the
+   receiver, leaving the sender with none, so the pair can't run for longer
+   than the sender alone would have; the receiver already has any priority
+   boost from the sender (see msg_deliver).
+   If the sender is still runnable (it sent a reply) then the handoff only goes
+   ahead if the receiver is at least as important as the sender.
+   => from = the thread running on this cpu that sent the message
+      to = blocked thread to hand the cpu to
+*/
+void sched_handoff(thread *from, thread *to)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   unsigned int timeslice;
+   
+   if(!from || !to) return;
    
-   /* make sure the next queue is not the hinted queue */
-   if(sched_next_queue == hint)
+   if(cpu->current != from || (from->state == running && to->priority > from->priority))
    {
-      sched_next_queue++;
-      if(sched_next_queue >= mp_cpus) sched_next_queue = 0;
+      sched_wakeup(to, (from->state == running) ? 0 : SCHED_WAKE_SYNC);
+      return;
    }
+   
+   /* put the receiver at the head of its queue on this cpu */
+   sched_enqueue(CPU_ID, to);
+   
+   /* donate the sender's remaining slice rather than copying it */
+   lock_gate(&(from->lock), LOCK_WRITE);
+   timeslice = from->timeslice;
+   from->timeslice = 0;
+   unlock_gate(&(from->lock), LOCK_WRITE);
+   
+   lock_gate(&(to->lock), LOCK_WRITE);
+   to->timeslice = timeslice;
+   unlock_gate(&(to->lock), LOCK_WRITE);
+   
+   cpu->handoff = to;
+   
+   SCHED_DEBUG("[sched:%i] thread %i of process %i handed cpu to thread %i of process %i (timeslice %i)\n",
+               CPU_ID, from->tid, from->proc->pid, to->tid, to->proc->pid, to->timeslice);
+}
 
-   SCHED_DEBUG("[sched:%i] load balancing: max threads per cpu: %i next queue: %i (%i) hint: %i (%i) total queued: %i\n",
-               CPU_ID, max_fair_share, sched_next_queue, cpu_table[sched_next_queue].queued,
-               hint, cpu_table[hint].queued, sched_total_queued);
+/* sched_trace
+   Record a scheduler event in this cpu's trace ring, overwriting the oldest
+   event if the ring is full. Only the running cpu writes to its ring so no
+   locking is needed.
+   => type = DIOSIX_TRACE_* event type
+      subject = thread the event concerns, or NULL for none
+      arg0, arg1 = event-specific data, see diosix.h
+*/
+void sched_trace(unsigned short type, thread *subject, unsigned int arg0, unsigned int arg1)
+{
+   sched_trace_ring *ring;
+   diosix_sched_trace_entry *entry;
+   unsigned int head;
+   
+   if(!sched_trace_rings) return;
    
-   /* the strategy is thus: use the hinted queue unless it has more than its
-      fair share of threads or the next queue is empty. in which case, use the next queue if possible and advance it if
-      successful. if the hinted queue is empty, then use that */
-   original_sched_next = sched_next_queue;
+   ring = &sched_trace_rings[CPU_ID];
+   head = ring->head;
+   entry = &(ring->entries[head & (DIOSIX_SCHED_TRACE_ENTRIES - 1)]);
    
-   lock_gate(&(cpu_table[hint].lock), LOCK_READ);
-   lock_gate(&(cpu_table[original_sched_next].lock), LOCK_READ);
+   /* mark the entry as being rewritten so a reader can't take it for the old event */
+   entry->sequence = 0;
+   SCHED_BARRIER();
    
-   if(((cpu_table[sched_next_queue].queued == 0) ||
-       (cpu_table[hint].queued > max_fair_share)) &&
-      (cpu_table[hint].queued != 0))
+   entry->timestamp = lowlevel_read_cyclecount();
+   entry->type = type;
+   entry->cpu = CPU_ID;
+   if(subject)
    {
-      picked = sched_next_queue;
-      sched_next_queue++;
+      entry->pid = subject->proc->pid;
+      entry->tid = subject->tid;
    }
    else
-      picked = hint;
+      entry->pid = entry->tid = 0;
+   entry->arg[0] = arg0;
+   entry->arg[1] = arg1;
+   
+   /* publish the event: a reader copying the ring from another cpu can use the
+      sequence number to spot entries that were overwritten mid-copy */
+   SCHED_BARRIER();
+   entry->sequence = head + 1;
+   SCHED_BARRIER();
+   ring->head = head + 1;
+}
 
-   SCHED_DEBUG("[sched:%i] load balancing: selected queue: %i\n",
-               CPU_ID, picked);
+/* sched_trace_copy
+   Copy a cpu's scheduler trace ring into a block. The ring is not locked so
+   entries recorded while the copy is in progress will have sequence numbers
+   greater than the head returned in the block, and an entry that was being
+   rewritten as it was copied has its sequence number zeroed.
+   => cpuid = id of the cpu whose trace to copy
+      block = block to fill in
+   <= 0 for success, or an error code
+*/
+kresult sched_trace_copy(unsigned int cpuid, diosix_sched_trace *block)
+{
+   sched_trace_ring *ring;
+   volatile diosix_sched_trace_entry *entry;
+   unsigned int loop, sequence;
+   
+   if(cpuid >= mp_cpus || !block) return e_bad_params;
+   if(!sched_trace_rings) return e_failure;
+   
+   ring = &sched_trace_rings[cpuid];
+   block->head = ring->head;
+   SCHED_BARRIER();
    
-   unlock_gate(&(cpu_table[original_sched_next].lock), LOCK_READ);
-   unlock_gate(&(cpu_table[hint].lock), LOCK_READ);
-   unlock_spin(&(sched_next_queue_slock));
+   for(loop = 0; loop < DIOSIX_SCHED_TRACE_ENTRIES; loop++)
+   {
+      entry = &(ring->entries[loop]);
+      
+      sequence = entry->sequence;
+      SCHED_BARRIER();
+      vmm_memcpy(&(block->entries[loop]), (void *)entry, sizeof(diosix_sched_trace_entry));
+      SCHED_BARRIER();
+      
+      /* the entry's only whole if its sequence number didn't change under us */
+      if(entry->sequence != sequence) block->entries[loop].sequence = 0;
+   }
    
-   return picked;
+   return success;
 }
 
 /* sched_initialise
@@ -964,11 +2314,20 @@ void sched_initialise(void)
 {
    BOOT_DEBUG("[sched:%i] starting operating system...\n", CPU_ID);
 
+   /* the boot cpu keeps time until it first goes idle */
+   sched_timekeeper = mp_boot_cpu;
+
    /* initialise pool of sleeping threads awaiting a clock wake-up */
    sched_bedroom = vmm_create_pool(sizeof(snoozing_thread), 4);
    if(!sched_bedroom)
       debug_panic("unable to create queued pool for clock-held sleeping threads");
    
+   /* tracing is a diagnostic aid, so carry on without it if memory is tight */
+   if(vmm_malloc((void **)&sched_trace_rings, sizeof(sched_trace_ring) * mp_cpus) == success)
+      vmm_memset(sched_trace_rings, 0, sizeof(sched_trace_ring) * mp_cpus);
+   else
+      sched_trace_rings = NULL;
+   
    /* start running process 1, thread 1 in user mode, which
       should spawn system managers and continue the boot process */
    lowlevel_kickstart();
@@ -98,7 +98,7 @@ thread *thread_duplicate(process *proc, thread *source)
    }
    
    /* grab memory and zero it now to store details of new thread */
-   kresult err = vmm_malloc((void **)&new, sizeof(thread));
+   kresult err = vmm_cache_alloc((void **)&new, KCACHE_THREAD);
    if(err)
    {
       unlock_gate(&(source->lock), LOCK_READ);
@@ -113,7 +113,7 @@ thread *thread_duplicate(process *proc, thread *source)
       thread_new_hash(proc);
       if(!(proc->threads))
       {
-         vmm_free(new);
+         vmm_cache_free(new, KCACHE_THREAD);
          unlock_gate(&(source->lock), LOCK_READ);
          unlock_gate(&(proc->lock), LOCK_WRITE);
          return NULL;
@@ -142,7 +142,7 @@ thread *thread_duplicate(process *proc, thread *source)
    {
       unlock_gate(&(source->lock), LOCK_READ);
       unlock_gate(&(proc->lock), LOCK_WRITE);
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_THREAD);
       return NULL; /* something went wrong */
    }
    
@@ -235,7 +235,7 @@ thread *thread_new(process *proc)
    }
 
    /* grab memory now to store details of new thread */
-   err = vmm_malloc((void **)&new, sizeof(thread));
+   err = vmm_cache_alloc((void **)&new, KCACHE_THREAD);
    if(err)
    {
       unlock_gate(&(proc->lock), LOCK_WRITE);
@@ -247,7 +247,7 @@ thread *thread_new(process *proc)
    err = vmm_malloc((void **)&kstack, MEM_PGSIZE);
    if(err)
    {
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_THREAD);
       unlock_gate(&(proc->lock), LOCK_WRITE);
       return NULL; /* FIXME should really do some clean up if this fails */
    }
@@ -260,7 +260,7 @@ thread *thread_new(process *proc)
       if(!(proc->threads))
       {
          vmm_free((void *)kstack);
-         vmm_free(new);
+         vmm_cache_free(new, KCACHE_THREAD);
          unlock_gate(&(proc->lock), LOCK_WRITE);
          return NULL;
       }
@@ -319,7 +319,7 @@ thread *thread_new(process *proc)
       if(new->hash_next) new->hash_prev = NULL;
       proc->thread_count--;
       vmm_free((void *)kstack);
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_THREAD);
       unlock_gate(&(proc->lock), LOCK_WRITE);
       return NULL;
    }
@@ -361,9 +361,12 @@ kresult thread_kill(process *owner, thread *victim)
       if(lock_gate(&(victim->lock), LOCK_WRITE | LOCK_SELFDESTRUCT))
          return e_failure;
       
-      /* if the victim is sleeping then make sure it gives up any 
-         timer blocks it may have held */
-      if(victim->state == sleeping) sched_remove_snoozer(victim);
+      /* make sure the victim gives up any timer blocks it may have held,
+         whether it was sleeping, waiting on an alarm or a doorbell, and its real-time reservation */
+      if(victim->rt_period) sched_set_realtime(victim, 0, 0);
+      sched_remove_snoozer(victim);
+      msg_doorbell_cancel(victim);
+      msg_endpoint_remove(victim);
       
       /* if we can't lock then assume it's this thread that's dying */
       if(sched_lock_thread(victim)) sched_remove(victim, dead);
@@ -392,6 +395,11 @@ kresult thread_kill(process *owner, thread *victim)
          owner->threads[victim->tid % THREAD_HASH_BUCKETS] = victim->hash_next;
 
       owner->thread_count--;
+      
+      /* keep the thread's cpu time on the process's books */
+      owner->cycles[THREAD_CYCLES_USER]   += victim->cycles[THREAD_CYCLES_USER];
+      owner->cycles[THREAD_CYCLES_KERNEL] += victim->cycles[THREAD_CYCLES_KERNEL];
+      owner->cycles[THREAD_CYCLES_IRQ]    += victim->cycles[THREAD_CYCLES_IRQ];
       unlock_gate(&(owner->lock), LOCK_WRITE);
       
       /* if the thread was using FP, free its context block */
@@ -399,7 +407,7 @@ kresult thread_kill(process *owner, thread *victim)
       
       /* free up resources */
       vmm_free((void *)(victim->kstackblk));
-      vmm_free(victim);
+      vmm_cache_free(victim, KCACHE_THREAD);
       
       THREAD_DEBUG("[thread:%i] killed thread %i (%p) of process %i (%p)\n",
               CPU_ID, victim->tid, victim, owner->pid, owner);
@@ -40,6 +40,9 @@ rw_gate vmm_lock;
    ---- 8MB ----- max top of kernel -------------------------------
    ---- 4MB ----- start of kernel --------------------------------- 
 
+   The stacks are only used during boot: once pg_init() has mapped physical
+   memory into the kernel, every page frame on them is handed to the buddy
+   allocator, which can find contiguous runs of pages quickly.
 */
 unsigned int *phys_pg_stack_low_base   = KERNEL_PHYS2LOG(MEM_PHYS_STACK_BASE -
                                           sizeof(unsigned int));
@@ -58,6 +61,23 @@ unsigned int phys_pg_low_total = 0, phys_pg_high_total = 0;
 unsigned int phys_pg_count = 0; /* nr of physical pages at our disposable */
 unsigned int phys_pg_reqed = 0; /* nr of physical pages requested */
 
+/* buddy allocator zones and a bitmap with a bit set for the first page
+   frame of every free block, so a buddy can be checked before its header
+   is trusted */
+phys_pg_zone phys_pg_zones[PHYS_ZONES];
+unsigned int *phys_pg_free_map = NULL;
+unsigned int phys_pg_map_frames = 0; /* number of page frames covered by the map */
+unsigned char phys_pg_buddy_ready = 0; /* set once the page stacks have been handed over */
+
+/* pool of page frames zeroed by idle cpus, ready to be handed out */
+void *phys_pg_zeroed[PHYS_PG_ZEROED_MAX];
+unsigned int phys_pg_zeroed_count = 0;
+volatile unsigned int phys_pg_zeroed_lock = 0;
+
+#define PHYS_MAP_SET(a)    (phys_pg_free_map[(a) >> 5] |= (1 << ((a) & 31)))
+#define PHYS_MAP_CLEAR(a)  (phys_pg_free_map[(a) >> 5] &= ~(1 << ((a) & 31)))
+#define PHYS_MAP_TEST(a)   (phys_pg_free_map[(a) >> 5] & (1 << ((a) & 31)))
+
 /* -------------------------------------------------------------------------
     Kernel heap management
    ------------------------------------------------------------------------- */
@@ -130,35 +150,21 @@ kresult vmm_malloc(void **addr, unsigned int size)
    /* if block is unset then we haven't found a suitable block (or the free
       list is empty). so allocate enough pages for the request */
    {
-      /* try using high memory first */
-      int pg_count, type = MEM_HIGH_PG;
-            
-      kresult result = vmm_ensure_pgs(required_capacity, type);
+      /* try using high memory first, then low memory */
+      unsigned int pg_count = (required_capacity / MEM_PGSIZE) + 1;
+      
+      kresult result = vmm_req_phys_pages(pg_count, (void **)&block, MEM_HIGH_PG);
       if(result)
       {
-         /* try using low memory */
-         type = MEM_LOW_PG;
-         result = vmm_ensure_pgs(required_capacity, type);
+         result = vmm_req_phys_pages(pg_count, (void **)&block, MEM_LOW_PG);
          if(result)
          {
-            VMM_DEBUG("[vmm:%i] failed to ensure physical pages for kernel heap (req size %i bytes)\n",
-                      CPU_ID, required_capacity);
+            VMM_DEBUG("[vmm:%i] failed to grab %i physical pages for kernel heap (req size %i bytes)\n",
+                      CPU_ID, pg_count, required_capacity);
             unlock_gate(&(vmm_lock), LOCK_WRITE);
             return result; /* give up otherwise */
          }
       }
-      
-      /* by now, we've verified that we have a run of pages so grab them */
-      for(pg_count = 0; pg_count < ((required_capacity / MEM_PGSIZE) + 1); pg_count++)
-      {
-         result = vmm_req_phys_pg((void **)&block, type); /* get pages in reverse order */
-         if(result)
-         {
-            VMM_DEBUG("[vmm:%i] failed to grab physical page for kernel heap\n", CPU_ID);
-            unlock_gate(&(vmm_lock), LOCK_WRITE);
-            return result; /* XXX shouldn't happen - memory leak */
-         }
-      }
 
       VMM_DEBUG("[vmm:%i] grabbed %i pages for %i bytes (block %p)\n", CPU_ID, pg_count, required_capacity, block);
       
@@ -498,13 +504,13 @@ kpool *vmm_create_pool(unsigned int block_size, unsigned int init_count)
    initsize = KPOOL_BLOCK_TOTALSIZE(block_size) * init_count;
    
    /* allocate a new pool structure and zero it */
-   if(vmm_malloc((void **)&new, sizeof(kpool))) return NULL;
+   if(vmm_cache_alloc((void **)&new, KCACHE_POOL)) return NULL;
    vmm_memset((void *)new, 0, sizeof(kpool));
    
    /* allocate the pool's heap block and zero it */
    if(vmm_malloc((void **)&(new->pool), initsize))
    {
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_POOL);
       return NULL;
    }
    vmm_memset((void *)new->pool, 0, initsize);
@@ -516,7 +522,7 @@ kpool *vmm_create_pool(unsigned int block_size, unsigned int init_count)
    {
       /* something's gone very wrong... */
       vmm_free(new->pool);
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_POOL);
       return NULL;
    }
    
@@ -540,12 +546,12 @@ kresult vmm_destroy_pool(kpool *pool)
    if(lock_gate(&(pool->lock), LOCK_WRITE | LOCK_SELFDESTRUCT))
       return e_failure;
    
-   /* pretty easy stuff */
+   /* pretty easy stuff - but let go of the lock before the pool goes back to the cache */
    if(pool->pool)
       vmm_free(pool->pool);
-   vmm_free(pool);
    
    unlock_gate(&(pool->lock), LOCK_WRITE | LOCK_SELFDESTRUCT);
+   vmm_cache_free(pool, KCACHE_POOL);
    
    VMM_DEBUG("[vmm:%i] destroyed pool %p\n", CPU_ID, pool);
    
@@ -889,10 +895,708 @@ unsigned int vmm_count_pool_inuse(kpool *pool)
 }
 
 
+/* -------------------------------------------------------------------------
+    Slab object caches
+   ------------------------------------------------------------------------- */
+
+#define KCACHE_DEFINE(a, b) { 0, (a), (b), (MEM_PGSIZE - sizeof(kcache_slab)) / KCACHE_SLOT_SIZE(b) }
+
+/* one cache per KCACHE_* type, in the same order */
+kcache vmm_caches[KCACHE_TYPES] =
+{
+   KCACHE_DEFINE("thread",   sizeof(thread)),
+   KCACHE_DEFINE("process",  sizeof(process)),
+   KCACHE_DEFINE("vmm_tree", sizeof(vmm_tree)),
+   KCACHE_DEFINE("vmm_area", sizeof(vmm_area)),
+   KCACHE_DEFINE("kpool",    sizeof(kpool))
+};
+
+/* vmm_cache_unlink_slab
+   Remove a slab from a doubly-linked list of slabs
+   => list = pointer to the list's head pointer
+      slab = slab to remove
+*/
+void vmm_cache_unlink_slab(kcache_slab **list, kcache_slab *slab)
+{
+   if(slab->previous)
+      slab->previous->next = slab->next;
+   else
+      *list = slab->next;
+   
+   if(slab->next)
+      slab->next->previous = slab->previous;
+   
+   slab->previous = slab->next = NULL;
+}
+
+/* vmm_cache_link_slab
+   Add a slab to the front of a doubly-linked list of slabs
+   => list = pointer to the list's head pointer
+      slab = slab to add
+*/
+void vmm_cache_link_slab(kcache_slab **list, kcache_slab *slab)
+{
+   slab->previous = NULL;
+   slab->next = *list;
+   if(*list) (*list)->previous = slab;
+   *list = slab;
+}
+
+/* vmm_cache_grow
+   Claim a physical page and carve it up into a new slab of free objects
+   for a cache, adding it to the cache's partial list. The caller must hold
+   the cache's lock
+   => cache = cache to grow
+      type = KCACHE_* type of the cache
+   <= 0 for success, or an error code
+*/
+kresult vmm_cache_grow(kcache *cache, unsigned int type)
+{
+   kcache_slab *slab;
+   unsigned char *slot;
+   unsigned int loop, slot_size = KCACHE_SLOT_SIZE(cache->obj_size);
+   void *phys;
+   
+   if(vmm_req_phys_pg(&phys, MEM_ANY_PG)) return e_no_phys_pgs;
+   slab = KERNEL_PHYS2LOG(phys);
+   
+   slab->magic = KCACHE_SLAB_MAGIC;
+   slab->type  = type;
+   slab->inuse = 0;
+   
+   /* chain the slots together into the slab's free list */
+   slot = (unsigned char *)slab + sizeof(kcache_slab);
+   slab->free = slot;
+   for(loop = 0; loop < cache->per_slab; loop++)
+   {
+      *KCACHE_SLOT_LINK(cache, slot) = (loop + 1 < cache->per_slab) ? slot + slot_size : NULL;
+      slot += slot_size;
+   }
+   
+   vmm_cache_link_slab(&(cache->partial), slab);
+   cache->slabs++;
+   cache->grows++;
+   
+   VMM_DEBUG("[vmm:%i] grew cache %s with slab %p (%i objects of %i bytes)\n",
+             CPU_ID, cache->name, slab, cache->per_slab, cache->obj_size);
+   
+   return success;
+}
+
+/* vmm_cache_take
+   Take a free object from a cache's slabs, growing the cache if it has none.
+   The caller must hold the cache's lock
+   => cache = cache to take an object from
+      type = KCACHE_* type of the cache
+   <= pointer to the object, or NULL for failure
+*/
+void *vmm_cache_take(kcache *cache, unsigned int type)
+{
+   kcache_slab *slab;
+   void *obj;
+   
+   /* fall back to the held-back empty slab before claiming a new page */
+   if(!cache->partial)
+   {
+      if(cache->empty)
+      {
+         vmm_cache_link_slab(&(cache->partial), cache->empty);
+         cache->empty = NULL;
+      }
+      else if(vmm_cache_grow(cache, type))
+         return NULL;
+   }
+   
+   slab = cache->partial;
+   obj = slab->free;
+   slab->free = *KCACHE_SLOT_LINK(cache, obj);
+   slab->inuse++;
+   cache->taken++;
+   
+   /* move the slab out of the way once it has nothing left to give */
+   if(!slab->free)
+   {
+      vmm_cache_unlink_slab(&(cache->partial), slab);
+      vmm_cache_link_slab(&(cache->full), slab);
+   }
+   
+   return obj;
+}
+
+/* vmm_cache_give
+   Return an object to its slab, releasing the slab's page if it is left
+   unused and the cache already holds back an empty slab. The caller must
+   hold the cache's lock
+   => cache = cache the object belongs to
+      type = KCACHE_* type of the cache
+      obj = object to return
+   <= 0 for success, or an error code
+*/
+kresult vmm_cache_give(kcache *cache, unsigned int type, void *obj)
+{
+   kcache_slab *slab = MEM_PGALIGN(obj);
+   
+   if(slab->magic != KCACHE_SLAB_MAGIC || slab->type != type || !slab->inuse)
+   {
+      KOOPS_DEBUG("[vmm:%i] OMGWTF! vmm_cache_give: object %p is not a live %s (slab %p magic %x type %i)\n",
+                  CPU_ID, obj, cache->name, slab, slab->magic, slab->type);
+      debug_stacktrace();
+      return e_bad_params;
+   }
+   
+   /* a full slab is about to have a free object again */
+   if(!slab->free)
+   {
+      vmm_cache_unlink_slab(&(cache->full), slab);
+      vmm_cache_link_slab(&(cache->partial), slab);
+   }
+   
+   *KCACHE_SLOT_LINK(cache, obj) = slab->free;
+   slab->free = obj;
+   slab->inuse--;
+   cache->taken--;
+   
+   if(slab->inuse) return success;
+   
+   /* the slab is completely free: keep one back, release the rest */
+   vmm_cache_unlink_slab(&(cache->partial), slab);
+   if(!cache->empty)
+   {
+      cache->empty = slab;
+      return success;
+   }
+   
+   slab->magic = 0;
+   cache->slabs--;
+   cache->shrinks++;
+   
+   VMM_DEBUG("[vmm:%i] released slab %p from cache %s\n", CPU_ID, slab, cache->name);
+   
+   return vmm_return_phys_pg(KERNEL_LOG2PHYS(slab));
+}
+
+/* vmm_cache_alloc
+   Allocate an object from one of the kernel's slab caches. The object is
+   served from this cpu's magazine if possible, otherwise the magazine is
+   refilled from the cache's slabs. The object's contents are undefined.
+   => addr = pointer to the variable in which to store the object's address
+      type = KCACHE_* type of object to allocate
+   <= 0 for success, or an error code
+*/
+kresult vmm_cache_alloc(void **addr, unsigned int type)
+{
+   kcache *cache;
+   kcache_magazine *mag = NULL;
+   void *obj;
+   
+   /* sanity checks */
+   if(!addr || type >= KCACHE_TYPES) return e_bad_params;
+   cache = &(vmm_caches[type]);
+   
+   /* the cpu table doesn't exist early on in boot */
+   if(cpu_table)
+   {
+      mag = &(cpu_table[CPU_ID].magazines[type]);
+      
+      /* fast path: this cpu owns its magazine and interrupts are off */
+      if(mag->count)
+      {
+         *addr = mag->objects[--(mag->count)];
+         mag->allocs++;
+         return success;
+      }
+   }
+   
+   lock_spin(&(cache->lock));
+   
+   obj = vmm_cache_take(cache, type);
+   
+   /* top up the magazine so the next few allocations are quick */
+   if(obj && mag)
+      while(mag->count < KCACHE_MAGAZINE_BATCH)
+      {
+         void *spare = vmm_cache_take(cache, type);
+         if(!spare) break;
+         mag->objects[mag->count++] = spare;
+      }
+   
+   if(obj) cache->allocs++;
+   
+   unlock_spin(&(cache->lock));
+   
+   if(!obj) return e_no_phys_pgs;
+   
+   *addr = obj;
+   return success;
+}
+
+/* vmm_cache_free
+   Return an object allocated by vmm_cache_alloc() to its cache, via this
+   cpu's magazine if it has room. A full magazine is half-emptied back into
+   the cache's slabs
+   => addr = object to free
+      type = KCACHE_* type of the object
+   <= 0 for success, or an error code
+*/
+kresult vmm_cache_free(void *addr, unsigned int type)
+{
+   kcache *cache;
+   kcache_magazine *mag = NULL;
+   kresult err;
+   
+   /* sanity checks */
+   if(!addr || type >= KCACHE_TYPES) return e_bad_params;
+   cache = &(vmm_caches[type]);
+   
+   if(cpu_table)
+   {
+      mag = &(cpu_table[CPU_ID].magazines[type]);
+      
+      if(mag->count < KCACHE_MAGAZINE_SIZE)
+      {
+         mag->objects[mag->count++] = addr;
+         mag->frees++;
+         return success;
+      }
+   }
+   
+   lock_spin(&(cache->lock));
+   
+   /* flush the older half of a full magazine back to the slabs */
+   if(mag)
+   {
+      unsigned int loop;
+      
+      for(loop = 0; loop < KCACHE_MAGAZINE_BATCH; loop++)
+         vmm_cache_give(cache, type, mag->objects[loop]);
+      
+      for(loop = KCACHE_MAGAZINE_BATCH; loop < KCACHE_MAGAZINE_SIZE; loop++)
+         mag->objects[loop - KCACHE_MAGAZINE_BATCH] = mag->objects[loop];
+      mag->count -= KCACHE_MAGAZINE_BATCH;
+   }
+   
+   err = vmm_cache_give(cache, type, addr);
+   if(!err) cache->frees++;
+   
+   unlock_spin(&(cache->lock));
+   
+   return err;
+}
+
+/* vmm_cache_stats
+   Gather the statistics for one of the kernel's slab caches. Other cpus'
+   magazines are read without stopping them, so the figures are a snapshot
+   => type = KCACHE_* type of the cache
+      stats = pointer to the structure to fill in
+   <= 0 for success, or an error code
+*/
+kresult vmm_cache_stats(unsigned int type, kcache_stats *stats)
+{
+   kcache *cache;
+   unsigned int loop;
+   
+   /* sanity checks */
+   if(!stats || type >= KCACHE_TYPES) return e_bad_params;
+   cache = &(vmm_caches[type]);
+   
+   vmm_memset(stats, 0, sizeof(kcache_stats));
+   
+   if(cpu_table)
+      for(loop = 0; loop < mp_cpus; loop++)
+      {
+         kcache_magazine *mag = &(cpu_table[loop].magazines[type]);
+         stats->cached += mag->count;
+         stats->magazine_allocs += mag->allocs;
+         stats->magazine_frees += mag->frees;
+      }
+   
+   lock_spin(&(cache->lock));
+   
+   stats->obj_size = cache->obj_size;
+   stats->per_slab = cache->per_slab;
+   stats->slabs    = cache->slabs;
+   stats->inuse    = cache->taken - stats->cached;
+   stats->allocs   = cache->allocs + stats->magazine_allocs;
+   stats->frees    = cache->frees + stats->magazine_frees;
+   stats->grows    = cache->grows;
+   stats->shrinks  = cache->shrinks;
+   
+   unlock_spin(&(cache->lock));
+   
+   return success;
+}
+
+/* vmm_list_caches (aka VMM_DEBUG_CACHES)
+   Output the state of the kernel's slab caches via kernel debug */
+void vmm_list_caches(void)
+{
+   unsigned int loop;
+   kcache_stats stats;
+   
+   for(loop = 0; loop < KCACHE_TYPES; loop++)
+   {
+      if(vmm_cache_stats(loop, &stats)) continue;
+      
+      VMM_DEBUG("[vmm:%i] cache %s: %i bytes x %i per slab, %i slabs, %i in use, %i in magazines\n",
+                CPU_ID, vmm_caches[loop].name, stats.obj_size, stats.per_slab, stats.slabs,
+                stats.inuse, stats.cached);
+      VMM_DEBUG("[vmm:%i]    allocs %i (%i from magazines) frees %i (%i to magazines) grows %i shrinks %i\n",
+                CPU_ID, stats.allocs, stats.magazine_allocs, stats.frees, stats.magazine_frees,
+                stats.grows, stats.shrinks);
+   }
+}
+
+
 /* -------------------------------------------------------------------------
     Physical page management
    ------------------------------------------------------------------------- */
 
+/* vmm_buddy_zone
+   Work out which zone a physical page frame belongs to
+   => frame = page frame number
+   <= PHYS_ZONE_* zone number
+*/
+unsigned int vmm_buddy_zone(unsigned int frame)
+{
+   if(frame < (MEM_DMA_REGION_MARK >> MEM_PGSHIFT)) return PHYS_ZONE_DMA;
+   return PHYS_ZONE_NORMAL;
+}
+
+/* vmm_buddy_link
+   Add a free block to its zone's list for its order and mark it free in the
+   free map. The caller must hold vmm_lock for writing
+   => frame = page frame number of the first page in the block
+      order = size of the block as a power-of-two number of pages
+*/
+void vmm_buddy_link(unsigned int frame, unsigned int order)
+{
+   phys_pg_zone *zone = &(phys_pg_zones[vmm_buddy_zone(frame)]);
+   phys_pg_block *block = KERNEL_PHYS2LOG(frame << MEM_PGSHIFT);
+   
+   block->order = order;
+   block->previous = NULL;
+   block->next = zone->free[order];
+   if(block->next) block->next->previous = block;
+   zone->free[order] = block;
+   
+   zone->blocks[order]++;
+   zone->free_pages += 1 << order;
+   PHYS_MAP_SET(frame);
+}
+
+/* vmm_buddy_unlink
+   Remove a free block from its zone's list and clear it from the free map.
+   The caller must hold vmm_lock for writing
+   => frame = page frame number of the first page in the block
+*/
+void vmm_buddy_unlink(unsigned int frame)
+{
+   phys_pg_zone *zone = &(phys_pg_zones[vmm_buddy_zone(frame)]);
+   phys_pg_block *block = KERNEL_PHYS2LOG(frame << MEM_PGSHIFT);
+   
+   if(block->previous)
+      block->previous->next = block->next;
+   else
+      zone->free[block->order] = block->next;
+   
+   if(block->next)
+      block->next->previous = block->previous;
+   
+   zone->blocks[block->order]--;
+   zone->free_pages -= 1 << block->order;
+   PHYS_MAP_CLEAR(frame);
+}
+
+/* vmm_buddy_alloc
+   Claim a block of 2^order contiguous pages from a zone, splitting a larger
+   block if there's none of the right size. The caller must hold vmm_lock
+   for writing
+   => zone = PHYS_ZONE_* zone to allocate from
+      order = size of the block as a power-of-two number of pages
+      frame = pointer to the variable to store the block's first page frame number in
+   <= 0 for success, or an error code
+*/
+kresult vmm_buddy_alloc(unsigned int zone, unsigned int order, unsigned int *frame)
+{
+   unsigned int search = order, found;
+   
+   /* find the smallest free block that's big enough */
+   while(search < PHYS_ORDERS && !phys_pg_zones[zone].free[search]) search++;
+   if(search >= PHYS_ORDERS)
+      return phys_pg_zones[zone].free_pages ? e_not_contiguous : e_no_phys_pgs;
+   
+   found = (unsigned int)KERNEL_LOG2PHYS(phys_pg_zones[zone].free[search]) >> MEM_PGSHIFT;
+   vmm_buddy_unlink(found);
+   
+   /* give the upper halves back until the block is the size we want */
+   while(search > order)
+   {
+      search--;
+      vmm_buddy_link(found + (1 << search), search);
+   }
+   
+   *frame = found;
+   return success;
+}
+
+/* vmm_buddy_alloc_pref
+   Claim a block of 2^order contiguous pages, honouring a page type preference
+   => order = size of the block as a power-of-two number of pages
+      pref = MEM_LOW_PG to only use DMA-able memory, otherwise try normal
+             memory first and fall back to the DMA zone
+      frame = pointer to the variable to store the block's first page frame number in
+   <= 0 for success, or an error code
+*/
+kresult vmm_buddy_alloc_pref(unsigned int order, unsigned int pref, unsigned int *frame)
+{
+   kresult err;
+   
+   if(pref != MEM_LOW_PG)
+   {
+      err = vmm_buddy_alloc(PHYS_ZONE_NORMAL, order, frame);
+      if(!err) return success;
+   }
+   
+   return vmm_buddy_alloc(PHYS_ZONE_DMA, order, frame);
+}
+
+/* vmm_buddy_free
+   Return a block of 2^order pages to its zone, merging it with its buddy
+   for as long as the buddy is also free. The caller must hold vmm_lock for
+   writing
+   => frame = page frame number of the first page in the block
+      order = size of the block as a power-of-two number of pages
+*/
+void vmm_buddy_free(unsigned int frame, unsigned int order)
+{
+   while(order < PHYS_MAX_ORDER)
+   {
+      unsigned int buddy = frame ^ (1 << order);
+      phys_pg_block *block = KERNEL_PHYS2LOG(buddy << MEM_PGSHIFT);
+      
+      /* stop if the buddy is in use or only partly free. zones are aligned
+         to the largest block size, so a buddy is always in the same zone */
+      if(buddy >= phys_pg_map_frames || !PHYS_MAP_TEST(buddy) || block->order != order)
+         break;
+      
+      vmm_buddy_unlink(buddy);
+      frame &= ~(1 << order);
+      order++;
+   }
+   
+   vmm_buddy_link(frame, order);
+}
+
+/* vmm_buddy_free_pg
+   Return a single page frame to the buddy allocator, checking it's a
+   sensible frame to free. The caller must hold vmm_lock for writing
+   => frame = page frame number to free
+   <= 0 for success, or an error code
+*/
+kresult vmm_buddy_free_pg(unsigned int frame)
+{
+   if(frame >= phys_pg_map_frames || PHYS_MAP_TEST(frame))
+   {
+      KOOPS_DEBUG("[vmm:%i] OMGWTF! vmm_buddy_free_pg: physical page frame "
+                  "%x is outside RAM or already free!\n", CPU_ID, frame << MEM_PGSHIFT);
+      debug_stacktrace();
+      return e_bad_params;
+   }
+   
+   vmm_buddy_free(frame, 0);
+   phys_pg_reqed--;
+   return success;
+}
+
+/* vmm_buddy_free_range
+   Return a run of pages to the buddy allocator in the largest aligned
+   blocks possible. The caller must hold vmm_lock for writing
+   => frame = page frame number of the first page in the run
+      pages = number of pages in the run
+*/
+void vmm_buddy_free_range(unsigned int frame, unsigned int pages)
+{
+   while(pages)
+   {
+      unsigned int order = 0;
+      
+      while(order < PHYS_MAX_ORDER && !(frame & (1 << order)) && (2 << order) <= pages)
+         order++;
+      
+      vmm_buddy_free(frame, order);
+      frame += 1 << order;
+      pages -= 1 << order;
+   }
+}
+
+/* vmm_buddy_order
+   Calculate the smallest block order that will hold a number of pages
+   => pages = number of pages required
+   <= block order, which may be greater than PHYS_MAX_ORDER
+*/
+unsigned int vmm_buddy_order(unsigned int pages)
+{
+   unsigned int order = 0;
+   
+   while((1 << order) < pages) order++;
+   return order;
+}
+
+/* vmm_buddy_initialise
+   Hand every page frame left on the page stacks over to the buddy allocator.
+   This must be called once pg_init() has mapped physical memory into the
+   kernel, as the buddy allocator keeps its free lists in the free pages
+   => frames = number of page frames from physical address zero to the
+               top of physical RAM
+   <= 0 for success, or an error code
+*/
+kresult vmm_buddy_initialise(unsigned int frames)
+{
+   unsigned int *entry, map_size = ((frames + 31) / 32) * sizeof(unsigned int);
+   
+   /* the free map comes off the page stacks before they're drained */
+   if(vmm_malloc((void **)&phys_pg_free_map, map_size)) return e_failure;
+   vmm_memset(phys_pg_free_map, 0, map_size);
+   vmm_memset(phys_pg_zones, 0, sizeof(phys_pg_zone) * PHYS_ZONES);
+   phys_pg_map_frames = frames;
+   
+   lock_gate(&(vmm_lock), LOCK_WRITE);
+   
+   /* note: stack ptrs point to the top available word, and are empty once above the base */
+   for(entry = phys_pg_stack_low_ptr; entry <= phys_pg_stack_low_base; entry++)
+      vmm_buddy_free(*entry >> MEM_PGSHIFT, 0);
+   for(entry = phys_pg_stack_high_ptr; entry <= phys_pg_stack_high_base; entry++)
+      vmm_buddy_free(*entry >> MEM_PGSHIFT, 0);
+   
+   phys_pg_stack_low_ptr = phys_pg_stack_low_base + 1;
+   phys_pg_stack_high_ptr = phys_pg_stack_high_base + 1;
+   phys_pg_buddy_ready = 1;
+   
+   unlock_gate(&(vmm_lock), LOCK_WRITE);
+   
+   BOOT_DEBUG("[vmm:%i] buddy allocator: %i DMA pages, %i normal pages free (map %i bytes)\n",
+              CPU_ID, phys_pg_zones[PHYS_ZONE_DMA].free_pages,
+              phys_pg_zones[PHYS_ZONE_NORMAL].free_pages, map_size);
+   
+   return success;
+}
+
+/* vmm_take_zeroed_pg
+   Take a page frame from the pool of frames zeroed while cpus were idle
+   => addr = pointer to the variable in which to store the frame's physical address
+   <= 0 for success, or e_no_phys_pgs if the pool is empty
+*/
+kresult vmm_take_zeroed_pg(void **addr)
+{
+   kresult err = e_no_phys_pgs;
+   
+   lock_spin(&(phys_pg_zeroed_lock));
+   if(phys_pg_zeroed_count)
+   {
+      *addr = phys_pg_zeroed[--phys_pg_zeroed_count];
+      err = success;
+   }
+   unlock_spin(&(phys_pg_zeroed_lock));
+   
+   return err;
+}
+
+/* vmm_release_zeroed_pgs
+   Give every frame in the pool of zeroed frames back to the buddy allocator,
+   for when memory is short. The pool is topped up again in idle time.
+   This can be called holding vmm_lock: the pool's lock is never held while
+   waiting for vmm_lock
+*/
+void vmm_release_zeroed_pgs(void)
+{
+   void *pages[PHYS_PG_ZEROED_MAX];
+   unsigned int count, loop;
+   
+   lock_spin(&(phys_pg_zeroed_lock));
+   count = phys_pg_zeroed_count;
+   for(loop = 0; loop < count; loop++)
+      pages[loop] = phys_pg_zeroed[loop];
+   phys_pg_zeroed_count = 0;
+   unlock_spin(&(phys_pg_zeroed_lock));
+   
+   if(!count) return;
+   
+   lock_gate(&(vmm_lock), LOCK_WRITE);
+   for(loop = 0; loop < count; loop++)
+      vmm_buddy_free_pg((unsigned int)pages[loop] >> MEM_PGSHIFT);
+   unlock_gate(&(vmm_lock), LOCK_WRITE);
+}
+
+/* vmm_zero_idle_pages
+   Top up the pool of zeroed page frames a batch at a time. Called by a cpu
+   about to go idle, so the cost of cleaning pages is moved out of the page
+   fault path and into time that would otherwise be wasted. The batch stops
+   as soon as the cpu is given a thread to run
+*/
+void vmm_zero_idle_pages(void)
+{
+   unsigned int loop;
+   void *page;
+   
+   if(!phys_pg_buddy_ready) return;
+   
+   for(loop = 0; loop < PHYS_PG_ZEROED_BATCH && phys_pg_zeroed_count < PHYS_PG_ZEROED_MAX; loop++)
+   {
+      if(sched_work_pending(CPU_ID)) return;
+      if(vmm_req_phys_pg(&page, MEM_ANY_PG | MEM_PG_NOZERO)) return;
+      vmm_memset(KERNEL_PHYS2LOG(page), 0, MEM_PGSIZE);
+      
+      lock_spin(&(phys_pg_zeroed_lock));
+      if(phys_pg_zeroed_count < PHYS_PG_ZEROED_MAX)
+      {
+         phys_pg_zeroed[phys_pg_zeroed_count++] = page;
+         page = NULL;
+      }
+      unlock_spin(&(phys_pg_zeroed_lock));
+      
+      /* another cpu filled the pool first */
+      if(page)
+      {
+         vmm_return_phys_pg(page);
+         return;
+      }
+   }
+}
+
+/* vmm_drain_page_caches
+   Give every frame stashed by the cpus back to the buddy allocator so they
+   can merge with their buddies into larger blocks. This can be called holding
+   vmm_lock, as vmm_malloc() does through vmm_req_phys_pages(): nothing waits
+   for vmm_lock while holding a stash's lock, so the two can't deadlock
+*/
+void vmm_drain_page_caches(void)
+{
+   void *pages[PHYS_PG_CACHE_SIZE];
+   unsigned int cpu, count, loop;
+   
+   if(!cpu_table) return;
+   
+   for(cpu = 0; cpu < mp_cpus; cpu++)
+   {
+      phys_pg_cache *cache = &(cpu_table[cpu].page_cache);
+      
+      /* empty the stash then free its frames outside its lock */
+      lock_spin(&(cache->lock));
+      count = cache->count;
+      for(loop = 0; loop < count; loop++)
+         pages[loop] = cache->pages[loop];
+      cache->count = 0;
+      unlock_spin(&(cache->lock));
+      
+      if(!count) continue;
+      
+      lock_gate(&(vmm_lock), LOCK_WRITE);
+      for(loop = 0; loop < count; loop++)
+         vmm_buddy_free_pg((unsigned int)pages[loop] >> MEM_PGSHIFT);
+      unlock_gate(&(vmm_lock), LOCK_WRITE);
+   }
+}
+
 /* vmm_req_phys_pages
    Request a block of contiguous physical memory in whole number of pages.
    If a sub-DMA marker page is requested and no such physical page is
@@ -911,6 +1615,45 @@ kresult vmm_req_phys_pages(unsigned short pages, void **ptr, unsigned int pref)
    unsigned short page_count = pages;
    unsigned int base = 0;
    
+   if(!pages) return e_bad_params;
+   
+   if(phys_pg_buddy_ready)
+   {
+      unsigned int order = vmm_buddy_order(pages), frame;
+      if(order > PHYS_MAX_ORDER) return e_too_big;
+      
+      lock_gate(&(vmm_lock), LOCK_WRITE);
+      
+      err = vmm_buddy_alloc_pref(order, pref, &frame);
+      
+      /* single frames stashed by the cpus or zeroed in advance may be keeping
+         the run apart, so give them back to the normal zone and have another go */
+      if(err && pref != MEM_LOW_PG)
+      {
+         vmm_drain_page_caches();
+         vmm_release_zeroed_pgs();
+         
+         err = vmm_buddy_alloc_pref(order, pref, &frame);
+      }
+      
+      if(err)
+      {
+         unlock_gate(&(vmm_lock), LOCK_WRITE);
+         return err;
+      }
+      
+      /* give back the pages beyond the end of the request */
+      if((1 << order) > pages)
+         vmm_buddy_free_range(frame + pages, (1 << order) - pages);
+      
+      phys_pg_reqed += pages;
+      vmm_memset(KERNEL_PHYS2LOG(frame << MEM_PGSHIFT), 0, pages * MEM_PGSIZE);
+      
+      unlock_gate(&(vmm_lock), LOCK_WRITE);
+      *(unsigned int *)ptr = frame << MEM_PGSHIFT;
+      return success;
+   }
+   
    /* prevent race conditions */
    lock_gate(&(vmm_lock), LOCK_READ);
    
@@ -968,6 +1711,19 @@ kresult vmm_return_phys_pages(void *addr, unsigned int pages)
    /* addr must be valid and aligned */
    if(!addr || MEM_PGALIGN(addr) != addr) return e_bad_params;
    
+   if(phys_pg_buddy_ready)
+   {
+      unsigned int frame = (unsigned int)addr >> MEM_PGSHIFT;
+      if(frame + pages > phys_pg_map_frames) return e_bad_params;
+      
+      lock_gate(&(vmm_lock), LOCK_WRITE);
+      vmm_buddy_free_range(frame, pages);
+      phys_pg_reqed -= pages;
+      unlock_gate(&(vmm_lock), LOCK_WRITE);
+      
+      return success;
+   }
+   
    /* run through the pages, returning them one by one */
    while(pages)
    {
@@ -985,17 +1741,98 @@ kresult vmm_return_phys_pages(void *addr, unsigned int pages)
    requested and no such physical page is available, this function will give up
    and return 1. If no preference is given, this function will attempt to grab
    a physical page from above the DMA marker first, and look below the DMA
-   marker if it has no success.
+   marker if it has no success. Requests with no preference are served from
+   the calling cpu's stash of free frames without taking vmm_lock.
    => addr = pointer to pointer into which new stack frame base address will be
              written.
       pref = 0 to request a page from below the DMA marker, otherwise 1 for no
-             preference.
+             preference. Or in MEM_PG_NOZERO if the caller will overwrite the
+             whole page and doesn't need it cleaned first.
    <= 0 for success or error code
 */
 kresult vmm_req_phys_pg(void **addr, int pref)
 {   
+   unsigned char clean = !(pref & MEM_PG_NOZERO);
+   pref &= ~MEM_PG_NOZERO;
+   
+   /* a page cleaned in idle time saves zeroing one now */
+   if(clean && phys_pg_buddy_ready && pref != MEM_LOW_PG && phys_pg_zeroed_count)
+      if(vmm_take_zeroed_pg(addr) == success) return success;
+   
+   /* take a frame from this cpu's stash if there's no need for a DMA-able one,
+      topping the stash up from the buddy allocator if it's empty */
+   if(phys_pg_buddy_ready && cpu_table && pref != MEM_LOW_PG)
+   {
+      phys_pg_cache *cache = &(cpu_table[CPU_ID].page_cache);
+      void *page = NULL, *batch[PHYS_PG_CACHE_BATCH];
+      unsigned int got = 0, frame;
+      
+      lock_spin(&(cache->lock));
+      if(cache->count) page = cache->pages[--(cache->count)];
+      unlock_spin(&(cache->lock));
+      
+      /* refill an empty stash with a batch claimed before its lock is taken, as
+         vmm_drain_page_caches() can hold vmm_lock while it waits for a stash.
+         only stash frames from the normal zone so DMA-able frames aren't
+         hoarded by cpus when drivers need them */
+      if(!page)
+      {
+         lock_gate(&(vmm_lock), LOCK_WRITE);
+         while(got < PHYS_PG_CACHE_BATCH && !vmm_buddy_alloc(PHYS_ZONE_NORMAL, 0, &frame))
+         {
+            batch[got++] = (void *)(frame << MEM_PGSHIFT);
+            phys_pg_reqed++;
+         }
+         unlock_gate(&(vmm_lock), LOCK_WRITE);
+         
+         /* only this cpu adds to its stash, so there's room for the rest of the batch */
+         if(got)
+         {
+            page = batch[--got];
+            
+            lock_spin(&(cache->lock));
+            while(got) cache->pages[cache->count++] = batch[--got];
+            unlock_spin(&(cache->lock));
+         }
+      }
+      
+      if(page)
+      {
+         *addr = page;
+         
+         /* clean this page */
+         if(clean) vmm_memset(KERNEL_PHYS2LOG(*addr), 0, MEM_PGSIZE);
+         return success;
+      }
+      
+      /* the normal zone's run dry, so fall through to try the DMA zone */
+   }
+   
    lock_gate(&(vmm_lock), LOCK_WRITE);
    
+   if(phys_pg_buddy_ready)
+   {
+      unsigned int frame;
+      
+      if(vmm_buddy_alloc_pref(0, pref, &frame))
+      {
+         unlock_gate(&(vmm_lock), LOCK_WRITE);
+         
+         /* last resort: a frame zeroed in advance, if this request didn't already look */
+         if(pref != MEM_LOW_PG && !clean && vmm_take_zeroed_pg(addr) == success)
+            return success;
+         return e_no_phys_pgs;
+      }
+      
+      phys_pg_reqed++;
+      unlock_gate(&(vmm_lock), LOCK_WRITE);
+      
+      /* clean the page outside of the lock */
+      *addr = (void *)(frame << MEM_PGSHIFT);
+      if(clean) vmm_memset(KERNEL_PHYS2LOG(*addr), 0, MEM_PGSIZE);
+      return success;
+   }
+   
    /* is a DMA-able physical page requested? */
    if(pref == MEM_LOW_PG)
    {
@@ -1062,6 +1899,67 @@ kresult vmm_return_phys_pg(void *addr)
       return e_not_pg_aligned;
    }
 
+   if(phys_pg_buddy_ready)
+   {
+      unsigned int frame = (unsigned int)addr >> MEM_PGSHIFT;
+      kresult err;
+      
+      /* stash normal frames on this cpu, draining the older half of a full stash.
+         DMA-able frames go straight back to their zone so they aren't lost to
+         requests that don't need them */
+      if(cpu_table && frame < phys_pg_map_frames && vmm_buddy_zone(frame) != PHYS_ZONE_DMA)
+      {
+         phys_pg_cache *cache = &(cpu_table[CPU_ID].page_cache);
+         void *spill[PHYS_PG_CACHE_BATCH];
+         unsigned int loop, spilled = 0;
+         
+         /* catch a frame that's already free in the buddy allocator or this stash */
+         lock_spin(&(cache->lock));
+         for(loop = 0; loop < cache->count; loop++)
+            if(cache->pages[loop] == addr) break;
+         
+         if(PHYS_MAP_TEST(frame) || loop < cache->count)
+         {
+            unlock_spin(&(cache->lock));
+            KOOPS_DEBUG("[vmm:%i] OMGWTF! vmm_return_phys_pg: physical page frame "
+                        "%x is already free!\n", CPU_ID, addr);
+            debug_stacktrace();
+            return e_bad_params;
+         }
+         
+         /* take the older half out of a full stash, to free once its lock is dropped */
+         if(cache->count == PHYS_PG_CACHE_SIZE)
+         {
+            for(loop = 0; loop < PHYS_PG_CACHE_BATCH; loop++)
+               spill[loop] = cache->pages[loop];
+            spilled = PHYS_PG_CACHE_BATCH;
+            
+            for(loop = PHYS_PG_CACHE_BATCH; loop < PHYS_PG_CACHE_SIZE; loop++)
+               cache->pages[loop - PHYS_PG_CACHE_BATCH] = cache->pages[loop];
+            cache->count -= PHYS_PG_CACHE_BATCH;
+         }
+         
+         cache->pages[cache->count++] = addr;
+         unlock_spin(&(cache->lock));
+         
+         if(spilled)
+         {
+            lock_gate(&(vmm_lock), LOCK_WRITE);
+            for(loop = 0; loop < spilled; loop++)
+               vmm_buddy_free_pg((unsigned int)spill[loop] >> MEM_PGSHIFT);
+            unlock_gate(&(vmm_lock), LOCK_WRITE);
+         }
+         
+         return success;
+      }
+      
+      lock_gate(&(vmm_lock), LOCK_WRITE);
+      err = vmm_buddy_free_pg(frame);
+      unlock_gate(&(vmm_lock), LOCK_WRITE);
+      
+      return err;
+   }
+   
    lock_gate(&(vmm_lock), LOCK_WRITE);
    
    /* decide which stack we're going to return this page frame onto */
@@ -1113,12 +2011,20 @@ kresult vmm_return_phys_pg(void *addr)
 */
 kresult vmm_enough_pgs(unsigned int size)
 {
+   unsigned int loop, stashed = 0;
+   
    if(!size) return success; /* there's always room for zero bytes ;) */
 
+   /* frames stashed by cpus or zeroed in advance are counted as requested but are still free */
+   if(cpu_table)
+      for(loop = 0; loop < mp_cpus; loop++)
+         stashed += cpu_table[loop].page_cache.count;
+   stashed += phys_pg_zeroed_count;
+   
    lock_gate(&(vmm_lock), LOCK_READ);
    
    /* convert size into whole number of pages, rounding up */
-   if((phys_pg_count - phys_pg_reqed) < ((size / MEM_PGSIZE) + 1))
+   if((phys_pg_count - phys_pg_reqed + stashed) < ((size / MEM_PGSIZE) + 1))
    {
       unlock_gate(&(vmm_lock), LOCK_READ);
       return e_not_enough_pgs;
@@ -1141,6 +2047,28 @@ kresult vmm_ensure_pgs(unsigned int size, int type)
    unsigned int pgs_required, pg_run_count;
    unsigned int *pg_ptr, *pg_base, *pg_ptr_saved, *pg_run_start;
    
+   /* the buddy allocator just needs a free block big enough */
+   if(phys_pg_buddy_ready)
+   {
+      unsigned int zone = (type == MEM_LOW_PG) ? PHYS_ZONE_DMA : PHYS_ZONE_NORMAL;
+      unsigned int order = vmm_buddy_order((size + MEM_PGMASK) >> MEM_PGSHIFT);
+      kresult err = e_not_contiguous;
+      
+      if(order > PHYS_MAX_ORDER) return e_not_contiguous;
+      
+      lock_gate(&(vmm_lock), LOCK_READ);
+      if(!phys_pg_zones[zone].free_pages) err = e_no_phys_pgs;
+      for(; order < PHYS_ORDERS; order++)
+         if(phys_pg_zones[zone].free[order])
+         {
+            err = success;
+            break;
+         }
+      unlock_gate(&(vmm_lock), LOCK_READ);
+      
+      return err;
+   }
+   
    /* if there are no 'high memory' (aka non-DMAable) pages then
       ensure we always pick from the lower memory area */
    if(!phys_pg_high_total) type = MEM_LOW_PG;
@@ -1257,7 +2185,7 @@ kresult vmm_ensure_pgs(unsigned int size, int type)
 kresult vmm_initialise(multiboot_info_t *mbd)
 {
    mb_memory_map_t *region;
-   unsigned int pg_stack_size, *pg_stack_top;
+   unsigned int pg_stack_size, *pg_stack_top, pg_frames = 0;
 
    /* initialise the smp lock */
    vmm_memset(&(vmm_lock), 0, sizeof(rw_gate));
@@ -1291,7 +2219,12 @@ kresult vmm_initialise(multiboot_info_t *mbd)
    while((unsigned int)region < mbd->mmap_addr + mbd->mmap_length)
    {
       if(region->type == 1) /* if region is present RAM */
+      {
+         unsigned int region_top = (region->base_addr_low / MEM_PGSIZE) + (region->length_low / MEM_PGSIZE);
+         
          phys_pg_count += (region->length_low / MEM_PGSIZE);
+         if(region_top > pg_frames) pg_frames = region_top;
+      }
 
       /* get next region */
       region = (mb_memory_map_t *)((unsigned int)region +
@@ -1414,6 +2347,13 @@ kresult vmm_initialise(multiboot_info_t *mbd)
       space using pagination */
    pg_init(); /* non-portable code */
 
+   /* physical memory is now accessible, so switch over to the buddy allocator */
+   if(vmm_buddy_initialise(pg_frames))
+   {
+      KOOPS_DEBUG("*** can't set up physical page buddy allocator - halting.\n");
+      while(1);
+   }
+   
    return 0;
 }
 
@@ -1447,7 +2387,14 @@ void vmm_memset(void *addr, unsigned char value, unsigned int count)
 {
    unsigned char *ptr = (unsigned char *)addr;
    unsigned int i;
-      
+   
+   /* short fills aren't worth the set-up cost of the port's bulk routine */
+   if(count >= MEM_SMALL_COPY)
+   {
+      lowlevel_memset(addr, value, count);
+      return;
+   }
+   
    for(i = 0; i < count; i++)
       ptr[i] = value;
 }
@@ -1469,6 +2416,13 @@ void vmm_memcpy(void *target, void *source, unsigned int count)
    /* sanity checks */
    if(!target || !source || !count) return;
    
+   /* short copies aren't worth the set-up cost of the port's bulk routine */
+   if(count >= MEM_SMALL_COPY)
+   {
+      lowlevel_memcpy(target, source, count);
+      return;
+   }
+   
    for(i = 0; i < count; i++)
       ptr1[i] = ptr2[i];
 }
@@ -1580,7 +2534,7 @@ kresult vmm_link_vma(process *proc, unsigned int baseaddr, vmm_area *vma)
    if(!proc || !baseaddr || !vma || baseaddr >= KERNEL_SPACE_BASE) return e_bad_params;
    
    /* allocate and zero memory for the new tree node */
-   err = vmm_malloc((void **)&new, sizeof(vmm_tree));
+   err = vmm_cache_alloc((void **)&new, KCACHE_VMM_TREE);
    if(err) return err;
    vmm_memset(new, 0, sizeof(vmm_tree));
    
@@ -1618,7 +2572,7 @@ kresult vmm_link_vma(process *proc, unsigned int baseaddr, vmm_area *vma)
    {
       /* the vma already exists or collides with an area */
       err = e_vma_exists;
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_VMM_TREE);
       
       VMM_DEBUG("[vmm:%i] couldn't link vma %p to process %i (%p) - collision with vma %p (base %x size %x)\n", 
               CPU_ID, vma, proc->pid, proc, existing->area, existing->base, existing->area->size);
@@ -1661,6 +2615,7 @@ kresult vmm_unlink_vma(process *owner, vmm_tree *victim)
    
    for(page_loop = 0; page_loop < vma->size; page_loop += MEM_PGSIZE)
       pg_remove_4K_mapping(owner->pgdir, victim->base + page_loop, release_flag);
+   owner->mem_generation++;
    
    /* delete from the vma's users pool */
    mapping = vmm_find_vma_mapping(vma, owner);
@@ -1677,7 +2632,7 @@ kresult vmm_unlink_vma(process *owner, vmm_tree *victim)
    {
       unlock_gate(&(vma->lock), LOCK_WRITE | LOCK_SELFDESTRUCT);
       vmm_destroy_pool(vma->mappings);
-      vmm_free(vma);
+      vmm_cache_free(vma, KCACHE_VMM_AREA);
    }
    else
       unlock_gate(&(vma->lock), LOCK_WRITE);
@@ -1685,7 +2640,7 @@ kresult vmm_unlink_vma(process *owner, vmm_tree *victim)
    VMM_DEBUG("[vmm:%i] unlinked vma %p from tree node %p in process %i (%p)\n",
            CPU_ID, vma, victim, owner->pid, owner);
    
-   return vmm_free(victim);
+   return vmm_cache_free(victim, KCACHE_VMM_TREE);
 }
 
 #define VMM_RESIZE_VMA_RETURN(a) { err = (a); goto vmm_resize_vma_exit; }
@@ -1763,6 +2718,7 @@ kresult vmm_resize_vma(process *owner, vmm_tree *node, signed int change)
          pages.. and other processes will want to use the physical pages. */
       for(page_loop = 0; page_loop < bytes; page_loop += MEM_PGSIZE)
          pg_remove_4K_mapping(owner->pgdir, node->base + vma->size + page_loop, release_flag);
+      owner->mem_generation++;
    }
 
 vmm_resize_vma_exit:
@@ -1797,6 +2753,7 @@ kresult vmm_alter_vma(process *owner, vmm_tree *node, unsigned int flags)
    {
       vma->flags &= ~VMA_ACCESS_MASK; /* clear the access bits */
       vma->flags |= (flags & VMA_ACCESS_MASK); /* set the new access bits */
+      owner->mem_generation++;
    }
    else
       err = e_no_rights; /* permission denied */
@@ -1866,7 +2823,7 @@ kresult vmm_add_vma(process *proc, unsigned int base, unsigned int size,
    /* block any attempt to map over the kernel */
    if(base + MEM_CLIP(base, size) >= KERNEL_SPACE_BASE) return e_bad_params;
 
-   kresult err = vmm_malloc((void **)&new, sizeof(vmm_area));
+   kresult err = vmm_cache_alloc((void **)&new, KCACHE_VMM_AREA);
    if(err) return err;
    vmm_memset(new, 0, sizeof(vmm_area)); /* zero the area */
    
@@ -1882,7 +2839,7 @@ kresult vmm_add_vma(process *proc, unsigned int base, unsigned int size,
    {
       /* tear down this failed vma */
       vmm_destroy_pool(new->mappings);
-      vmm_free(new);
+      vmm_cache_free(new, KCACHE_VMM_AREA);
       
       return err;
    }
@@ -44,6 +44,13 @@ void mp_interrupt_thread(thread *target, unsigned char interrupt)
    return;
 }
 
+/* mp_interrupt_cpu
+   Send a given interrupt to another core */
+void mp_interrupt_cpu(unsigned char cpu, unsigned char interrupt)
+{
+   return;
+}
+
 /* mp_delay
    Cause the processor to pause for a few cycles - the length of a normal
    scheduling quantum */
@@ -78,7 +85,7 @@ void mp_init_cpu_table(void)
    
    /* initialise all cpu run queues */
    for(cpu_loop = 0; cpu_loop < mp_cpus; cpu_loop++)
-      for(priority_loop = 0; priority_loop < SCHED_PRIORITY_MAX; priority_loop++)
+      for(priority_loop = 0; priority_loop < SCHED_PRIORITY_LEVELS; priority_loop++)
       {
          mp_thread_queue *cpu_queue = &(cpu_table[cpu_loop].queues[priority_loop]);
          cpu_queue->priority = priority_loop;
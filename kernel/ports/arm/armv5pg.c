@@ -279,8 +279,8 @@ kresult pg_do_fault(thread *target, unsigned int faultaddr, arm_vector_num vecto
       {
          unsigned int new_phys, new_virt, source_virt;
          
-         /* grab a new (blank) physical page */
-         if(vmm_req_phys_pg((void **)&new_phys, 1))
+         /* grab a new physical page - there's no need to clean it as it's about to be overwritten */
+         if(vmm_req_phys_pg((void **)&new_phys, MEM_ANY_PG | MEM_PG_NOZERO))
             return e_failure; /* bail out if we can't get a phys page */
          
          /* copy physical page to another via kernel virtual addresses */
@@ -551,6 +551,9 @@ kresult pg_new_process(process *new, process *current)
       if(current) unlock_gate(&(current->lock), LOCK_READ);
       return e_failure;
    }
+   
+   /* cloning write-protects the parent's private pages */
+   if(current) current->mem_generation++;
 
    if(current) unlock_gate(&(current->lock), LOCK_READ);
    unlock_gate(&(new->lock), LOCK_WRITE);
@@ -777,6 +780,23 @@ kresult pg_add_4K_mapping(unsigned int **pgdir, unsigned int virtual, unsigned i
 #endif
 }
 
+/* pg_move_4K_pages
+   Move the physical pages behind a run of 4K pages in one process into another.
+   Not supported on this port yet, so the caller must copy the pages instead
+   => target = process to move the pages into
+      tvirtual = base address of the range in the target
+      source = process to move the pages out of
+      svirtual = base address of the range in the source
+      pages = number of 4K pages in the range
+      moved = pointer to word to add the number of pages actually moved to
+   <= 0 for success or an error code
+*/
+kresult pg_move_4K_pages(process *target, unsigned int tvirtual, process *source,
+                         unsigned int svirtual, unsigned int pages, unsigned int *moved)
+{
+   return e_failure;
+}
+
 /* pg_add_1M_mapping
    Add or edit an existing 1M mapping to a page directory
    => pgdir = pointer to page directory to add the 1M mapping to
@@ -40,4 +40,30 @@ void lowlevel_kickstart(void);
 #define lowlevel_cpu_sleep arm_cpu_sleep 
 void arm_cpu_sleep(int_registers_block *regs);
 
+/* return the bit number of the least significant set bit in a non-zero word:
+   isolate the lowest bit and count the zeroes above it (ARMv5 and later) */
+static __inline__ unsigned int arm_find_first_set(unsigned int word)
+{
+   unsigned int zeroes;
+   __asm__ __volatile__("clz %0, %1" : "=r" (zeroes) : "r" (word & -word));
+   return 31 - zeroes;
+}
+#define lowlevel_find_first_set arm_find_first_set
+void arm_memcpy(void *target, void *source, unsigned int count);
+void arm_memset(void *addr, unsigned char value, unsigned int count);
+#define lowlevel_memcpy arm_memcpy
+#define lowlevel_memset arm_memset
+
+/* the scheduler timer isn't dynamically programmable on this port yet, so
+   refuse one-shot requests and keep the periodic tick running while idle */
+#define lowlevel_timer_oneshot(a) (e_failure)
+#define lowlevel_timer_oneshot_usec(a) (e_failure)
+#define lowlevel_timer_periodic() (0)
+
+/* there's no free-running cycle counter to hand, so timestamp with the msec clock */
+#define lowlevel_read_cyclecount() ((unsigned long long)sched_msec_counter)
+#define lowlevel_read_usec() ((unsigned long long)sched_msec_counter * 1000)
+#define lowlevel_usec_calibrated() (0)
+#define lowlevel_cycles_to_usec(a) ((a) * 1000)
+
 #endif
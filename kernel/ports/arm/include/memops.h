@@ -0,0 +1,72 @@
+/* kernel/ports/arm/include/memops.h
+ * bulk memory copy and fill primitives for the ARM port
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.18:00:00
+ 
+Copyright (c) Chris Williams and individual contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+#ifndef _MEMOPS_H
+#define   _MEMOPS_H
+
+/* these primitives don't depend on the rest of the kernel so that
+   scripts/memops-bench.c can build them for the host. they move data in
+   32-byte bursts, a whole ARM926 cache line at a time */
+
+#define ARM_BURST_SIZE        (32) /* bytes moved per ldm/stm loop iteration */
+#define ARM_WORD_MASK         (3)  /* ldm and stm need word-aligned addresses */
+
+/* arm_copy_ldm
+   Copy whole bursts of ARM_BURST_SIZE bytes with ldm/stm
+   => target = word-aligned destination address
+      source = word-aligned source address
+      bursts = number of bursts to copy, must be non-zero
+*/
+static inline void arm_copy_ldm(void *target, const void *source, unsigned int bursts)
+{
+   __asm__ __volatile__("1:\n\t"
+                        "ldmia %1!, {r3, r4, r5, r6}\n\t"
+                        "stmia %0!, {r3, r4, r5, r6}\n\t"
+                        "ldmia %1!, {r3, r4, r5, r6}\n\t"
+                        "stmia %0!, {r3, r4, r5, r6}\n\t"
+                        "subs %2, %2, #1\n\t"
+                        "bne 1b"
+                        : "+r" (target), "+r" (source), "+r" (bursts)
+                        :
+                        : "r3", "r4", "r5", "r6", "memory", "cc");
+}
+
+/* arm_fill_stm
+   Fill whole bursts of ARM_BURST_SIZE bytes with stm
+   => target = word-aligned destination address
+      value = byte to fill with
+      bursts = number of bursts to fill, must be non-zero
+*/
+static inline void arm_fill_stm(void *target, unsigned char value, unsigned int bursts)
+{
+   unsigned int pattern = value * 0x01010101;
+   
+   __asm__ __volatile__("mov r3, %2\n\t"
+                        "mov r4, %2\n\t"
+                        "mov r5, %2\n\t"
+                        "mov r6, %2\n\t"
+                        "1:\n\t"
+                        "stmia %0!, {r3, r4, r5, r6}\n\t"
+                        "stmia %0!, {r3, r4, r5, r6}\n\t"
+                        "subs %1, %1, #1\n\t"
+                        "bne 1b"
+                        : "+r" (target), "+r" (bursts)
+                        : "r" (pattern)
+                        : "r3", "r4", "r5", "r6", "memory", "cc");
+}
+
+#endif
@@ -31,10 +31,17 @@ void syscall_do_thread_exit(int_registers_block *regs);
 void syscall_do_thread_fork(int_registers_block *regs);
 void syscall_do_thread_kill(int_registers_block *regs);
 void syscall_do_thread_sleep(int_registers_block *regs);
+void syscall_do_timer(int_registers_block *regs);
 void syscall_do_msg_send(int_registers_block *regs);
 void syscall_post_msg_send(thread *sender, kresult result);
 void syscall_do_msg_recv(int_registers_block *regs);
 void syscall_post_msg_recv(thread *receiver, kresult result);
+void syscall_do_msg_fast(int_registers_block *regs);
+void syscall_post_msg_fast(thread *receiver, kresult result, unsigned int tag,
+                           unsigned int control, unsigned int *words);
+void syscall_do_doorbell(int_registers_block *regs);
+void syscall_do_msg_batch(int_registers_block *regs);
+kresult syscall_msg_send(thread *current, diosix_msg_info *msg);
 void syscall_do_privs(int_registers_block *regs);
 void syscall_do_info(int_registers_block *regs);
 void syscall_do_driver(int_registers_block *regs);
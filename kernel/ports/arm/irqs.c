@@ -36,6 +36,12 @@ void irq_handler(int_registers_block regs)
    
    IRQ_DEBUG("[irq:%i] processing IRQ %i (registers at %p)\n", CPU_ID, regs.intnum, &regs);
 
+   if(cpu_table)
+   {
+      sched_trace(DIOSIX_TRACE_IRQ_ENTER, cpu_table[CPU_ID].current, regs.intnum, 0);
+      sched_account(cpu_table[CPU_ID].current, THREAD_CYCLES_IRQ);
+   }
+
    lock_gate(&irq_lock, LOCK_READ);
    
    /* the interrupt might trigger a reschedule that will change the currently
@@ -105,7 +111,7 @@ void irq_handler(int_registers_block regs)
                          CPU_ID, driver->proc->pid, driver->proc, regs.intnum, driver);
                if(driver->proc)
                {
-                  msg_send_signal(driver->proc, NULL, SIGXIRQ, regs.intnum);
+                  msg_send_irq(driver->proc, regs.intnum);
                   handled = 1;
                }
             }
@@ -121,6 +127,14 @@ void irq_handler(int_registers_block regs)
    unlock_gate(&irq_lock, LOCK_READ);
 
 irq_handler_exit:
+   if(cpu_table)
+   {
+      sched_trace(DIOSIX_TRACE_IRQ_EXIT, cpu_table[CPU_ID].current, regs.intnum, 0);
+      
+      /* the kernel isn't preemptible so the interrupt must have arrived in usermode */
+      sched_account(cpu_table[CPU_ID].current, THREAD_CYCLES_USER);
+   }
+   
    if(!handled)
    {
       IRQ_DEBUG("[irq:%i] spurious IRQ %i!\n", CPU_ID, regs.intnum);
@@ -268,6 +282,31 @@ kresult irq_register_driver(unsigned int irq_num, unsigned int flags,
       
       new->proc = proc; /* driver is a userspace process */
       
+      /* give the process somewhere to gather its raised IRQs */
+      if(!(proc->irqs_pending))
+      {
+         diosix_irq_set *set;
+         
+         err = vmm_malloc((void **)&set, sizeof(diosix_irq_set));
+         if(err)
+         {
+            vmm_free(new);
+            return err;
+         }
+         
+         vmm_memset(set, 0, sizeof(diosix_irq_set));
+         
+         lock_spin(&(proc->endpoint.lock));
+         if(!(proc->irqs_pending))
+         {
+            proc->irqs_pending = set;
+            set = NULL;
+         }
+         unlock_spin(&(proc->endpoint.lock));
+         
+         if(set) vmm_free(set); /* another thread beat us to it */
+      }
+      
       lock_gate(&(proc->lock), LOCK_WRITE);
       
       /* add the driver to the start of the process's list */
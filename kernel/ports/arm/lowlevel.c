@@ -16,6 +16,7 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 */
 
 #include <portdefs.h>
+#include <memops.h>
 
 // --------------------- atomic locking support ---------------------------
 
@@ -31,6 +32,80 @@ void unlock_spin(volatile unsigned int *spinlock)
 {
 }
 
+// ---------------------- memory copy and fill -----------------------------
+
+/* arm_memcpy (aka lowlevel_memcpy)
+   Copy bytes forwards using ldm/stm bursts when the source and target
+   share the same word alignment, otherwise a byte at a time
+   => target = destination address
+      source = source address
+      count = number of bytes to copy
+*/
+void arm_memcpy(void *target, void *source, unsigned int count)
+{
+   unsigned char *to = (unsigned char *)target;
+   unsigned char *from = (unsigned char *)source;
+   
+   if(!(((unsigned int)to ^ (unsigned int)from) & ARM_WORD_MASK))
+   {
+      unsigned int bulk;
+      
+      /* bring both pointers up to a word boundary */
+      while(count && ((unsigned int)to & ARM_WORD_MASK))
+      {
+         *to++ = *from++;
+         count--;
+      }
+      
+      bulk = count & ~(ARM_BURST_SIZE - 1);
+      if(bulk)
+      {
+         arm_copy_ldm(to, from, bulk / ARM_BURST_SIZE);
+         to += bulk;
+         from += bulk;
+         count -= bulk;
+      }
+      
+      while(count >= sizeof(unsigned int))
+      {
+         *(unsigned int *)to = *(unsigned int *)from;
+         to += sizeof(unsigned int);
+         from += sizeof(unsigned int);
+         count -= sizeof(unsigned int);
+      }
+   }
+   
+   while(count--) *to++ = *from++;
+}
+
+/* arm_memset (aka lowlevel_memset)
+   Fill bytes using stm bursts
+   => addr = destination address
+      value = byte to fill with
+      count = number of bytes to fill
+*/
+void arm_memset(void *addr, unsigned char value, unsigned int count)
+{
+   unsigned char *to = (unsigned char *)addr;
+   unsigned int bulk;
+   
+   while(count && ((unsigned int)to & ARM_WORD_MASK))
+   {
+      *to++ = value;
+      count--;
+   }
+   
+   bulk = count & ~(ARM_BURST_SIZE - 1);
+   if(bulk)
+   {
+      arm_fill_stm(to, value, bulk / ARM_BURST_SIZE);
+      to += bulk;
+      count -= bulk;
+   }
+   
+   while(count--) *to++ = value;
+}
+
 // ---------------------------- generic veneers ---------------------------
 
 void lowlevel_thread_switch(thread *now, thread *next, int_registers_block *regs)
@@ -22,6 +22,7 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
    => r0 = DIOSIX_THREAD_INFO: read info about the currently running thread
            DIOSIX_PROCESS_INFO: read info about the currently running process
            DIOSIX_KERNEL_INFO: read info about the currently running kernel
+           DIOSIX_SCHED_TRACE: copy a cpu's scheduler trace (executive and drivers only)
       r1 = pointer to empty diosix_thread_info/diosix_process_info/diosix_kernel_info
            structure for kernel to fill in
    <= r0 = 0 for succes or an error code
@@ -30,10 +31,27 @@ void syscall_do_info(int_registers_block *regs)
 {
    diosix_info_block *block = (diosix_info_block *)(regs->r0);
    thread *current = cpu_table[CPU_ID].current;
+   unsigned long long cycles[THREAD_CYCLES_TYPES];
    
    SYSCALL_DEBUG("[sys:%i] SYSCALL_INFO(%i) called by process %i (thread %i)\n",
                  CPU_ID, regs->r1, current->proc->pid, current->tid);
 
+   /* the scheduler trace is too big to fit in an info block, so check it separately */
+   if(regs->r1 == DIOSIX_SCHED_TRACE)
+   {
+      diosix_sched_trace *trace = (diosix_sched_trace *)(regs->r0);
+      
+      /* only the executive and drivers get to snoop on the scheduler */
+      if(current->proc->layer > LAYER_DRIVERS)
+         SYSCALL_RETURN(e_no_rights);
+      
+      if(!trace || (regs->r0 + MEM_CLIP(trace, sizeof(diosix_sched_trace))) > KERNEL_SPACE_BASE)
+         SYSCALL_RETURN(e_bad_address);
+      
+      /* a bad pointer will page fault in the caller's virtual space */
+      SYSCALL_RETURN(sched_trace_copy(trace->cpu, trace));
+   }
+   
    /* sanity check pointer for badness */
    if(!block || (regs->r0 + MEM_CLIP(block, sizeof(diosix_info_block))) > KERNEL_SPACE_BASE)
       SYSCALL_RETURN(e_bad_address);
@@ -45,6 +63,8 @@ void syscall_do_info(int_registers_block *regs)
          block->data.t.tid      = current->tid;
          block->data.t.cpu      = current->cpu;
          block->data.t.priority = current->priority;
+         block->data.t.migrations = current->migrations;
+         sched_cycles_to_cpu_time(current->cycles, &(block->data.t.time));
          SYSCALL_RETURN(success);
          
       case DIOSIX_PROCESS_INFO:
@@ -61,6 +81,11 @@ void syscall_do_info(int_registers_block *regs)
          block->data.p.proc_group_id = current->proc->proc_group_id;
          block->data.p.session_id    = current->proc->session_id;
          block->data.p.role = current->proc->role;
+         
+         /* the time charged at syscall entry brings the caller's own figures up to date */
+         proc_sum_cycles(current->proc, cycles);
+         sched_cycles_to_cpu_time(cycles, &(block->data.p.time));
+         sched_cycles_to_cpu_time(current->proc->child_cycles, &(block->data.p.children_time));
          SYSCALL_RETURN(success);
          
       /* these are defined externally in the makefile */
@@ -77,6 +102,8 @@ void syscall_do_info(int_registers_block *regs)
       case DIOSIX_KERNEL_STATISTICS:
       {
          block->data.s.kernel_uptime       = sched_msec_counter;
+         block->data.s.sched_migrations    = sched_total_migrations();
+         block->data.s.uptime_usec         = sched_get_usec();
          SYSCALL_RETURN(success);
       }
    }
@@ -26,6 +26,9 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
               => r1 = bitfield of POSIX-compatible signals that process will accept
            DIOSIX_KERNEL_SIGNALS:
               => r1 = bitfield of kernel-generated signals that process will accept
+           DIOSIX_SCHED_REALTIME: join or leave the real-time scheduling class (executive and drivers only)
+              => r1 = period in usec, or 0 to leave the class
+                 r2 = usec of cpu time to run at real-time priority per period
    <= r0 = 0 for success or an error code
 */
 void syscall_do_privs(int_registers_block *regs)
@@ -50,6 +53,10 @@ void syscall_do_privs(int_registers_block *regs)
       case DIOSIX_KERNEL_SIGNALS:
          current->proc->kernel_signals_accepted = regs->r1;
          SYSCALL_RETURN(success);
+         
+      case DIOSIX_SCHED_REALTIME:
+         if(current->proc->layer > LAYER_DRIVERS) SYSCALL_RETURN(e_no_rights);
+         SYSCALL_RETURN(sched_set_realtime(current, regs->r1, regs->r2));
    }
    
    /* fall through to returning an error code */
@@ -331,7 +338,7 @@ void syscall_do_set_id(int_registers_block *regs)
          if(!role)
          {
             lock_gate(&(current->lock), LOCK_WRITE);
-            SYSCALL_SET_ID_RETURN(current, proc_role_remove(current, role));
+            SYSCALL_SET_ID_RETURN(current, proc_role_remove(current, current->role));
          }
          
          /* otherwise, try to add it */
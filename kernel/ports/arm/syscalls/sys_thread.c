@@ -147,3 +147,29 @@ void syscall_do_thread_sleep(int_registers_block *regs)
    
    SYSCALL_RETURN(sched_add_snoozer(current, regs->r0, wake));
 }
+
+/* syscall: timer - set a high-resolution timer for the current thread. the tick-based
+   thread_sleep and alarm calls are wrappers around the same kernel timers.
+   => r0 = DIOSIX_TIMER_SLEEP: block the current thread until the time has elapsed
+           DIOSIX_TIMER_ALARM: send a SIGALRM signal to the process once the time has elapsed
+      r1 = number of microseconds to wait, or 0 to cancel any outstanding timers
+   <= r0 = 0 for success (after blocking), or an error code
+*/
+void syscall_do_timer(int_registers_block *regs)
+{
+   thread *current = cpu_table[CPU_ID].current;
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_TIMER(%i, %i) called by process %i (%p) (thread %i)\n",
+                 CPU_ID, regs->r0, regs->r1, current->proc->pid, current->proc, current->tid);
+   
+   switch(regs->r0)
+   {
+      case DIOSIX_TIMER_SLEEP:
+         SYSCALL_RETURN(sched_add_timer(current, 0, regs->r1, wake));
+         
+      case DIOSIX_TIMER_ALARM:
+         SYSCALL_RETURN(sched_add_timer(current, 0, regs->r1, signal));
+   }
+   
+   SYSCALL_RETURN(e_bad_params);
+}
@@ -52,6 +52,9 @@ void exception_handler(int_registers_block regs)
 
    regs.intnum &= 0xff; /* just interested in the low byte */
    
+   /* bill the running thread for its time in usermode, or the kernel if it faulted there */
+   if(cpu_table) sched_account(cpu_table[CPU_ID].current, THREAD_CYCLES_KERNEL);
+   
    switch(regs.intnum)
    {
       /* cpu exceptions */
@@ -187,16 +190,23 @@ void exception_handler(int_registers_block regs)
          break;
          
       case INT_IPI_RESCHED: /* IPI: Foreced reschedule */
-         /* wait until another core marks this thread as
-            non-running and then pick another thread */
+         lapic_end_interrupt();
+         
+         /* an idle core, or one running a less important thread than one
+            just queued for it, is sent this to pick up the new work */
+         if(!cpu_table[CPU_ID].current) break;
+         
+         /* wait for any core changing this thread's state to finish
+            and then pick a thread on the way out. the thread may well
+            still be running if it's about to be preempted */
          lock_gate(&(cpu_table[CPU_ID].current->lock), LOCK_READ);
-         while(cpu_table[CPU_ID].current->state != running);
          unlock_gate(&(cpu_table[CPU_ID].current->lock), LOCK_READ);
          break;
 
       case INT_IPI_FLUSHTLB: /* IPI: flush TLB/reload page tables */
          {
             thread *t = cpu_table[CPU_ID].current;
+            lapic_end_interrupt();
             if(t && t->state == running)
                x86_load_cr3(KERNEL_LOG2PHYS(t->proc->pgdir));
          }
@@ -274,6 +284,22 @@ void exception_handler(int_registers_block regs)
                syscall_do_debug(&regs);
                break;
                
+            case SYSCALL_TIMER:
+               syscall_do_timer(&regs);
+               break;
+               
+            case SYSCALL_MSG_FAST:
+               syscall_do_msg_fast(&regs);
+               break;
+               
+            case SYSCALL_DOORBELL:
+               syscall_do_doorbell(&regs);
+               break;
+               
+            case SYSCALL_MSG_BATCH:
+               syscall_do_msg_batch(&regs);
+               break;
+               
             default:
                XPT_DEBUG("[xpt:%i] unknown syscall %x by thread %i in process %i\n",
                          CPU_ID, regs.edx, cpu_table[CPU_ID].current->tid,
@@ -290,9 +316,14 @@ void exception_handler(int_registers_block regs)
    /* there might be a thread of a higher-priority waiting to be run or the current process
       may not exist - so prod the scheduler to switch to another thread if need be -
       but don't try to switch out if we just did a kernel->kernel exception */
-   if((regs.eip < KERNEL_SPACE_BASE) || (cpu_table[CPU_ID].current->state != running))
+   if((regs.eip < KERNEL_SPACE_BASE) || !(cpu_table[CPU_ID].current) ||
+      (cpu_table[CPU_ID].current->state != running))
       sched_pick(&regs);
 
+   /* bill whichever thread we're returning to for its time in the kernel */
+   if(cpu_table) sched_account(cpu_table[CPU_ID].current,
+                               (regs.eip < KERNEL_SPACE_BASE) ? THREAD_CYCLES_USER : THREAD_CYCLES_KERNEL);
+   
    XPT_DEBUG("[xpt:%i] OUT: ds %x edi %x esi %x ebp %x esp %x ebx %x edx %x ecx %x eax %x\n"
              "      intnum %x errcode %x eip %x cs %x eflags %x useresp %x ss %x\n",
              CPU_ID, regs.ds, regs.edi, regs.esi, regs.ebp, regs.esp, regs.ebx, regs.edx, regs.ecx, regs.eax,
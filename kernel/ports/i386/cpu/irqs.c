@@ -41,6 +41,12 @@ void irq_handler(int_registers_block regs)
    
    /* make sure we only consider the low byte, which contains the irq number */
    regs.intnum = regs.intnum % IRQ_MAX_LINES;
+   
+   if(cpu_table)
+   {
+      sched_trace(DIOSIX_TRACE_IRQ_ENTER, cpu_table[CPU_ID].current, regs.intnum, 0);
+      sched_account(cpu_table[CPU_ID].current, THREAD_CYCLES_IRQ);
+   }
  
    lock_gate(&irq_lock, LOCK_READ);
 
@@ -102,7 +108,7 @@ void irq_handler(int_registers_block regs)
                          CPU_ID, driver->proc->pid, driver->proc, regs.intnum, driver);
                if(driver->proc)
                {
-                  msg_send_signal(driver->proc, NULL, SIGXIRQ, regs.intnum);
+                  msg_send_irq(driver->proc, regs.intnum);
                   handled = 1;
                }
             }
@@ -116,6 +122,16 @@ irq_handler_exit_pre_unlock:
    unlock_gate(&irq_lock, LOCK_READ);
 irq_handler_exit_post_unlock:
    
+   if(cpu_table) sched_trace(DIOSIX_TRACE_IRQ_EXIT, cpu_table[CPU_ID].current, regs.intnum, 0);
+   
+   /* if this cpu was idling with its tick stopped then get the tick going
+      again and run whatever the IRQ has woken up */
+   if(cpu_table && cpu_table[CPU_ID].tickless) sched_pick(&regs);
+   
+   /* charge the interrupt to the thread it interrupted, or whatever's now running */
+   if(cpu_table) sched_account(cpu_table[CPU_ID].current,
+                               (regs.eip < KERNEL_SPACE_BASE) ? THREAD_CYCLES_USER : THREAD_CYCLES_KERNEL);
+   
 #ifdef IRQ_DEBUG
    if(!handled)
    {
@@ -267,6 +283,31 @@ kresult irq_register_driver(unsigned int irq_num, unsigned int flags,
       }
       
       new->proc = proc; /* driver is a userspace process */
+      
+      /* give the process somewhere to gather its raised IRQs */
+      if(!(proc->irqs_pending))
+      {
+         diosix_irq_set *set;
+         
+         err = vmm_malloc((void **)&set, sizeof(diosix_irq_set));
+         if(err)
+         {
+            vmm_free(new);
+            return err;
+         }
+         
+         vmm_memset(set, 0, sizeof(diosix_irq_set));
+         
+         lock_spin(&(proc->endpoint.lock));
+         if(!(proc->irqs_pending))
+         {
+            proc->irqs_pending = set;
+            set = NULL;
+         }
+         unlock_spin(&(proc->endpoint.lock));
+         
+         if(set) vmm_free(set); /* another thread beat us to it */
+      }
 
       lock_gate(&(proc->lock), LOCK_WRITE);
       
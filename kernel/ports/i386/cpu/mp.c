@@ -84,6 +84,20 @@ void mp_interrupt_thread(thread *target, unsigned char interrupt)
    unlock_gate(&(target->lock), LOCK_READ);
 }
 
+/* mp_interrupt_cpu
+   Send a given interrupt to another core, such as to wake it from idle
+   => cpu = id of the core to interrupt
+      interrupt = vector to send
+*/
+void mp_interrupt_cpu(unsigned char cpu, unsigned char interrupt)
+{
+   /* sanity check - no bad ids or uniproc machines */
+   if(mp_cpus < 2 || cpu >= mp_cpus || cpu == CPU_ID || !interrupt) return;
+   
+   MP_DEBUG("[mp:%i] sending interrupt %i to cpu %i\n", CPU_ID, interrupt, cpu);
+   lapic_ipi_send(cpu, interrupt);
+}
+
 /* mp_catch_ap
    This is the point where an application processor joins the kernel proper */
 void _mp_catch_ap(void)
@@ -206,19 +220,24 @@ kresult mp_init_ap(unsigned int id)
 void mp_init_cpu_table(void)
 {
    unsigned int cpu_loop, priority_loop;
+   void *table;
    
-   if(vmm_malloc((void **)&cpu_table, sizeof(mp_core) * mp_cpus))
+   /* allocate enough to start the table on a cache line boundary so
+      that no two cpus' structures share a line */
+   if(vmm_malloc(&table, (sizeof(mp_core) * mp_cpus) + MP_CACHE_LINE_SIZE))
    {
       MP_DEBUG("[mp:%i] can't allocate cpu table! halting...\n");
       while(1);
    }
    
+   cpu_table = (mp_core *)(((unsigned int)table + MP_CACHE_LINE_SIZE - 1) & ~(MP_CACHE_LINE_SIZE - 1));
+   
    /* zero everything */
    vmm_memset((void *)cpu_table, 0, sizeof(mp_core) * mp_cpus);
    
    /* initialise all cpu run queues */
    for(cpu_loop = 0; cpu_loop < mp_cpus; cpu_loop++)
-      for(priority_loop = 0; priority_loop < SCHED_PRIORITY_MAX; priority_loop++)
+      for(priority_loop = 0; priority_loop < SCHED_PRIORITY_LEVELS; priority_loop++)
       {
          mp_thread_queue *cpu_queue = &(cpu_table[cpu_loop].queues[priority_loop]);
          cpu_queue->priority = priority_loop;
@@ -163,8 +163,8 @@ kresult pg_do_fault(thread *target, unsigned int faultaddr, unsigned int cpuflag
       {
          unsigned int new_phys, new_virt, source_virt;
          
-         /* grab a new (blank) physical page */
-         if(vmm_req_phys_pg((void **)&new_phys, 1))
+         /* grab a new physical page - there's no need to clean it as it's about to be overwritten */
+         if(vmm_req_phys_pg((void **)&new_phys, MEM_ANY_PG | MEM_PG_NOZERO))
             return e_failure; /* bail out if we can't get a phys page */
          
          /* copy physical page to another via kernel virtual addresses */
@@ -432,6 +432,9 @@ kresult pg_new_process(process *new, process *current)
       if(current) unlock_gate(&(current->lock), LOCK_READ);
       return e_failure;
    }
+   
+   /* cloning write-protects the parent's private pages */
+   if(current) current->mem_generation++;
 
    if(current) unlock_gate(&(current->lock), LOCK_READ);
    unlock_gate(&(new->lock), LOCK_WRITE);
@@ -686,6 +689,78 @@ kresult pg_add_4K_mapping(unsigned int **pgdir, unsigned int virtual, unsigned i
    return 0;
 }
 
+/* pg_move_4K_pages
+   Move the physical pages behind a run of 4K pages in one process into another,
+   releasing whatever was mapped in the target. A page is only moved if it is
+   present, writeable and private in the source, otherwise it is copied instead.
+   Moved pages are unmapped from the source so it'll fault in blank pages on
+   its next access. Both ranges must be page aligned and already faulted in
+   => target = process to move the pages into
+      tvirtual = base address of the range in the target
+      source = process to move the pages out of
+      svirtual = base address of the range in the source
+      pages = number of 4K pages in the range
+      moved = pointer to word to add the number of pages actually moved to
+   <= 0 for success or an error code
+*/
+kresult pg_move_4K_pages(process *target, unsigned int tvirtual, process *source,
+                         unsigned int svirtual, unsigned int pages, unsigned int *moved)
+{
+   unsigned int loop, count = 0;
+   process *current_proc = NULL;
+   kresult err = success;
+   
+   if(!target || !source || !moved) return e_bad_params;
+   if(!MEM_IS_PG_ALIGNED(tvirtual) || !MEM_IS_PG_ALIGNED(svirtual)) return e_bad_params;
+   
+   for(loop = 0; loop < pages; loop++)
+   {
+      unsigned int tentry = 0, sentry = 0;
+      unsigned int *ttbl, *stbl;
+      
+      /* look up both page table entries - the page tables must already exist */
+      ttbl = (unsigned int *)((unsigned int)target->pgdir[(tvirtual >> PG_DIR_BASE) & PG_INDEX_MASK] & PG_4K_MASK);
+      stbl = (unsigned int *)((unsigned int)source->pgdir[(svirtual >> PG_DIR_BASE) & PG_INDEX_MASK] & PG_4K_MASK);
+      if(ttbl) tentry = ((unsigned int *)KERNEL_PHYS2LOG(ttbl))[(tvirtual >> PG_TBL_BASE) & PG_INDEX_MASK];
+      if(stbl) sentry = ((unsigned int *)KERNEL_PHYS2LOG(stbl))[(svirtual >> PG_TBL_BASE) & PG_INDEX_MASK];
+      
+      if(!(tentry & PG_PRESENT) || !(sentry & PG_PRESENT))
+      {
+         err = e_bad_address;
+         break;
+      }
+      
+      if((sentry & (PG_RW | PG_PRIVATE)) == (PG_RW | PG_PRIVATE))
+      {
+         /* hand the source's physical page over to the target, dropping the target's old page */
+         pg_remove_4K_mapping(target->pgdir, tvirtual, 1);
+         pg_add_4K_mapping(target->pgdir, tvirtual, sentry & PG_4K_MASK,
+                           PG_PRESENT | (tentry & PG_RW) | PG_PRIVLVL | PG_PRIVATE);
+         pg_remove_4K_mapping(source->pgdir, svirtual, 0);
+         count++;
+      }
+      else
+         /* the page may be shared with another process, so copy it */
+         vmm_memcpy(KERNEL_PHYS2LOG(tentry & PG_4K_MASK), KERNEL_PHYS2LOG(sentry & PG_4K_MASK), MEM_PGSIZE);
+      
+      tvirtual += MEM_PGSIZE;
+      svirtual += MEM_PGSIZE;
+   }
+   
+   if(!count) return err;
+   source->mem_generation++;
+   
+   /* flush stale mappings for the moved pages out of the tlbs */
+   if(cpu_table[CPU_ID].current) current_proc = cpu_table[CPU_ID].current->proc;
+   if(current_proc == target || current_proc == source)
+      x86_load_cr3(KERNEL_LOG2PHYS(current_proc->pgdir));
+   mp_interrupt_process(target, INT_IPI_FLUSHTLB);
+   mp_interrupt_process(source, INT_IPI_FLUSHTLB);
+   
+   *(moved) += count;
+   return err;
+}
+
 /* pg_add_4M_mapping
  Add or edit an existing 4M mapping to a page directory
  => pgdir = pointer to page directory to add the 4K mapping to
@@ -30,6 +30,7 @@ extern void isr142(); extern void isr143();
 volatile unsigned char lapic_preflight_timer_pass = 0;
 volatile unsigned int lapic_preflight_timer_lap[APIC_TIMER_PASSES];
 volatile unsigned int lapic_preflight_timer_init = 0;
+volatile unsigned long long lapic_preflight_cycles[2]; /* cycle counter at the first and last passes */
 
 /* default handler for local APIC's IRQs - just EOI the interrupt */
 kresult lapic_irq_default(unsigned char intnum, int_registers_block *regs)
@@ -46,6 +47,12 @@ kresult lapic_preflight_timer(unsigned char intnum, int_registers_block *regs)
    LAPIC_DEBUG("[lapic:%i] lapic preflight timer interrupt: count %i\n",
                CPU_ID, lapic_preflight_timer_pass);
 
+   /* time the passes with the cpu's cycle counter too, to calibrate it as a clock */
+   if(lapic_preflight_timer_pass == 0)
+      lapic_preflight_cycles[0] = x86_read_cyclecount();
+   else if(lapic_preflight_timer_pass == APIC_TIMER_PASSES - 1)
+      lapic_preflight_cycles[1] = x86_read_cyclecount();
+   
    /* sample the lAPIC's current timer value and store it while the index variable 
       is valid for the array */
    if(lapic_preflight_timer_pass < APIC_TIMER_PASSES)
@@ -165,6 +172,114 @@ void lapic_ipi_send_startup(unsigned char destination, unsigned char vector)
    lapic_write(LAPIC_ICR_LO, vector | LAPIC_TYPE_START | LAPIC_ASSERT);
 }
 
+/* lapic_timer_load_oneshot
+   Set this cpu's timer to fire once after the given number of counts,
+   accounting for the part of the current period that has already passed.
+   => cpu = this cpu's structure
+      counts = number of lAPIC timer counts to wait
+*/
+void lapic_timer_load_oneshot(mp_core *cpu, unsigned int counts)
+{
+   /* count the time already spent in the current period, be it a tick
+      or an earlier one-shot that's being replaced */
+   if(cpu->timer_oneshot)
+      cpu->timer_residue += cpu->timer_oneshot - lapic_read(LAPIC_TIMERNOW);
+   else
+      cpu->timer_residue += lapic_preflight_timer_init - lapic_read(LAPIC_TIMERNOW);
+   cpu->timer_oneshot = counts;
+   
+   /* clearing the periodic bit leaves the timer in one-shot mode */
+   lapic_write(LAPIC_LVT_TIMER, IRQ_APIC_TIMER);
+   lapic_write(LAPIC_TIMERINIT, counts);
+}
+
+/* lapic_timer_oneshot
+   Stop this cpu's periodic scheduler tick and instead fire the timer once
+   after the given number of ticks. Used to idle a cpu without waking it
+   up every tick. Call lapic_timer_periodic() when the cpu is next woken.
+   => ticks = number of scheduler ticks to wait, clamped to what the timer can count
+   <= success, or e_failure if the lAPIC timer isn't calibrated for use
+*/
+kresult lapic_timer_oneshot(unsigned int ticks)
+{
+   mp_core *cpu;
+   unsigned int max_ticks;
+   
+   if(!lapic_preflight_timer_init || !cpu_table || !ticks) return e_failure;
+   
+   cpu = &cpu_table[CPU_ID];
+   max_ticks = 0xffffffff / lapic_preflight_timer_init;
+   if(ticks > max_ticks) ticks = max_ticks;
+
+   LAPIC_DEBUG("[lapic:%i] timer going one-shot for %i ticks (%x)\n",
+               CPU_ID, ticks, ticks * lapic_preflight_timer_init);
+
+   lapic_timer_load_oneshot(cpu, ticks * lapic_preflight_timer_init);
+   
+   return success;
+}
+
+/* lapic_timer_oneshot_usec
+   Pause this cpu's periodic scheduler tick and fire the timer once after the
+   given number of microseconds, provided that's sooner than the timer would
+   otherwise fire. Used to meet timer deadlines that fall between ticks. Call
+   lapic_timer_periodic() when the timer fires.
+   => usec = number of microseconds to wait
+   <= success, e_too_big if the timer is already due to fire first, or
+      e_failure if the lAPIC timer isn't calibrated for use
+*/
+kresult lapic_timer_oneshot_usec(unsigned int usec)
+{
+   mp_core *cpu;
+   unsigned int counts;
+   
+   if(!lapic_preflight_timer_init || !cpu_table) return e_failure;
+   
+   cpu = &cpu_table[CPU_ID];
+   if(usec >= DIOSIX_USEC_PER_TICK) return e_too_big;
+   
+   /* a tick's worth of timer counts is lapic_preflight_timer_init, so scale
+      the usec into counts in two parts to avoid overflowing */
+   counts = ((lapic_preflight_timer_init / DIOSIX_USEC_PER_TICK) * usec) +
+            (((lapic_preflight_timer_init % DIOSIX_USEC_PER_TICK) * usec) / DIOSIX_USEC_PER_TICK);
+   if(!counts) counts = 1;
+   
+   if(counts >= lapic_read(LAPIC_TIMERNOW)) return e_too_big;
+   
+   LAPIC_DEBUG("[lapic:%i] timer going one-shot for %i usec (%x)\n", CPU_ID, usec, counts);
+   
+   lapic_timer_load_oneshot(cpu, counts);
+   
+   return success;
+}
+
+/* lapic_timer_periodic
+   Return this cpu's timer to its periodic scheduler tick after a one-shot
+   period, and work out how much time passed while the tick was stopped
+   using the calibrated count of the lAPIC timer. Counts left over from
+   partial ticks are carried into the next measurement so time isn't lost.
+   <= number of whole scheduler ticks that elapsed during the one-shot period
+*/
+unsigned int lapic_timer_periodic(void)
+{
+   mp_core *cpu = &cpu_table[CPU_ID];
+   unsigned int elapsed, ticks;
+   
+   /* the timer counts down to zero and stops in one-shot mode */
+   elapsed = cpu->timer_oneshot - lapic_read(LAPIC_TIMERNOW) + cpu->timer_residue;
+   ticks = elapsed / lapic_preflight_timer_init;
+   cpu->timer_residue = elapsed % lapic_preflight_timer_init;
+   cpu->timer_oneshot = 0;
+   
+   lapic_write(LAPIC_LVT_TIMER, IRQ_APIC_TIMER | LAPIC_TIMER_TP);
+   lapic_write(LAPIC_TIMERINIT, lapic_preflight_timer_init);
+   
+   LAPIC_DEBUG("[lapic:%i] timer back to periodic after %i ticks (residue %x)\n",
+               CPU_ID, ticks, cpu->timer_residue);
+
+   return ticks;
+}
+
 /* lapic_initialise
    Set up a cpu's local APIC on a multiprocessor system
    => flags = flag up who's calling this function
@@ -249,6 +364,10 @@ void lapic_initialise(unsigned char flags)
 
       lapic_preflight_timer_init = 0xffffffff - lapic_preflight_timer_init;
       
+      /* the cycle counter was sampled across all but the first pass */
+      x86_calibrate_usec((unsigned int)(lapic_preflight_cycles[1] - lapic_preflight_cycles[0]),
+                         (APIC_TIMER_PASSES - 1) * DIOSIX_USEC_PER_TICK);
+      
       /* register the LAPIC timer driver */
       irq_register_driver(IRQ_APIC_TIMER, IRQ_DRIVER_FUNCTION | IRQ_DRIVER_LAST, 0, &int_common_timer);
    }
@@ -605,6 +605,7 @@ int_enter_knl:
    mov es, ax               ;         = 2 * 8 = 16 = 0x10
    mov fs, ax               ;
    mov gs, ax               ;   so set up the correct segment
+   cld                      ; user code can leave the direction flag set
 
    call exception_handler   ; bounce into the kernel, all regs preserved on exit
 
@@ -630,6 +631,7 @@ irq_enter_knl:
    mov es, ax               ;         = 2 * 8 = 16 = 0x10
    mov fs, ax               ;
    mov gs, ax               ;   so set up the correct segment
+   cld                      ; user code can leave the direction flag set
    
    call irq_handler         ; bounce into the kernel, all regs preserved on exit
 
@@ -18,6 +18,7 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
 */
 
 #include <portdefs.h>
+#include <memops.h>
 
 // --------------------- atomic locking support ---------------------------
 
@@ -307,6 +308,60 @@ unsigned long long x86_read_cyclecount(void)
    return ((unsigned long long)low) | (((unsigned long long)high) << 32);
 }
 
+/* conversion from the cycle counter to real time: 2^32 / cycles per usec,
+   or zero if the cycle counter hasn't been calibrated yet */
+unsigned int x86_usec_scale = 0;
+unsigned long long x86_usec_base = 0;
+
+/* x86_calibrate_usec
+   Work out how fast the cycle counter runs against a known period of time
+   so that it can be used as a high-resolution clock. The counter is assumed
+   to run at a constant rate and in step across all cpus.
+   => cycles = number of cycles that elapsed during the period
+      usec = length of the period in microseconds
+*/
+void x86_calibrate_usec(unsigned int cycles, unsigned int usec)
+{
+   unsigned int per_usec;
+   
+   if(!usec) return;
+   per_usec = cycles / usec;
+   if(per_usec < 2) return; /* too slow to be any use */
+   
+   x86_usec_scale = 0xffffffff / per_usec;
+   
+   /* start the clock from zero */
+   x86_usec_base = 0;
+   x86_usec_base = x86_read_usec();
+}
+
+/* x86_cycles_to_usec
+   => cycles = number of cpu cycles
+   <= how many microseconds that number of cycles takes, or 0 if the cycle
+      counter hasn't been calibrated
+*/
+unsigned long long x86_cycles_to_usec(unsigned long long cycles)
+{
+   unsigned int low = (unsigned int)cycles;
+   unsigned int high = (unsigned int)(cycles >> 32);
+   
+   /* multiply by the scale and drop the bottom 32 bits of the product,
+      avoiding a 64-bit divide we don't have the runtime support for */
+   return ((unsigned long long)high * x86_usec_scale) +
+          (((unsigned long long)low * x86_usec_scale) >> 32);
+}
+
+/* x86_read_usec
+   <= microseconds since the cycle counter was calibrated, or the scheduler's
+      rough msec counter in usec if it hasn't been calibrated
+*/
+unsigned long long x86_read_usec(void)
+{
+   if(!x86_usec_scale) return (unsigned long long)sched_msec_counter * 1000;
+   
+   return x86_cycles_to_usec(x86_read_cyclecount()) - x86_usec_base;
+}
+
 // ------------------------- CMOS memory support ---------------------------
 /* x86_cmos_write
    Update a byte in the BIOS NVRAM
@@ -412,6 +467,114 @@ unsigned int x86_read_cr0(void)
    return ret_val;
 }
 
+/* set to 1 if the SSE copy and fill loops are worth using on this system, 0 if not,
+   or -1 if we haven't checked yet */
+signed char x86_sse_copy_worthwhile = -1;
+
+/* x86_sse_claim
+   Borrow the SSE registers for the kernel if it's safe to do so: SSE must be
+   present and enabled on this cpu, and the FPU must not be holding a thread's
+   live state. TS is only set once a thread's FP state has been saved, so the
+   registers can be used freely and the next thread to use FP will fault and
+   have its state loaded over them. The caller must hand back the registers
+   with x86_load_cr0() and the value stored in cr0
+   => cr0 = pointer to variable to store the CR0 value to restore
+   <= 1 if the SSE registers have been claimed, or 0 if not
+*/
+unsigned char x86_sse_claim(unsigned int *cr0)
+{
+   unsigned int cr4;
+   
+   if(KernelFPPresent != X86_FPU_PRESENT || (fpu_type)KernelSIMDPresent < fpu_type_sse)
+      return 0;
+   
+   /* cpus with enhanced rep movsb/stosb beat the SSE loops with plain string
+      instructions (see scripts/memops-bench.c), so leave SSE alone on them */
+   if(x86_sse_copy_worthwhile < 0)
+   {
+      unsigned int eax, ebx, ecx, edx;
+      
+      x86_cpuid(0, eax, ebx, ecx, edx);
+      if(eax >= X86_CPUID_EXTFEATURES)
+      {
+         __asm__ __volatile__("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                              : "a" (X86_CPUID_EXTFEATURES), "c" (0));
+         x86_sse_copy_worthwhile = (ebx & (1 << X86_CPUID_EBX_ERMS)) ? 0 : 1;
+      }
+      else
+         x86_sse_copy_worthwhile = 1;
+   }
+   if(!x86_sse_copy_worthwhile) return 0;
+   
+   *cr0 = x86_read_cr0();
+   if((*cr0 & (X86_CR0_TS | X86_CR0_EM)) != X86_CR0_TS) return 0;
+   
+   /* boot code only enables SSE on the boot cpu */
+   __asm__ __volatile__("movl %%cr4, %0" : "=r" (cr4));
+   if(!(cr4 & X86_CR4_OSFXSR)) return 0;
+   
+   __asm__ __volatile__("clts");
+   return 1;
+}
+
+/* x86_memcpy (aka lowlevel_memcpy)
+   Copy bytes forwards using rep movsd, or the SSE registers for large
+   16-byte aligned copies if they're free
+   => target = destination address
+      source = source address
+      count = number of bytes to copy
+*/
+void x86_memcpy(void *target, void *source, unsigned int count)
+{
+   unsigned int cr0;
+   
+   if(count >= X86_SSE_COPY_MIN && !(((unsigned int)target | (unsigned int)source) & X86_SSE_ALIGN_MASK) &&
+      x86_sse_claim(&cr0))
+   {
+      unsigned int bulk = count & ~(X86_SSE_BLOCK_SIZE - 1);
+      
+      x86_copy_sse(target, source, bulk / X86_SSE_BLOCK_SIZE);
+      x86_load_cr0(cr0);
+      
+      target = (void *)((unsigned int)target + bulk);
+      source = (void *)((unsigned int)source + bulk);
+      count -= bulk;
+   }
+   
+   x86_copy_rep(target, source, count);
+}
+
+/* x86_memset (aka lowlevel_memset)
+   Fill bytes using rep stosd, or the SSE registers for large fills if
+   they're free
+   => addr = destination address
+      value = byte to fill with
+      count = number of bytes to fill
+*/
+void x86_memset(void *addr, unsigned char value, unsigned int count)
+{
+   unsigned int cr0;
+   
+   if(count >= X86_SSE_COPY_MIN && x86_sse_claim(&cr0))
+   {
+      unsigned int head = (0 - (unsigned int)addr) & X86_SSE_ALIGN_MASK, bulk;
+      
+      /* bring the address up to a 16-byte boundary first */
+      x86_fill_rep(addr, value, head);
+      addr = (void *)((unsigned int)addr + head);
+      count -= head;
+      
+      bulk = count & ~(X86_SSE_BLOCK_SIZE - 1);
+      x86_fill_sse(addr, value, bulk / X86_SSE_BLOCK_SIZE);
+      x86_load_cr0(cr0);
+      
+      addr = (void *)((unsigned int)addr + bulk);
+      count -= bulk;
+   }
+   
+   x86_fill_rep(addr, value, count);
+}
+
 /* x86_proc_preinit
    Perform any port-specific pre-initialisation before we start the operating system.
    Assuming microkernel virtual memory model is now active */
@@ -614,6 +777,7 @@ void x86_warm_kickstart(void)
    /* this seems to be the only sensible place to set these state variables */
    next->state = running;
    cpu_table[CPU_ID].current = next;
+   cpu_table[CPU_ID].current_priority = sched_determine_priority(next);
    
 #ifdef LOLVL_DEBUG
    if((regs->useresp <= regs->ebp) && (regs->ebp < KERNEL_SPACE_BASE))
@@ -684,6 +848,7 @@ void x86_kickstart(thread *torun)
    torun->state = running;
    torun->timeslice = SCHED_TIMESLICE;
    cpu_table[CPU_ID].current = torun;
+   cpu_table[CPU_ID].current_priority = sched_determine_priority(torun);
    torun->flags |= THREAD_FLAG_INUSERMODE; /* well, we're about to be.. */
    
    /* prepare FP support if needed */
@@ -203,7 +203,10 @@ typedef struct
 }  __attribute__((packed)) gdtptr_descr;
 
 
-/* describe an mp core */
+/* describe an mp core - each one is aligned to its own cache lines so that
+   per-cpu scheduler counters aren't falsely shared between processors */
+#define MP_CACHE_LINE_SIZE   (64)
+
 typedef struct
 {
    chip_state state;
@@ -212,15 +215,37 @@ typedef struct
    
    /* prioritised run queues */
    mp_thread_queue queues[SCHED_PRIORITY_LEVELS];
+   unsigned int queue_bitmap[SCHED_BITMAP_WORDS]; /* bit n set if queues[n] is non-empty */
    unsigned int lowest_queue_filled; /* index into queues of the lowest priority
                                        queue with threads in it */
-   unsigned int queued; /* how much workload this processor has */
+   volatile unsigned int queued; /* how much workload this processor has - written under
+                                    the cpu's lock but read without it when balancing */
+   unsigned int migrations; /* threads moved onto this cpu from another */
+   
+   sched_timer_wheel timers; /* threads snoozing on this cpu's scheduler clock */
+   volatile unsigned char tickless; /* non-zero while idling with the periodic tick stopped */
+   volatile unsigned char hrtimer;  /* non-zero while the periodic tick is paused for a high-resolution timer */
+   unsigned long long hrtimer_due;  /* when that high-resolution timer goes off, in usec */
+   thread *handoff;  /* thread handed this cpu by synchronous IPC, to run at the next pick, or NULL */
+   unsigned char current_priority; /* run queue priority of the current thread, to spot wakeups that should preempt it */
+   volatile unsigned char resched_pending; /* non-zero from sending this cpu a reschedule IPI until it next checks its queues */
+   
+   kcache_magazine magazines[KCACHE_TYPES]; /* free objects for the kernel's slab caches */
+   phys_pg_cache page_cache; /* free physical page frames for this cpu */
+   
+   /* cpu time accounting: what the cpu has been doing since acct_stamp */
+   unsigned long long acct_stamp; /* cycle count when the current thread was last charged */
+   unsigned char acct_type;       /* THREAD_CYCLES_* bucket the cycles since then belong in */
+   
+   /* lAPIC timer counts loaded for the current one-shot period, and
+      counts that have elapsed but not yet been accounted for as ticks */
+   unsigned int timer_oneshot, timer_residue;
    
    /* pointers to this CPU's gdt table and into its TSS selector */
    gdtptr_descr gdtptr;
    gdt_entry *tssentry;
    
-} mp_core;
+} __attribute__((aligned(MP_CACHE_LINE_SIZE))) mp_core;
 
 /* multiprocessing support */
 #define MP_AP_START_STACK_SIZE   (1024)
@@ -234,5 +259,6 @@ kresult mp_post_initialise(void);
 void mp_catch_ap(void);
 void mp_interrupt_process(process *proc, unsigned char interrupt);
 void mp_interrupt_thread(thread *target, unsigned char interrupt);
+void mp_interrupt_cpu(unsigned char cpu, unsigned char interrupt);
 
 #endif
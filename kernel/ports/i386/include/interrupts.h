@@ -139,6 +139,9 @@ void lapic_ipi_send(unsigned char destination, unsigned char vector);
 void lapic_ipi_broadcast(unsigned char vector);
 void lapic_ipi_send_startup(unsigned char destination, unsigned char vector);
 void lapic_ipi_send_init(unsigned char destination);
+kresult lapic_timer_oneshot(unsigned int ticks);
+kresult lapic_timer_oneshot_usec(unsigned int usec);
+unsigned int lapic_timer_periodic(void);
 unsigned int ioapic_read(unsigned char id, unsigned char reg);
 void ioapic_write(unsigned char id, unsigned char reg, unsigned int value);
 kresult ioapic_register_chip(unsigned int id, unsigned int physaddr);
@@ -67,8 +67,10 @@ void serial_initialise(void);
 #define X86_IOPORT_MAXWORDS   (2048) /* number of 32bit words in (2^16)-bit IO port access bitmap */
 #define X86_IOPORT_BITMAPSIZE (X86_IOPORT_MAXWORDS * sizeof(unsigned int))
 
-/* CR0 flags */
+/* CR0 and CR4 flags */
+#define X86_CR0_EM            (1 << 2)
 #define X86_CR0_TS            (1 << 3)
+#define X86_CR4_OSFXSR        (1 << 9)
 
 /* probe the CPU for features, return data in eax,ebx,ecx,edx for given function */
 #define x86_cpuid(func,ax,bx,cx,dx) \
@@ -77,6 +79,8 @@ void serial_initialise(void);
 /* CPUID functions */
 #define X86_CPUID_FEATURES    (1)
 #define X86_CPUID_EDX_LAPIC   (9)
+#define X86_CPUID_EXTFEATURES (7)
+#define X86_CPUID_EBX_ERMS    (9) /* enhanced rep movsb/stosb */
 
 unsigned x86_inportb(unsigned short port);
 void x86_outportb(unsigned port, unsigned val);
@@ -99,12 +103,36 @@ void x86_disable_interrupts(void);
 #define lowlevel_disable_interrupts x86_disable_interrupts
 #define lowlevel_enable_interrupts x86_enable_interrupts
 #define lowlevel_cpu_sleep x86_cpu_sleep
+#define lowlevel_timer_oneshot lapic_timer_oneshot
+#define lowlevel_timer_periodic lapic_timer_periodic
+#define lowlevel_timer_oneshot_usec lapic_timer_oneshot_usec
 void x86_cpu_sleep(int_registers_block *regs);
 void x86_change_tss(gdtptr_descr *cpugdt, gdt_entry *gdt, tss_descr *tss, unsigned char flags);
 kresult x86_init_tss(thread *toinit);
 void x86_start_ap(void);
 void x86_start_ap_end(void);
 unsigned long long x86_read_cyclecount(void);
+#define lowlevel_read_cyclecount x86_read_cyclecount
+void x86_calibrate_usec(unsigned int cycles, unsigned int usec);
+unsigned long long x86_read_usec(void);
+#define lowlevel_read_usec x86_read_usec
+extern unsigned int x86_usec_scale;
+#define lowlevel_usec_calibrated() (x86_usec_scale != 0)
+unsigned long long x86_cycles_to_usec(unsigned long long cycles);
+#define lowlevel_cycles_to_usec x86_cycles_to_usec
+
+/* return the bit number of the least significant set bit in a non-zero word */
+static __inline__ unsigned int x86_find_first_set(unsigned int word)
+{
+   unsigned int bit;
+   __asm__ __volatile__("bsfl %1, %0" : "=r" (bit) : "rm" (word));
+   return bit;
+}
+#define lowlevel_find_first_set x86_find_first_set
+void x86_memcpy(void *target, void *source, unsigned int count);
+void x86_memset(void *addr, unsigned char value, unsigned int count);
+#define lowlevel_memcpy x86_memcpy
+#define lowlevel_memset x86_memset
 void lowlevel_thread_switch(thread *now, thread *next, int_registers_block *regs);
 void lowlevel_proc_preinit(void);
 void lowlevel_stacktrace(void);
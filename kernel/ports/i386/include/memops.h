@@ -0,0 +1,134 @@
+/* kernel/ports/i386/include/memops.h
+ * bulk memory copy and fill primitives for the i386 port
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.18:00:00
+
+Copyright (c) Chris Williams and individual contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+#ifndef _MEMOPS_H
+#define   _MEMOPS_H
+
+/* these primitives don't depend on the rest of the kernel so that
+   scripts/memops-bench.c can build them for the host. they copy forwards,
+   clearing the direction flag themselves rather than trusting whoever ran
+   last, and leave any policy, such as when the SSE registers can be borrowed,
+   to the caller */
+
+#define X86_SSE_COPY_MIN      (1024) /* smallest copy or fill worth borrowing the SSE registers for */
+#define X86_SSE_BLOCK_SIZE    (64)   /* bytes moved per SSE loop iteration */
+#define X86_SSE_ALIGN_MASK    (15)   /* SSE aligned loads and stores need 16-byte alignment */
+
+/* the kernel is built for plain i386 so the compiler won't touch the SSE
+   registers and can't be told they're clobbered. the host benchmark can */
+#ifdef __SSE__
+#define X86_SSE_CLOBBERS      , "xmm0", "xmm1", "xmm2", "xmm3"
+#else
+#define X86_SSE_CLOBBERS
+#endif
+
+/* x86_copy_rep
+   Copy bytes a dword at a time with rep movsd, then any remaining bytes
+   => target = destination address
+      source = source address
+      count = number of bytes to copy
+*/
+static inline void x86_copy_rep(void *target, const void *source, unsigned int count)
+{
+   unsigned int dwords = count >> 2;
+   
+   __asm__ __volatile__("cld\n\t"
+                        "rep movsl\n\t"
+                        "movl %3, %%ecx\n\t"
+                        "rep movsb"
+                        : "+D" (target), "+S" (source), "+c" (dwords)
+                        : "r" (count & 3)
+                        : "memory", "cc");
+}
+
+/* x86_fill_rep
+   Fill bytes a dword at a time with rep stosd, then any remaining bytes
+   => target = destination address
+      value = byte to fill with
+      count = number of bytes to fill
+*/
+static inline void x86_fill_rep(void *target, unsigned char value, unsigned int count)
+{
+   unsigned int dwords = count >> 2;
+   
+   __asm__ __volatile__("cld\n\t"
+                        "rep stosl\n\t"
+                        "movl %3, %%ecx\n\t"
+                        "rep stosb"
+                        : "+D" (target), "+c" (dwords)
+                        : "a" (value * 0x01010101), "r" (count & 3)
+                        : "memory", "cc");
+}
+
+/* x86_copy_sse
+   Copy whole blocks of X86_SSE_BLOCK_SIZE bytes through the SSE registers.
+   The caller must make sure SSE is usable and its registers hold nothing
+   of value
+   => target = 16-byte aligned destination address
+      source = 16-byte aligned source address
+      blocks = number of blocks to copy, must be non-zero
+*/
+static inline void x86_copy_sse(void *target, const void *source, unsigned int blocks)
+{
+   __asm__ __volatile__("1:\n\t"
+                        "movaps   (%1), %%xmm0\n\t"
+                        "movaps 16(%1), %%xmm1\n\t"
+                        "movaps 32(%1), %%xmm2\n\t"
+                        "movaps 48(%1), %%xmm3\n\t"
+                        "movaps %%xmm0,   (%0)\n\t"
+                        "movaps %%xmm1, 16(%0)\n\t"
+                        "movaps %%xmm2, 32(%0)\n\t"
+                        "movaps %%xmm3, 48(%0)\n\t"
+                        "add $64, %1\n\t"
+                        "add $64, %0\n\t"
+                        "decl %2\n\t"
+                        "jnz 1b"
+                        : "+r" (target), "+r" (source), "+r" (blocks)
+                        :
+                        : "memory", "cc" X86_SSE_CLOBBERS);
+}
+
+/* x86_fill_sse
+   Fill whole blocks of X86_SSE_BLOCK_SIZE bytes through the SSE registers.
+   The caller must make sure SSE is usable and its registers hold nothing
+   of value
+   => target = 16-byte aligned destination address
+      value = byte to fill with
+      blocks = number of blocks to fill, must be non-zero
+*/
+static inline void x86_fill_sse(void *target, unsigned char value, unsigned int blocks)
+{
+   unsigned int pattern = value * 0x01010101;
+   unsigned int line[4];
+   
+   line[0] = line[1] = line[2] = line[3] = pattern;
+   
+   __asm__ __volatile__("movups (%2), %%xmm0\n\t"
+                        "1:\n\t"
+                        "movaps %%xmm0,   (%0)\n\t"
+                        "movaps %%xmm0, 16(%0)\n\t"
+                        "movaps %%xmm0, 32(%0)\n\t"
+                        "movaps %%xmm0, 48(%0)\n\t"
+                        "add $64, %0\n\t"
+                        "decl %1\n\t"
+                        "jnz 1b"
+                        : "+r" (target), "+r" (blocks)
+                        : "r" (line)
+                        : "memory", "cc" X86_SSE_CLOBBERS);
+}
+
+#endif
@@ -117,5 +117,7 @@ void pg_postmortem(int_registers_block *regs);
 kresult pg_user2phys(unsigned int *paddr, unsigned int **pgdir, unsigned int vaddr);
 kresult pg_user2kernel(unsigned int *kaddr, unsigned int uaddr, process *proc);
 kresult pg_remove_4K_mapping(unsigned int **pgdir, unsigned int virtual, unsigned int release_flag);
+kresult pg_move_4K_pages(process *target, unsigned int tvirtual, process *source,
+                         unsigned int svirtual, unsigned int pages, unsigned int *moved);
 
 #endif
@@ -26,7 +26,6 @@ void syscall_do_msg_send(int_registers_block *regs)
 {
    thread *current = cpu_table[CPU_ID].current;
    diosix_msg_info *msg = (diosix_msg_info *)regs->eax;
-   unsigned int send_result;
    
    SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_SEND(%x) called by process %i (%p) (thread %i)\n",
            CPU_ID, regs->eax, cpu_table[CPU_ID].current->proc->pid, cpu_table[CPU_ID].current->proc,
@@ -36,6 +35,20 @@ void syscall_do_msg_send(int_registers_block *regs)
    if(!msg || ((unsigned int)msg + MEM_CLIP(msg, sizeof(diosix_msg_info)) >= KERNEL_SPACE_BASE))
       SYSCALL_RETURN(e_bad_address);
    
+   SYSCALL_RETURN(syscall_msg_send(current, msg));
+}
+
+/* syscall_msg_send
+   Send a message on behalf of a thread, as syscall:msg_send does. If the thread
+   is blocked waiting for a reply or a message then its eax is updated when it wakes
+   => current = thread sending the message
+      msg = pointer to the message description block, already checked to be in userspace
+   <= 0 for success or a diosix-specific error code
+*/
+kresult syscall_msg_send(thread *current, diosix_msg_info *msg)
+{
+   kresult send_result;
+   
    /* determine the type of message being sent - this code is mostly portable... */
    if(msg->flags & DIOSIX_MSG_SIGNAL)
    {
@@ -45,13 +58,13 @@ void syscall_do_msg_send(int_registers_block *regs)
       
       /* send a signal to the caller's process group */
       if(msg->flags & DIOSIX_MSG_INMYPROCGRP)
-         SYSCALL_RETURN(proc_send_group_signal(current->proc->proc_group_id, current,
-                                               msg->signal.number, msg->signal.extra));
+         return proc_send_group_signal(current->proc->proc_group_id, current,
+                                       msg->signal.number, msg->signal.extra);
       
       /* send a signal to an arbitrary process group - pgid zero means use the caller's */
       if(msg->flags & DIOSIX_MSG_INAPROCGRP)
-         SYSCALL_RETURN(proc_send_group_signal(msg->pid, current,
-                                               msg->signal.number, msg->signal.extra));
+         return proc_send_group_signal(msg->pid, current,
+                                       msg->signal.number, msg->signal.extra);
       
       /* default to sending a single signal - check to see if we're sending to a
          specifically named process (by role) or otherwise use the suggested pid */
@@ -59,7 +72,7 @@ void syscall_do_msg_send(int_registers_block *regs)
          target = proc_role_lookup(msg->role);
       else
          target = proc_find_proc(msg->pid);
-      if(!target) SYSCALL_RETURN(e_not_found);
+      if(!target) return e_not_found;
       
       /* send the signal */
       send_result = msg_send_signal(target, current, msg->signal.number, msg->signal.extra);
@@ -68,17 +81,17 @@ void syscall_do_msg_send(int_registers_block *regs)
       if(!send_result)
          msg->pid = target->pid;
       
-      SYSCALL_RETURN(send_result);
+      return send_result;
    }
    
    /* bail out if it's not a generic sync message */
-   if(!(msg->flags & DIOSIX_MSG_GENERIC)) SYSCALL_RETURN(e_bad_params);
+   if(!(msg->flags & DIOSIX_MSG_GENERIC)) return e_bad_params;
 
    /* do the actual sending */
    send_result = msg_send(current, msg);
    
-   SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_SEND(%x) msg_send() returned code %i\n",
-                 CPU_ID, regs->eax, send_result);
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_SEND(%p) msg_send() returned code %i\n",
+                 CPU_ID, msg, send_result);
    
    switch(send_result)
    {
@@ -96,18 +109,18 @@ void syscall_do_msg_send(int_registers_block *regs)
             msg->send_size = 0;
             msg->send = NULL;
             
-            syscall_do_msg_recv(regs); /* will update eax when it returns */      
+            return msg_recv(current, msg);
          }
-         else
-            SYSCALL_RETURN(success); /* let the sender know what happened */
+         
+         return success; /* let the sender know what happened */
          
       /* can't write into the receiver's buffer */
       case e_bad_target_address:
-         SYSCALL_RETURN(e_no_receiver);
+         return e_no_receiver;
          
       default:
          /* fall through to returning msg_send()'s error code */
-         SYSCALL_RETURN(send_result);
+         return send_result;
    }
 }
 
@@ -175,3 +188,158 @@ void syscall_post_msg_recv(thread *receiver, kresult result)
    else
       receiver->regs.eax = result;
 }
+
+/* syscall:msg_fast - pass a short message entirely in registers
+   => eax = DIOSIX_MSG_FAST_TAG() of the thread to send to (ignored for DIOSIX_MSG_FAST_RECV)
+      ebx = DIOSIX_MSG_FAST_* operation, DIOSIX_MSG_FAST_WORDS() count and flags
+      ecx, esi, edi, ebp = message words
+   <= eax = 0 for success or a diosix-specific error code
+      when a message arrives:
+      edx = DIOSIX_MSG_FAST_TAG() of the sender
+      ebx = DIOSIX_MSG_FAST_CALL or DIOSIX_MSG_FAST_REPLY and the word count
+      ecx, esi, edi, ebp = message words
+*/
+void syscall_do_msg_fast(int_registers_block *regs)
+{
+   thread *current = cpu_table[CPU_ID].current;
+   diosix_msg_fast_info msg;
+   unsigned int op = regs->ebx & DIOSIX_MSG_FAST_OPMASK;
+   kresult err;
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_FAST(%x, %x) called by process %i (thread %i)\n",
+                 CPU_ID, regs->eax, regs->ebx, current->proc->pid, current->tid);
+   
+   /* hand the tag back unchanged if the call returns without a message */
+   regs->edx = regs->eax;
+   
+   msg.tag = regs->eax;
+   msg.control = regs->ebx;
+   msg.words[0] = regs->ecx;
+   msg.words[1] = regs->esi;
+   msg.words[2] = regs->edi;
+   msg.words[3] = regs->ebp;
+   
+   /* a blocked caller or replier's eax is overwritten when its answer arrives */
+   if(op == DIOSIX_MSG_FAST_RECV)
+      err = msg_recv_fast(current, &msg);
+   else
+      err = msg_send_fast(current, &msg);
+   
+   /* a receiver that picked up a queued call rather than blocking gets it now */
+   if(err == success && (op == DIOSIX_MSG_FAST_RECV || op == DIOSIX_MSG_FAST_REPLY_RECV) &&
+      (msg.control & DIOSIX_MSG_FAST_OPMASK) == DIOSIX_MSG_FAST_CALL)
+   {
+      regs->edx = msg.tag;
+      regs->ebx = msg.control;
+      regs->ecx = msg.words[0];
+      regs->esi = msg.words[1];
+      regs->edi = msg.words[2];
+      regs->ebp = msg.words[3];
+   }
+   
+   SYSCALL_RETURN(err);
+}
+
+/* syscall_post_msg_fast
+   Load a fast message into the saved registers of a thread blocked on the fast path
+   => receiver = thread to receive the message
+      result = return code from the receiver's syscall
+      tag = DIOSIX_MSG_FAST_TAG() of the sender
+      control = DIOSIX_MSG_FAST_* operation and word count
+      words = the message's words
+*/
+void syscall_post_msg_fast(thread *receiver, kresult result, unsigned int tag,
+                           unsigned int control, unsigned int *words)
+{
+   receiver->regs.eax = result;
+   receiver->regs.edx = tag;
+   receiver->regs.ebx = control;
+   receiver->regs.ecx = words[0];
+   receiver->regs.esi = words[1];
+   receiver->regs.edi = words[2];
+   receiver->regs.ebp = words[3];
+}
+
+/* syscall:doorbell - wait on or ring a doorbell word in shared memory
+   => eax = DIOSIX_DOORBELL_WAIT: block until the doorbell is rung, unless it no longer holds ecx
+            DIOSIX_DOORBELL_RING: wake all threads waiting on the doorbell
+      ebx = address of the doorbell word
+      ecx = value the doorbell word is expected to hold (DIOSIX_DOORBELL_WAIT only)
+   <= eax = 0 for success or an error code
+*/
+void syscall_do_doorbell(int_registers_block *regs)
+{
+   thread *current = cpu_table[CPU_ID].current;
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_DOORBELL(%i, %x, %x) called by process %i (thread %i)\n",
+                 CPU_ID, regs->eax, regs->ebx, regs->ecx, current->proc->pid, current->tid);
+   
+   switch(regs->eax)
+   {
+      case DIOSIX_DOORBELL_WAIT:
+         SYSCALL_RETURN(msg_doorbell_wait(current, regs->ebx, regs->ecx));
+         
+      case DIOSIX_DOORBELL_RING:
+         SYSCALL_RETURN(msg_doorbell_ring(current, regs->ebx));
+   }
+   
+   SYSCALL_RETURN(e_bad_params);
+}
+
+/* syscall:msg_batch - send and receive a list of messages in one go
+   => eax = pointer to an array of diosix_msg_batch_entry blocks
+      ebx = number of entries in the array
+   <= eax = result of the last entry processed
+      ebx = number of entries processed
+   The entries are processed in order, each one's result written into it. Only the
+   last entry may be one that can block the caller, such as a send waiting for its
+   reply or a receive: any earlier entry that could block is refused with
+   e_would_block and skipped, as there's no way to carry on with the batch once the
+   thread is asleep. If the last entry blocks, its result is only known when the
+   thread wakes, so it is returned in eax and not written into the entry
+*/
+void syscall_do_msg_batch(int_registers_block *regs)
+{
+   thread *current = cpu_table[CPU_ID].current;
+   diosix_msg_batch_entry *entries = (diosix_msg_batch_entry *)regs->eax;
+   unsigned int count = regs->ebx, loop;
+   kresult result = success;
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_BATCH(%x, %i) called by process %i (thread %i)\n",
+                 CPU_ID, regs->eax, regs->ebx, current->proc->pid, current->tid);
+   
+   regs->ebx = 0; /* nothing processed yet */
+   
+   /* sanitise the input data while we're here */
+   if(count > DIOSIX_MSG_BATCH_MAX) SYSCALL_RETURN(e_bad_params);
+   if(!entries || ((unsigned int)entries + MEM_CLIP(entries, count * sizeof(diosix_msg_batch_entry)) >= KERNEL_SPACE_BASE))
+      SYSCALL_RETURN(e_bad_address);
+   
+   for(loop = 0; loop < count; loop++)
+   {
+      diosix_msg_info *msg = entries[loop].msg;
+      
+      if(!msg || ((unsigned int)msg + MEM_CLIP(msg, sizeof(diosix_msg_info)) >= KERNEL_SPACE_BASE))
+         result = e_bad_address;
+      else if(loop < count - 1 && msg_batch_can_block(entries[loop].op, msg))
+         result = e_would_block;
+      else if(entries[loop].op == DIOSIX_MSG_BATCH_SEND)
+         result = syscall_msg_send(current, msg);
+      else if(entries[loop].op == DIOSIX_MSG_BATCH_RECV)
+         result = msg_recv(current, msg);
+      else
+         result = e_bad_params;
+      
+      regs->ebx = loop + 1;
+      
+      /* only the last entry can get this far and block */
+      if(current->state != running) break;
+      
+      entries[loop].result = result;
+   }
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_MSG_BATCH processed %i of %i entries, last result %i\n",
+                 CPU_ID, regs->ebx, count, result);
+   
+   SYSCALL_RETURN(result);
+}
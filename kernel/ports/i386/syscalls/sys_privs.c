@@ -30,6 +30,9 @@ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
               => ebx = bitfield of POSIX-compatible signals that process will accept
             DIOSIX_KERNEL_SIGNALS:
               => ebx = bitfield of kernel-generated signals that process will accept
+            DIOSIX_SCHED_REALTIME: join or leave the real-time scheduling class (executive and drivers only)
+              => ebx = period in usec, or 0 to leave the class
+                 ecx = usec of cpu time to run at real-time priority per period
    <= eax = 0 for success or an error code
 */
 void syscall_do_privs(int_registers_block *regs)
@@ -60,6 +63,10 @@ void syscall_do_privs(int_registers_block *regs)
       case DIOSIX_KERNEL_SIGNALS:
          current->proc->kernel_signals_accepted = regs->ebx;
          SYSCALL_RETURN(success);
+         
+      case DIOSIX_SCHED_REALTIME:
+         if(current->proc->layer > LAYER_DRIVERS) SYSCALL_RETURN(e_no_rights);
+         SYSCALL_RETURN(sched_set_realtime(current, regs->ebx, regs->ecx));
    }
    
    /* fall through to returning an error code */
@@ -341,7 +348,7 @@ void syscall_do_set_id(int_registers_block *regs)
          if(!role)
          {
             lock_gate(&(current->lock), LOCK_WRITE);
-            SYSCALL_SET_ID_RETURN(current, proc_role_remove(current, role));
+            SYSCALL_SET_ID_RETURN(current, proc_role_remove(current, current->role));
          }
          
          /* otherwise, try to add it */
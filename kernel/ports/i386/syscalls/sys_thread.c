@@ -162,3 +162,29 @@ void syscall_do_thread_sleep(int_registers_block *regs)
    
    SYSCALL_RETURN(sched_add_snoozer(current, regs->eax, wake));
 }
+
+/* syscall: timer - set a high-resolution timer for the current thread. the tick-based
+   thread_sleep and alarm calls are wrappers around the same kernel timers.
+   => eax = DIOSIX_TIMER_SLEEP: block the current thread until the time has elapsed
+            DIOSIX_TIMER_ALARM: send a SIGALRM signal to the process once the time has elapsed
+      ebx = number of microseconds to wait, or 0 to cancel any outstanding timers
+   <= eax = 0 for success (after blocking), or an error code
+*/
+void syscall_do_timer(int_registers_block *regs)
+{
+   thread *current = cpu_table[CPU_ID].current;
+   
+   SYSCALL_DEBUG("[sys:%i] SYSCALL_TIMER(%i, %i) called by process %i (%p) (thread %i)\n",
+                 CPU_ID, regs->eax, regs->ebx, current->proc->pid, current->proc, current->tid);
+   
+   switch(regs->eax)
+   {
+      case DIOSIX_TIMER_SLEEP:
+         SYSCALL_RETURN(sched_add_timer(current, 0, regs->ebx, wake));
+         
+      case DIOSIX_TIMER_ALARM:
+         SYSCALL_RETURN(sched_add_timer(current, 0, regs->ebx, signal));
+   }
+   
+   SYSCALL_RETURN(e_bad_params);
+}
@@ -0,0 +1,294 @@
+/* scripts/memops-bench.c
+ * host microbenchmark for the kernel's bulk memory copy and fill primitives
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.18:00:00
+
+Copyright (c) Chris Williams and individual contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+/* syntax: memops-bench [<megabytes per test>]
+
+   builds on the host against a port's memops.h and compares the old byte
+   loops behind vmm_memcpy() and vmm_memset() with the port's primitives
+   across a range of sizes and source/target alignments. build it with the
+   kernel's lack of optimisation so the byte loops behave as they do in the
+   kernel, eg on an x86 host:
+
+   gcc -std=c99 -Wall -fno-builtin -Ikernel/ports/i386/include -o memops-bench scripts/memops-bench.c
+
+   or on an ARM host, with -Ikernel/ports/arm/include instead. results are in
+   MB/s; a dash means the primitive can't be used for that alignment */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <memops.h>
+
+#define BENCH_MAX_SIZE     (64 * 1024)
+#define BENCH_SLACK        (64)  /* room to misalign the buffers */
+#define BENCH_DEFAULT_MB   (64)  /* bytes to move per test, in MB */
+
+typedef void (*bench_copy_func)(void *target, void *source, unsigned int count);
+typedef void (*bench_fill_func)(void *target, unsigned char value, unsigned int count);
+
+/* the byte loops vmm_memcpy() and vmm_memset() used to be */
+void byte_copy(void *target, void *source, unsigned int count)
+{
+   unsigned char *ptr1 = (unsigned char *)target;
+   unsigned char *ptr2 = (unsigned char *)source;
+   unsigned int i;
+   
+   for(i = 0; i < count; i++)
+      ptr1[i] = ptr2[i];
+}
+
+void byte_fill(void *target, unsigned char value, unsigned int count)
+{
+   unsigned char *ptr = (unsigned char *)target;
+   unsigned int i;
+   
+   for(i = 0; i < count; i++)
+      ptr[i] = value;
+}
+
+/* the port's primitives, wrapped up the same way the kernel drives them */
+#if defined(__i386__) || defined(__x86_64__)
+
+void rep_copy(void *target, void *source, unsigned int count)
+{
+   x86_copy_rep(target, source, count);
+}
+
+void rep_fill(void *target, unsigned char value, unsigned int count)
+{
+   x86_fill_rep(target, value, count);
+}
+
+/* the kernel only takes the SSE path for aligned buffers, and a plain
+   rep movsd for anything left over */
+void sse_copy(void *target, void *source, unsigned int count)
+{
+   unsigned int bulk = count & ~(X86_SSE_BLOCK_SIZE - 1);
+   
+   if(bulk) x86_copy_sse(target, source, bulk / X86_SSE_BLOCK_SIZE);
+   x86_copy_rep((unsigned char *)target + bulk, (unsigned char *)source + bulk, count - bulk);
+}
+
+void sse_fill(void *target, unsigned char value, unsigned int count)
+{
+   unsigned int bulk = count & ~(X86_SSE_BLOCK_SIZE - 1);
+   
+   if(bulk) x86_fill_sse(target, value, bulk / X86_SSE_BLOCK_SIZE);
+   x86_fill_rep((unsigned char *)target + bulk, value, count - bulk);
+}
+
+#define BENCH_PORT_NAME    "rep"
+#define BENCH_PORT_COPY    rep_copy
+#define BENCH_PORT_FILL    rep_fill
+#define BENCH_PORT_ALIGN   (0)   /* rep movsd copes with any alignment */
+#define BENCH_FAST_NAME    "sse"
+#define BENCH_FAST_COPY    sse_copy
+#define BENCH_FAST_FILL    sse_fill
+#define BENCH_FAST_ALIGN   (X86_SSE_ALIGN_MASK)
+
+#elif defined(__arm__)
+
+void ldm_copy(void *target, void *source, unsigned int count)
+{
+   unsigned int bulk = count & ~(ARM_BURST_SIZE - 1);
+   
+   if(bulk) arm_copy_ldm(target, source, bulk / ARM_BURST_SIZE);
+   byte_copy((unsigned char *)target + bulk, (unsigned char *)source + bulk, count - bulk);
+}
+
+void stm_fill(void *target, unsigned char value, unsigned int count)
+{
+   unsigned int bulk = count & ~(ARM_BURST_SIZE - 1);
+   
+   if(bulk) arm_fill_stm(target, value, bulk / ARM_BURST_SIZE);
+   byte_fill((unsigned char *)target + bulk, value, count - bulk);
+}
+
+#define BENCH_PORT_NAME    "ldm/stm"
+#define BENCH_PORT_COPY    ldm_copy
+#define BENCH_PORT_FILL    stm_fill
+#define BENCH_PORT_ALIGN   (ARM_WORD_MASK)
+
+#else
+#error "memops-bench: no memops.h primitives for this host"
+#endif
+
+unsigned char *bench_source, *bench_target;
+
+/* bench_now
+   <= current time in nanoseconds */
+double bench_now(void)
+{
+   struct timespec now;
+   
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+/* bench_copy
+   Time a copy routine and check it produced the right result
+   => func = copy routine to time
+      size = bytes per copy
+      source_off, target_off = offsets from 64-byte aligned buffers
+      total = total bytes to copy
+   <= throughput in MB/s, or a negative number if the copy was wrong
+*/
+double bench_copy(bench_copy_func func, unsigned int size, unsigned int source_off,
+                  unsigned int target_off, unsigned long total)
+{
+   unsigned long loop, iterations = total / size;
+   unsigned int i;
+   double start, taken;
+   
+   for(i = 0; i < size; i++) bench_source[source_off + i] = (unsigned char)(i * 7 + 1);
+   memset(bench_target, 0, BENCH_MAX_SIZE + BENCH_SLACK);
+   
+   start = bench_now();
+   for(loop = 0; loop < iterations; loop++)
+      func(bench_target + target_off, bench_source + source_off, size);
+   taken = bench_now() - start;
+   
+   if(memcmp(bench_target + target_off, bench_source + source_off, size) ||
+      bench_target[target_off + size] != 0 || (target_off && bench_target[target_off - 1] != 0))
+      return -1;
+   
+   return ((double)iterations * size / (1024.0 * 1024.0)) / (taken / 1e9);
+}
+
+/* bench_fill
+   Time a fill routine and check it produced the right result
+   => func = fill routine to time
+      size = bytes per fill
+      target_off = offset from a 64-byte aligned buffer
+      total = total bytes to fill
+   <= throughput in MB/s, or a negative number if the fill was wrong
+*/
+double bench_fill(bench_fill_func func, unsigned int size, unsigned int target_off, unsigned long total)
+{
+   unsigned long loop, iterations = total / size;
+   unsigned int i;
+   double start, taken;
+   
+   memset(bench_target, 0, BENCH_MAX_SIZE + BENCH_SLACK);
+   
+   start = bench_now();
+   for(loop = 0; loop < iterations; loop++)
+      func(bench_target + target_off, 0xa5, size);
+   taken = bench_now() - start;
+   
+   for(i = 0; i < size; i++)
+      if(bench_target[target_off + i] != 0xa5) return -1;
+   if(bench_target[target_off + size] != 0 || (target_off && bench_target[target_off - 1] != 0))
+      return -1;
+   
+   return ((double)iterations * size / (1024.0 * 1024.0)) / (taken / 1e9);
+}
+
+/* bench_print
+   Print a result column, flagging broken results and unusable primitives */
+void bench_print(double result, unsigned char usable)
+{
+   if(!usable) printf(" %10s", "-");
+   else if(result < 0) printf(" %10s", "BROKEN");
+   else printf(" %10.0f", result);
+}
+
+int main(int argc, char *argv[])
+{
+   static const unsigned int sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+   static const unsigned int aligns[][2] = { {0, 0}, {0, 4}, {1, 3}, {16, 32} };
+   unsigned long total = BENCH_DEFAULT_MB;
+   unsigned int s, a;
+   unsigned char *source_block, *target_block;
+   int broken = 0;
+   
+   if(argc > 1) total = strtoul(argv[1], NULL, 0);
+   if(!total) total = BENCH_DEFAULT_MB;
+   total *= 1024 * 1024;
+   
+   source_block = malloc(BENCH_MAX_SIZE + (BENCH_SLACK * 2));
+   target_block = malloc(BENCH_MAX_SIZE + (BENCH_SLACK * 2));
+   if(!source_block || !target_block)
+   {
+      fprintf(stderr, "memops-bench: out of memory\n");
+      return 1;
+   }
+   bench_source = (unsigned char *)(((unsigned long)source_block + BENCH_SLACK - 1) & ~(unsigned long)(BENCH_SLACK - 1));
+   bench_target = (unsigned char *)(((unsigned long)target_block + BENCH_SLACK - 1) & ~(unsigned long)(BENCH_SLACK - 1));
+   
+   printf("%-6s %6s %6s %10s %10s", "test", "size", "align", "byte", BENCH_PORT_NAME);
+#ifdef BENCH_FAST_NAME
+   printf(" %10s", BENCH_FAST_NAME);
+#endif
+   printf("   (MB/s, %lu MB per test)\n", total / (1024 * 1024));
+   
+   for(a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++)
+      for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+      {
+         unsigned int source_off = aligns[a][0], target_off = aligns[a][1];
+         unsigned char port_ok, fast_ok;
+         double result;
+         
+         /* copies */
+         port_ok = !((source_off | target_off) & BENCH_PORT_ALIGN) ||
+                   !((source_off ^ target_off) & BENCH_PORT_ALIGN);
+         
+         printf("%-6s %6u %3u/%-2u", "copy", sizes[s], source_off, target_off);
+         result = bench_copy(byte_copy, sizes[s], source_off, target_off, total);
+         broken |= result < 0;
+         bench_print(result, 1);
+         
+         result = port_ok ? bench_copy(BENCH_PORT_COPY, sizes[s], source_off, target_off, total) : 0;
+         broken |= port_ok && result < 0;
+         bench_print(result, port_ok);
+#ifdef BENCH_FAST_NAME
+         fast_ok = !((source_off | target_off) & BENCH_FAST_ALIGN);
+         result = fast_ok ? bench_copy(BENCH_FAST_COPY, sizes[s], source_off, target_off, total) : 0;
+         broken |= fast_ok && result < 0;
+         bench_print(result, fast_ok);
+#endif
+         printf("\n");
+         
+         /* fills */
+         port_ok = !(target_off & BENCH_PORT_ALIGN);
+         
+         printf("%-6s %6u %6u", "fill", sizes[s], target_off);
+         result = bench_fill(byte_fill, sizes[s], target_off, total);
+         broken |= result < 0;
+         bench_print(result, 1);
+         
+         result = port_ok ? bench_fill(BENCH_PORT_FILL, sizes[s], target_off, total) : 0;
+         broken |= port_ok && result < 0;
+         bench_print(result, port_ok);
+#ifdef BENCH_FAST_NAME
+         fast_ok = !(target_off & BENCH_FAST_ALIGN);
+         result = fast_ok ? bench_fill(BENCH_FAST_FILL, sizes[s], target_off, total) : 0;
+         broken |= fast_ok && result < 0;
+         bench_print(result, fast_ok);
+#endif
+         printf("\n");
+      }
+   
+   free(source_block);
+   free(target_block);
+   
+   return broken ? 1 : 0;
+}
@@ -19,6 +19,8 @@
 
 @tests = ( "Usermode execution" );
 my $results;
+my @benchmarks;
+my $bench_results;
 
 # syntax: process-testsuite-logs.pl <target name>
 #
@@ -126,6 +128,84 @@ foreach $test_name (@tests)
    $testid++;
 }
 
+print "</table>\n";
+
+# output the benchmark figures in the same layout, one row per benchmark seen in the logs
+print "<h2>Benchmarks</h2>\n";
+print "<table cellspacing=\"1\" cellpadding=\"10\" bgcolor=\"#ddd\">\n";
+print " <tr bgcolor=\"white\">\n";
+print "  <td colspan=\"2\"><b>Benchmark</b></td>\n";
+
+foreach $model (@arch_cpu_models)
+{
+   print "  <td align=\"center\" colspan=\"".($cores_fitted_count * $mem_fitted_count)."\"><b>$model</b></td>\n";
+   print "  <td width=\"1\">&nbsp;</td>\n"; # vertical separator
+}
+
+print " </tr>\n";
+print " <tr bgcolor=\"white\">\n";
+print "  <td colspan=\"2\">&nbsp;</td>\n";
+
+foreach $model (@arch_cpu_models)
+{
+   foreach $cores (@arch_cpu_cores)
+   {
+      print "  <td align=\"center\" colspan=\"".($mem_fitted_count)."\"><b>$cores cpu(s)</b></td>\n";
+   }
+   
+   print "  <td width=\"1\">&nbsp;</td>\n"; # vertical separator
+}
+
+print " </tr>\n";
+print " <tr bgcolor=\"white\">\n";
+print "  <td colspan=\"2\">&nbsp;</td>\n";
+
+foreach $model (@arch_cpu_models)
+{
+   foreach $cores (@arch_cpu_cores)
+   {
+      foreach $mem (@arch_mem_fitted)
+      {
+         print "  <td><b>$mem</b></td>\n";
+      }
+   }
+   
+   print "  <td width=\"1\">&nbsp;</td>\n"; # vertical separator
+}
+
+print " </tr>\n";
+
+for($benchid = 0; $benchid < scalar @benchmarks; $benchid++)
+{
+   print " <tr bgcolor=\"white\">\n";
+   print " <td>($benchid)</td>\n";
+   print " <td><b>$benchmarks[$benchid]</b></td>\n";
+   
+   foreach $model (@arch_cpu_models)
+   {
+      foreach $cores (@arch_cpu_cores)
+      {
+         foreach $mem (@arch_mem_fitted)
+         {
+            my $result = $bench_results[$benchid]{$model."_".$cores."_".$mem};
+
+            if($result eq "FAIL" || $result eq "")
+            {
+               print "  <td bgcolor=\"#f00\">$result</td>\n";
+            }
+            else
+            {
+               print "  <td>$result</td>\n";
+            }
+         }
+      }
+      
+      print "  <td width=\"1\">&nbsp;</td>\n"; # vertical separator
+   }
+   
+   print " </tr>\n";
+}
+
 print "</table>\n";
 print "</body></html>\n";
 
@@ -134,7 +214,8 @@ exit 0;
 
 # process_log(cpu model, number of cores, phys mem fitted)
 # open the log file associated with this boot configuration and process
-# any test results found, storing them into an array of hashes called $results
+# any test results found, storing them into an array of hashes called $results.
+# benchmark figures are stored in $bench_results and their names in @benchmarks
 sub process_log
 {
    open(my $log, '<', "./test/$arch_name/automated_$_[0]_$_[1]_$_[2].log") or die $!;
@@ -145,6 +226,21 @@ sub process_log
       {
          $results[$1]{$_[0]."_".$_[1]."_".$_[2]} = $2;
       }
+      elsif(/__DTS__bench([0-9]*) OK # SKIP (.*?) *$/)
+      {
+         $benchmarks[$1] = $2;
+         $bench_results[$1]{$_[0]."_".$_[1]."_".$_[2]} = "skipped";
+      }
+      elsif(/__DTS__bench([0-9]*) OK # (.*) = ([0-9]+) (\S+)/)
+      {
+         $benchmarks[$1] = $2;
+         $bench_results[$1]{$_[0]."_".$_[1]."_".$_[2]} = "$3 $4";
+      }
+      elsif(/__DTS__bench([0-9]*) FAIL # (.*?) *$/)
+      {
+         $benchmarks[$1] = $2;
+         $bench_results[$1]{$_[0]."_".$_[1]."_".$_[2]} = "FAIL";
+      }
    }
    
    close $log;
@@ -0,0 +1,126 @@
+#!/usr/bin/perl
+
+# ----------------------------------------------------------------------
+# scripts/sched-trace-timeline.pl
+# Turn dumps of the kernel's per-cpu scheduler trace into a timeline
+# Author : agent <agent@local>
+# Date   : Sat,17 Oct 2026.12:00:00
+#
+# Copyright (c) Chris Williams and individual contributors
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+# Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+# ______________________________________________________________________
+
+# syntax: sched-trace-timeline.pl [--mhz <cpu clock>] <dump file> [<dump file> ...]
+#
+# each dump file holds one or more raw diosix_sched_trace blocks, as filled in
+# by diosix_get_sched_trace(), written out back-to-back - typically one per cpu.
+# the events from all the blocks are merged and printed in timestamp order.
+# timestamps are cpu cycles on i386 and msec on arm; pass --mhz to convert
+# i386 cycle counts into usec.
+
+use strict;
+
+# must match DIOSIX_SCHED_TRACE_ENTRIES and the structures in diosix.h
+my $trace_entries = 256;
+my $header_size   = 8;  # cpu, head
+my $entry_size    = 32; # timestamp, type, cpu, pid, tid, arg[2], sequence
+my $block_size    = $header_size + ($trace_entries * $entry_size);
+
+my %event_names = ( 1 => "switch", 2 => "wakeup", 3 => "block",
+                    4 => "priority", 5 => "irq-enter", 6 => "irq-exit" );
+
+my $mhz = 0;
+my @events;
+
+if($ARGV[0] eq "--mhz")
+{
+   shift @ARGV;
+   $mhz = shift @ARGV;
+}
+
+if(scalar @ARGV == 0 || $mhz < 0)
+{
+   print STDERR "syntax: sched-trace-timeline.pl [--mhz <cpu clock>] <dump file> [<dump file> ...]\n";
+   exit 1;
+}
+
+# pull the valid events out of every block in every dump
+foreach my $file (@ARGV)
+{
+   my $block;
+
+   open(DUMP, "<", $file) or die "can't open $file: $!";
+   binmode DUMP;
+
+   while(read(DUMP, $block, $block_size) == $block_size)
+   {
+      my ($cpu, $head) = unpack("V V", substr($block, 0, $header_size));
+      my $oldest = ($head > $trace_entries) ? ($head - $trace_entries) : 0;
+
+      for(my $slot = 0; $slot < $trace_entries; $slot++)
+      {
+         my ($lo, $hi, $type, $ecpu, $pid, $tid, $arg0, $arg1, $seq) =
+            unpack("V V v v V V V V V", substr($block, $header_size + ($slot * $entry_size), $entry_size));
+
+         # skip empty slots and those overwritten while the ring was being copied
+         next if($seq == 0 || $seq <= $oldest || $seq > $head);
+         next if((($seq - 1) % $trace_entries) != $slot);
+
+         push @events, { time => ($hi * 4294967296) + $lo, cpu => $ecpu, seq => $seq,
+                         type => $type, pid => $pid, tid => $tid, arg0 => $arg0, arg1 => $arg1 };
+      }
+   }
+
+   close(DUMP);
+}
+
+if(scalar @events == 0)
+{
+   print STDERR "no trace events found\n";
+   exit 1;
+}
+
+@events = sort { $a->{time} <=> $b->{time} || $a->{cpu} <=> $b->{cpu} || $a->{seq} <=> $b->{seq} } @events;
+
+my $start = $events[0]->{time};
+my %last_time;
+
+printf("%14s %10s %4s  %-10s %s\n", ($mhz ? "usec" : "time"), "delta", "cpu", "event", "details");
+
+foreach my $event (@events)
+{
+   my $time  = $event->{time} - $start;
+   my $delta = exists $last_time{$event->{cpu}} ? $event->{time} - $last_time{$event->{cpu}} : 0;
+   my $name  = $event_names{$event->{type}} || "type $event->{type}";
+   my $thread = "$event->{pid}.$event->{tid}";
+   my $details;
+
+   $last_time{$event->{cpu}} = $event->{time};
+
+   if($mhz)
+   {
+      $time  = $time / $mhz;
+      $delta = $delta / $mhz;
+   }
+
+   if($event->{type} == 1)
+   {
+      my $in  = $event->{pid} ? $thread : "idle";
+      my $out = $event->{arg0} ? "$event->{arg0}.$event->{arg1}" : "idle";
+      $details = "$out -> $in";
+   }
+   elsif($event->{type} == 2) { $details = "$thread queued on cpu $event->{arg0} at priority $event->{arg1}"; }
+   elsif($event->{type} == 3) { $details = "$thread off cpu $event->{arg1} queue, state $event->{arg0}"; }
+   elsif($event->{type} == 4) { $details = "$thread priority $event->{arg0} -> $event->{arg1}"; }
+   elsif($event->{type} == 5 || $event->{type} == 6) { $details = "irq $event->{arg0} (thread $thread)"; }
+   else { $details = "$thread $event->{arg0} $event->{arg1}"; }
+
+   printf("%14.2f %10.2f %4i  %-10s %s\n", $time, $delta, $event->{cpu}, $name, $details);
+}
@@ -0,0 +1,486 @@
+/* user/bin/testsuite/bench.c
+ * Microbenchmarks of the system call and message passing interfaces
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.18:30:00
+
+Copyright (c) Chris Williams and individual contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+#include "diosix.h"
+#include "functions.h"
+#include "roles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+
+/* requests understood by the benchmark server, passed in the first word of a message */
+#define BENCH_REQ_ECHO    (0) /* reply with a single word */
+#define BENCH_REQ_WHERE   (1) /* reply with the id of the cpu the server is running on */
+#define BENCH_REQ_QUIT    (2) /* reply and then exit */
+
+/* buffers are private to the client and server once they've forked */
+static unsigned int bench_buffer[DIOSIX_MSG_MAX_SIZE / sizeof(unsigned int)];
+static int bench_server_pid = -1;
+
+/* ------------------------------------------------------------------------
+      list of benchmarks to perform
+   ------------------------------------------------------------------------ */
+
+bench_def bench_list[] = { bench__null_syscall, "syscall: null syscall latency",
+                           bench__pingpong_same_cpu, "ipc: send/reply latency, same cpu",
+                           bench__pingpong_cross_cpu, "ipc: send/reply latency, across cpus",
+                           bench__throughput_4, "ipc: throughput, 4 byte messages",
+                           bench__throughput_64, "ipc: throughput, 64 byte messages",
+                           bench__throughput_256, "ipc: throughput, 256 byte messages",
+                           bench__throughput_1k, "ipc: throughput, 1KB messages",
+                           bench__throughput_4k, "ipc: throughput, 4KB messages",
+                           bench__throughput_16k, "ipc: throughput, 16KB messages",
+                           bench__single_part, "ipc: 4KB message in a single part",
+                           bench__multipart, "ipc: 4KB message in four parts",
+                           bench__queued, "ipc: queued send/reply latency",
+                           bench__pid_addressed, "ipc: pid-addressed send/reply latency",
+                           bench__role_addressed, "ipc: role-addressed send/reply latency",
+                           NULL, "" }; /* last item */
+
+/* ------------------------------------------------------------------------ */
+
+/* bench_read_clock
+   <= the cpu's cycle counter on x86, or the kernel's high-resolution
+      clock in usec on other architectures
+*/
+unsigned long long bench_read_clock(void)
+{
+#if defined (__i386__)
+   unsigned int high, low;
+
+   __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+
+   return ((unsigned long long)low) | (((unsigned long long)high) << 32);
+#else
+   diosix_kernel_stats stats;
+
+   if(diosix_get_kernel_stats(&stats) != success) return 0;
+   return stats.uptime_usec;
+#endif
+}
+
+/* bench_server
+   Sit in a loop answering requests from the benchmarking process, and
+   exit when told to. This runs in a forked child process
+*/
+void bench_server(void)
+{
+   diosix_msg_info msg;
+   diosix_thread_info thread_info;
+   unsigned int request, answer;
+
+   /* the pager role isn't used by anything else in the system. if this fails
+      then the role-addressed benchmark will fail */
+   diosix_set_role(BENCH_ROLE);
+
+   while(1)
+   {
+      memset(&msg, 0, sizeof(diosix_msg_info));
+      msg.flags = DIOSIX_MSG_GENERIC;
+      msg.recv = bench_buffer;
+      msg.recv_max_size = sizeof(bench_buffer);
+
+      if(diosix_msg_receive(&msg) != success) continue;
+
+      request = bench_buffer[0];
+      answer = 0;
+
+      if(request == BENCH_REQ_WHERE)
+      {
+         if(diosix_get_thread_info(&thread_info) == success)
+            answer = thread_info.cpu;
+      }
+
+      msg.send = &answer;
+      msg.send_size = sizeof(unsigned int);
+      diosix_msg_reply(&msg);
+
+      if(request == BENCH_REQ_QUIT)
+      {
+         diosix_set_role(DIOSIX_ROLE_NONE);
+         diosix_exit(0);
+      }
+   }
+}
+
+/* bench_start_server
+   Fork off a process to answer the benchmarks' messages
+   <= 0 for success, or an error code
+*/
+kresult bench_start_server(void)
+{
+   bench_server_pid = diosix_fork();
+   if(bench_server_pid == -1) return e_failure;
+
+   if(bench_server_pid == 0)
+   {
+      bench_server();
+      diosix_exit(0); /* shouldn't get here */
+   }
+
+   return success;
+}
+
+/* bench_request
+   Send a request to the benchmark server and wait for its reply
+   => msg = message to fill in and send
+      flags = extra DIOSIX_MSG_* flags, or DIOSIX_MSG_MULTIPART to send
+              the parts given in data
+      role = role to address the server by, or DIOSIX_ROLE_NONE to use its pid
+      data = pointer to the message data, or an array of parts
+      size = size of the message in bytes, or the number of parts
+      answer = pointer to word to store the server's answer in
+   <= 0 for success, or an error code
+*/
+kresult bench_request(diosix_msg_info *msg, unsigned int flags, unsigned int role,
+                      void *data, unsigned int size, unsigned int *answer)
+{
+   kresult err;
+   unsigned int tries = 0;
+
+   if(role)
+      msg->role = role;
+   else
+      msg->pid = bench_server_pid;
+
+   msg->tid = DIOSIX_MSG_ANY_THREAD;
+   msg->flags = DIOSIX_MSG_GENERIC | DIOSIX_MSG_SENDASUSR | flags;
+   msg->send = data;
+   msg->send_size = size;
+   msg->recv = answer;
+   msg->recv_max_size = sizeof(unsigned int);
+
+   /* the server may be busy replying to the last request, so keep trying
+      if this message isn't one to be queued for it */
+   while((err = diosix_msg_send(msg)) == e_no_receiver && tries++ < BENCH_MAX_RETRIES)
+      diosix_thread_yield();
+
+   return err;
+}
+
+/* bench_roundtrips
+   Time a number of send/reply round trips to the benchmark server
+   => flags, role, data, size = see bench_request()
+      elapsed = pointer to store the total time taken in
+   <= 0 for success, or an error code
+*/
+kresult bench_roundtrips(unsigned int flags, unsigned int role, void *data,
+                         unsigned int size, unsigned long long *elapsed)
+{
+   diosix_msg_info msg;
+   unsigned int loop, answer;
+   unsigned long long start;
+
+   /* warm up the path first */
+   memset(&msg, 0, sizeof(diosix_msg_info));
+   bench_buffer[0] = BENCH_REQ_ECHO;
+   if(bench_request(&msg, flags, role, data, size, &answer) != success) return e_failure;
+
+   start = bench_read_clock();
+   for(loop = 0; loop < BENCH_ITERATIONS; loop++)
+   {
+      memset(&msg, 0, sizeof(diosix_msg_info));
+      if(bench_request(&msg, flags, role, data, size, &answer) != success) return e_failure;
+   }
+
+   *elapsed = bench_read_clock() - start;
+   return success;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* BENCH: bench__null_syscall
+   Time a system call that does very little work in the kernel
+*/
+kresult bench__null_syscall(bench_result *result)
+{
+   diosix_thread_info info;
+   unsigned int loop;
+   unsigned long long start;
+
+   start = bench_read_clock();
+   for(loop = 0; loop < BENCH_ITERATIONS; loop++)
+      diosix_get_thread_info(&info);
+
+   result->value = (bench_read_clock() - start) / BENCH_ITERATIONS;
+   return success;
+}
+
+/* bench_pingpong
+   Time send/reply round trips, sorting each one by whether the client
+   and server ran on the same cpu. There's no way to pin threads to cpus so
+   this relies on the scheduler spreading them out on its own
+   => same = non-zero to report the same-cpu time, or zero for the cross-cpu time
+      result = pointer to store the average time per round trip in
+   <= 0 for success, e_not_found if no round trip of the required sort
+      was timed, or an error code
+*/
+kresult bench_pingpong(unsigned char same, bench_result *result)
+{
+   diosix_msg_info msg;
+   diosix_thread_info info;
+   unsigned int loop, cpu, samples = 0;
+   unsigned long long start, taken, total = 0;
+
+   bench_buffer[0] = BENCH_REQ_WHERE;
+
+   for(loop = 0; loop < BENCH_ITERATIONS; loop++)
+   {
+      memset(&msg, 0, sizeof(diosix_msg_info));
+
+      start = bench_read_clock();
+      if(bench_request(&msg, 0, DIOSIX_ROLE_NONE, bench_buffer, sizeof(unsigned int), &cpu) != success)
+         return e_failure;
+      taken = bench_read_clock() - start;
+
+      if(diosix_get_thread_info(&info) != success) return e_failure;
+      if((info.cpu == cpu) == (same != 0))
+      {
+         total += taken;
+         samples++;
+      }
+   }
+
+   if(!samples) return e_not_found;
+
+   result->value = total / samples;
+   return success;
+}
+
+/* BENCH: bench__pingpong_same_cpu */
+kresult bench__pingpong_same_cpu(bench_result *result)
+{
+   return bench_pingpong(1, result);
+}
+
+/* BENCH: bench__pingpong_cross_cpu
+   Skipped on uniprocessor systems, or if the scheduler kept the client
+   and server together throughout
+*/
+kresult bench__pingpong_cross_cpu(bench_result *result)
+{
+   return bench_pingpong(0, result);
+}
+
+/* bench_throughput
+   Measure how many bytes can be passed to another process per second
+   => size = size of each message in bytes
+      result = pointer to store the throughput in
+   <= 0 for success, or an error code
+*/
+kresult bench_throughput(unsigned int size, bench_result *result)
+{
+   unsigned long long elapsed;
+
+   if(bench_roundtrips(0, DIOSIX_ROLE_NONE, bench_buffer, size, &elapsed) != success)
+      return e_failure;
+   if(!elapsed) elapsed = 1;
+
+#if defined (__i386__)
+   /* bytes per thousand cycles */
+   result->value = ((unsigned long long)size * BENCH_ITERATIONS * 1000) / elapsed;
+   result->unit = "bytes/kcycle";
+#else
+   /* KB per second */
+   result->value = ((unsigned long long)size * BENCH_ITERATIONS * 1000000) / (elapsed * 1024);
+   result->unit = "KB/s";
+#endif
+   return success;
+}
+
+/* BENCH: bench__throughput_*
+   Throughput across a range of message sizes
+*/
+kresult bench__throughput_4(bench_result *result)
+{
+   return bench_throughput(4, result);
+}
+
+kresult bench__throughput_64(bench_result *result)
+{
+   return bench_throughput(64, result);
+}
+
+kresult bench__throughput_256(bench_result *result)
+{
+   return bench_throughput(256, result);
+}
+
+kresult bench__throughput_1k(bench_result *result)
+{
+   return bench_throughput(1024, result);
+}
+
+kresult bench__throughput_4k(bench_result *result)
+{
+   return bench_throughput(4096, result);
+}
+
+kresult bench__throughput_16k(bench_result *result)
+{
+   return bench_throughput(DIOSIX_MSG_MAX_SIZE, result);
+}
+
+/* BENCH: bench__single_part
+   Baseline for bench__multipart: the same amount of data in one block
+*/
+kresult bench__single_part(bench_result *result)
+{
+   unsigned long long elapsed;
+
+   if(bench_roundtrips(0, DIOSIX_ROLE_NONE, bench_buffer, 4096, &elapsed) != success)
+      return e_failure;
+
+   result->value = elapsed / BENCH_ITERATIONS;
+   return success;
+}
+
+/* BENCH: bench__multipart
+   Send 4KB gathered from four separate 1KB blocks
+*/
+kresult bench__multipart(bench_result *result)
+{
+   diosix_msg_multipart parts[4];
+   unsigned long long elapsed;
+   unsigned int loop;
+
+   for(loop = 0; loop < 4; loop++)
+      DIOSIX_WRITE_MULTIPART(parts, loop, (unsigned char *)bench_buffer + (loop * 1024), 1024);
+
+   if(bench_roundtrips(DIOSIX_MSG_MULTIPART, DIOSIX_ROLE_NONE, parts, 4, &elapsed) != success)
+      return e_failure;
+
+   result->value = elapsed / BENCH_ITERATIONS;
+   return success;
+}
+
+/* BENCH: bench__queued
+   Round trips with messages that wait in the server's queue if it
+   isn't ready to receive them
+*/
+kresult bench__queued(bench_result *result)
+{
+   unsigned long long elapsed;
+
+   if(bench_roundtrips(DIOSIX_MSG_QUEUEME, DIOSIX_ROLE_NONE, bench_buffer, sizeof(unsigned int), &elapsed) != success)
+      return e_failure;
+
+   result->value = elapsed / BENCH_ITERATIONS;
+   return success;
+}
+
+/* BENCH: bench__pid_addressed
+   Baseline for bench__role_addressed: the server is found by its pid
+*/
+kresult bench__pid_addressed(bench_result *result)
+{
+   unsigned long long elapsed;
+
+   if(bench_roundtrips(0, DIOSIX_ROLE_NONE, bench_buffer, sizeof(unsigned int), &elapsed) != success)
+      return e_failure;
+
+   result->value = elapsed / BENCH_ITERATIONS;
+   return success;
+}
+
+/* BENCH: bench__role_addressed
+   The server is found by the role it has registered with the kernel
+*/
+kresult bench__role_addressed(bench_result *result)
+{
+   unsigned long long elapsed;
+
+   if(bench_roundtrips(0, BENCH_ROLE, bench_buffer, sizeof(unsigned int), &elapsed) != success)
+      return e_failure;
+
+   result->value = elapsed / BENCH_ITERATIONS;
+   return success;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* do_bench
+   Attempt to perform a benchmark and write the output to the log
+   => nr = benchmark ID number
+*/
+void do_bench(bench_nr nr)
+{
+   kresult err;
+   bench_result result;
+   kresult (*bench)(bench_result *);
+   char buffer[LOG_MAX_LINE_LENGTH];
+
+   /* locate the benchmark and run it */
+   bench = bench_list[nr].func;
+   if(!bench) return;
+
+   result.value = 0;
+#if defined (__i386__)
+   result.unit = "cycles";
+#else
+   result.unit = "usec";
+#endif
+   err = bench(&result);
+
+   if(err == success)
+      snprintf(buffer, LOG_MAX_LINE_LENGTH, LOG "bench%i OK # %s = %u %s \n",
+               nr, bench_list[nr].comment, (unsigned int)result.value, result.unit);
+   else if(err == e_not_found)
+      snprintf(buffer, LOG_MAX_LINE_LENGTH, LOG "bench%i OK # SKIP %s \n", nr, bench_list[nr].comment);
+   else
+      snprintf(buffer, LOG_MAX_LINE_LENGTH, LOG "bench%i FAIL # %s \n", nr, bench_list[nr].comment);
+
+   /* push result of benchmark out to the kernel's debug channel */
+   diosix_debug_write(buffer);
+}
+
+/* do_benchmarks
+   Run through the list of benchmarks against a forked server process
+*/
+void do_benchmarks(void)
+{
+   bench_nr bench_id = 0;
+   diosix_msg_info msg;
+   unsigned int answer;
+
+   if(bench_start_server() != success)
+   {
+      /* report each benchmark as failed */
+      while(bench_list[bench_id].func)
+      {
+         char buffer[LOG_MAX_LINE_LENGTH];
+         snprintf(buffer, LOG_MAX_LINE_LENGTH, LOG "bench%i FAIL # %s \n", bench_id, bench_list[bench_id].comment);
+         diosix_debug_write(buffer);
+         bench_id++;
+      }
+      return;
+   }
+
+   while(bench_list[bench_id].func)
+   {
+      do_bench(bench_id);
+      bench_id++;
+   }
+
+   /* shut down the server */
+   memset(&msg, 0, sizeof(diosix_msg_info));
+   bench_buffer[0] = BENCH_REQ_QUIT;
+   bench_request(&msg, DIOSIX_MSG_QUEUEME, DIOSIX_ROLE_NONE, bench_buffer, sizeof(unsigned int), &answer);
+}
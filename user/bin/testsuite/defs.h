@@ -37,7 +37,8 @@ typedef enum
    test_is_running = 0,
    test_diosix_fork = 1,
    test_fp_addition = 2,
-   test_msg_send = 3
+   test_msg_send = 3,
+   test_sched_rt_limit = 4
 } test_nr;
 
 /* test functions */
@@ -45,5 +46,64 @@ kresult test__is_running(void);
 kresult test__diosix_fork(void);
 kresult test__fp_addition(void);
 kresult test__msg_send(void);
+kresult test__sched_rt_limit(void);
+
+/* ------------------------------------------------------- */
+
+/* benchmarks are run after the tests, and each logs a single figure */
+#define BENCH_ITERATIONS  (256) /* round trips to time per benchmark */
+#define BENCH_MAX_RETRIES (1000) /* give up on a busy server after this many attempts */
+#define BENCH_ROLE        (DIOSIX_ROLE_PAGER) /* role taken by the benchmark server */
+
+/* a benchmark's figure and the units it's measured in */
+typedef struct
+{
+   unsigned long long value;
+   const char *unit;
+} bench_result;
+
+/* define a benchmark's structure */
+typedef struct
+{
+   kresult (*func)(bench_result *result); /* benchmark function: returns e_not_found to skip */
+   const char *comment; /* human-readable string for the log */
+} bench_def;
+
+/* list of possible benchmarks */
+typedef enum
+{
+   bench_null_syscall = 0,
+   bench_pingpong_same_cpu = 1,
+   bench_pingpong_cross_cpu = 2,
+   bench_throughput_4 = 3,
+   bench_throughput_64 = 4,
+   bench_throughput_256 = 5,
+   bench_throughput_1k = 6,
+   bench_throughput_4k = 7,
+   bench_throughput_16k = 8,
+   bench_single_part = 9,
+   bench_multipart = 10,
+   bench_queued = 11,
+   bench_pid_addressed = 12,
+   bench_role_addressed = 13
+} bench_nr;
+
+/* benchmark functions */
+kresult bench__null_syscall(bench_result *result);
+kresult bench__pingpong_same_cpu(bench_result *result);
+kresult bench__pingpong_cross_cpu(bench_result *result);
+kresult bench__throughput_4(bench_result *result);
+kresult bench__throughput_64(bench_result *result);
+kresult bench__throughput_256(bench_result *result);
+kresult bench__throughput_1k(bench_result *result);
+kresult bench__throughput_4k(bench_result *result);
+kresult bench__throughput_16k(bench_result *result);
+kresult bench__single_part(bench_result *result);
+kresult bench__multipart(bench_result *result);
+kresult bench__queued(bench_result *result);
+kresult bench__pid_addressed(bench_result *result);
+kresult bench__role_addressed(bench_result *result);
+
+void do_benchmarks(void);
 
 #endif
\ No newline at end of file
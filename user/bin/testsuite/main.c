@@ -35,6 +35,7 @@ test_def test_list[] = { test__is_running, "testsuite running",
                          test__diosix_fork, "direct fork syscall",
                          test__fp_addition, "fp: addition",
                          test__msg_send, "ipc: send a simple message",
+                         test__sched_rt_limit, "sched: refuse an oversized real-time budget",
                          NULL, "" }; /* last item */
 
 /* ------------------------------------------------------------------------ */
@@ -87,6 +88,9 @@ int main(void)
       test_id++;
    }
 
+   /* follow up with the performance figures */
+   do_benchmarks();
+
    while(1); /* idle */
 }
 
@@ -0,0 +1,50 @@
+/* user/bin/testsuite/sched.c
+ * Testsuite of the scheduler interface
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.20:00:00
+
+Copyright (c) Chris Williams and individual contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+#include "diosix.h"
+#include "functions.h"
+
+#include "defs.h"
+
+/* the kernel lets a real-time thread reserve at most half of a cpu */
+#define TEST_RT_PERIOD      (10000) /* usec */
+#define TEST_RT_FULL        (TEST_RT_PERIOD)             /* all of a cpu */
+#define TEST_RT_OVER        ((TEST_RT_PERIOD * 6) / 10)  /* over the per-thread limit */
+#define TEST_RT_UNDER       (TEST_RT_PERIOD / 5)         /* well within it */
+
+/* TEST: test__sched_rt_limit
+   Check a single thread can't reserve more of a cpu than the per-thread
+   real-time limit allows, even when the system as a whole has the spare
+   capacity, and that a modest reservation is still admitted.
+   Expected result: both oversized budgets refused with e_too_big
+*/
+kresult test__sched_rt_limit(void)
+{
+   if(diosix_sched_realtime(TEST_RT_PERIOD, TEST_RT_FULL) != e_too_big) goto test_rt_fail;
+   if(diosix_sched_realtime(TEST_RT_PERIOD, TEST_RT_OVER) != e_too_big) goto test_rt_fail;
+   
+   /* a reservation within the limit must still be allowed, and then given up */
+   if(diosix_sched_realtime(TEST_RT_PERIOD, TEST_RT_UNDER) != success) return e_failure;
+   if(diosix_sched_realtime(0, 0) != success) return e_failure;
+   
+   return success;
+   
+test_rt_fail:
+   /* leave the real-time class if the kernel let us in */
+   diosix_sched_realtime(0, 0);
+   return e_failure;
+}
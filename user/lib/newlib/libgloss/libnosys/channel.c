@@ -0,0 +1,272 @@
+/* user/lib/newlib/libgloss/libnosys/channel.c
+ * single-producer single-consumer ring channels in shared memory
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.16:00:00
+
+ Copyright (c) Chris Williams and individual contributors
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+
+*/
+
+#include <string.h>
+
+#include "diosix.h"
+#include "functions.h"
+
+/* the producer and consumer each publish a store then check the other's
+   waiting flag, so a full barrier is needed between the two. slot data only
+   needs to be ordered against the head and tail updates, which the cpu does
+   for us on x86, and the arm port is uniprocessor */
+#if defined (__i386__)
+#define CHANNEL_FULL_BARRIER()  __asm__ __volatile__("lock; addl $0, 0(%%esp)" : : : "memory")
+#else
+#define CHANNEL_FULL_BARRIER()  __asm__ __volatile__("" : : : "memory")
+#endif
+#define CHANNEL_BARRIER()       __asm__ __volatile__("" : : : "memory")
+
+/* find the slot for item number a in channel c */
+#define CHANNEL_SLOT(c, a)  ((volatile unsigned int *)((unsigned char *)((c)->ring) + sizeof(diosix_channel_header) + \
+                             (((a) & ((c)->slots - 1)) * DIOSIX_CHANNEL_SLOT_STRIDE((c)->slot_size))))
+
+/* channel_geometry
+   Check a ring's geometry fits inside its shared area and, if so, take a
+   private copy of it to use from then on
+   => chan = channel to fill in
+      size = size of the shared area in bytes
+      slots = number of slots in the ring
+      slot_size = maximum size of an item in the ring, in bytes
+   <= 0 for success, or an error code
+*/
+static kresult channel_geometry(diosix_channel *chan, unsigned int size,
+                                unsigned int slots, unsigned int slot_size)
+{
+   if(!slots || (slots & (slots - 1)) || !slot_size || slot_size > size) return e_bad_params;
+   if(size < sizeof(diosix_channel_header) ||
+      slots > (size - sizeof(diosix_channel_header)) / DIOSIX_CHANNEL_SLOT_STRIDE(slot_size))
+      return e_bad_params;
+
+   chan->size = size;
+   chan->slots = slots;
+   chan->slot_size = slot_size;
+   return success;
+}
+
+/* diosix_channel_create
+   Create a shared area for a new channel and set up an empty ring in it.
+   The process on the other end of the channel maps the area in using
+   diosix_channel_attach(), which this process answers with diosix_channel_accept()
+   => chan = channel structure to fill in
+      base = page-aligned address to create the shared area at
+      size = size of the shared area in bytes, a multiple of the page size
+      slot_size = maximum size of an item in the channel, in bytes
+   <= 0 for success, or an error code
+*/
+kresult diosix_channel_create(diosix_channel *chan, void *base, unsigned int size, unsigned int slot_size)
+{
+   diosix_channel_header *ring = base;
+   unsigned int slots;
+
+   /* sanity checks */
+   if(!chan || !base || !slot_size) return e_bad_params;
+   if(((unsigned int)base | size) & (DIOSIX_MEMORY_PAGESIZE - 1)) return e_not_pg_aligned;
+   if(slot_size > size || size < sizeof(diosix_channel_header) + DIOSIX_CHANNEL_SLOT_STRIDE(slot_size))
+      return e_too_small;
+
+   /* fit in as many slots as possible, rounded down to a power of two */
+   slots = (size - sizeof(diosix_channel_header)) / DIOSIX_CHANNEL_SLOT_STRIDE(slot_size);
+   while(slots & (slots - 1)) slots &= slots - 1;
+
+   if(diosix_memory_create(base, size)) return e_failure;
+   if(diosix_memory_access(base, VMA_WRITEABLE | VMA_SHARED))
+   {
+      diosix_memory_destroy(base);
+      return e_failure;
+   }
+
+   memset(ring, 0, sizeof(diosix_channel_header));
+   ring->slot_size = slot_size;
+   ring->slots = slots;
+   ring->magic = DIOSIX_CHANNEL_MAGIC;
+
+   channel_geometry(chan, size, slots, slot_size);
+   chan->ring = ring;
+   return success;
+}
+
+/* diosix_channel_accept
+   Reply to a process's diosix_channel_attach() request, sharing the channel's
+   area with it
+   => chan = channel to share
+      msg = the received request message
+   <= 0 for success, or an error code
+*/
+kresult diosix_channel_accept(diosix_channel *chan, diosix_msg_info *msg)
+{
+   kresult result = success;
+
+   if(!chan || !chan->ring || !msg) return e_bad_params;
+
+   /* the other end must be asking to share an area of the right size */
+   if(!(msg->flags & DIOSIX_MSG_SHAREVMA) || msg->mem_req.size != chan->size)
+   {
+      result = e_bad_params;
+      msg->flags &= ~DIOSIX_MSG_SHAREVMA;
+   }
+   else
+      msg->mem_req.base = (unsigned int)chan->ring;
+
+   msg->send = &result;
+   msg->send_size = sizeof(kresult);
+
+   if(diosix_msg_reply(msg)) return e_failure;
+   return result;
+}
+
+/* diosix_channel_attach
+   Ask the process that created a channel to share it, and map its area in
+   => chan = channel structure to fill in
+      msg = message to send, with its target and any request payload filled in
+      base = page-aligned address to map the channel's area at, which must
+             not already be in use
+      size = size of the channel's area in bytes
+   <= 0 for success, or an error code
+*/
+kresult diosix_channel_attach(diosix_channel *chan, diosix_msg_info *msg, void *base, unsigned int size)
+{
+   kresult result = e_failure;
+   diosix_channel_header *ring = base;
+
+   if(!chan || !msg || !base || !size) return e_bad_params;
+   if(((unsigned int)base | size) & (DIOSIX_MEMORY_PAGESIZE - 1)) return e_not_pg_aligned;
+
+   msg->flags |= DIOSIX_MSG_SHAREVMA;
+   msg->mem_req.base = (unsigned int)base;
+   msg->mem_req.size = size;
+   msg->recv = &result;
+   msg->recv_max_size = sizeof(kresult);
+
+   if(diosix_msg_send(msg)) return e_failure;
+   if(result != success) return result;
+   if(!(msg->flags & DIOSIX_MSG_SHAREVMA)) return e_failure;
+
+   if(ring->magic != DIOSIX_CHANNEL_MAGIC) return e_bad_magic;
+   if(channel_geometry(chan, size, ring->slots, ring->slot_size)) return e_bad_params;
+
+   chan->ring = ring;
+   return success;
+}
+
+/* diosix_channel_send
+   Add an item to the end of a channel's ring, waking the consumer if it is
+   asleep on an empty ring. Only one thread may send on a channel
+   => chan = channel to send through
+      data = pointer to the item to copy into the ring
+      size = size of the item in bytes
+      flags = DIOSIX_CHANNEL_NOWAIT to return e_would_block rather than sleep on a full ring
+   <= 0 for success, or an error code
+*/
+kresult diosix_channel_send(diosix_channel *chan, void *data, unsigned int size, unsigned int flags)
+{
+   diosix_channel_header *ring;
+   unsigned int head, tail;
+   volatile unsigned int *slot;
+
+   if(!chan || !chan->ring || (!data && size)) return e_bad_params;
+   ring = chan->ring;
+   if(size > chan->slot_size) return e_too_big;
+
+   head = ring->head;
+
+   /* wait for the consumer to make room */
+   while((head - ring->tail) >= chan->slots)
+   {
+      if(flags & DIOSIX_CHANNEL_NOWAIT) return e_would_block;
+
+      ring->producer_waiting = 1;
+      CHANNEL_FULL_BARRIER();
+
+      tail = ring->tail;
+      if((head - tail) >= chan->slots) diosix_doorbell_wait(&(ring->tail), tail);
+
+      ring->producer_waiting = 0;
+   }
+
+   slot = CHANNEL_SLOT(chan, head);
+   slot[0] = size;
+   if(size) memcpy((void *)&(slot[1]), data, size);
+
+   /* publish the item */
+   CHANNEL_BARRIER();
+   ring->head = head + 1;
+   CHANNEL_FULL_BARRIER();
+
+   /* ring the doorbell only if this item made the ring non-empty and the consumer's asleep */
+   if(ring->consumer_waiting && ring->tail == head)
+      diosix_doorbell_ring(&(ring->head));
+
+   return success;
+}
+
+/* diosix_channel_receive
+   Take the item from the front of a channel's ring, waking the producer if it
+   is asleep on a full ring. Only one thread may receive from a channel
+   => chan = channel to receive from
+      data = pointer to buffer to copy the item into
+      size = pointer to the size of the buffer in bytes, which is updated with
+             the size of the item received
+      flags = DIOSIX_CHANNEL_NOWAIT to return e_would_block rather than sleep on an empty ring
+   <= 0 for success, or an error code
+*/
+kresult diosix_channel_receive(diosix_channel *chan, void *data, unsigned int *size, unsigned int flags)
+{
+   diosix_channel_header *ring;
+   unsigned int head, tail, item;
+   volatile unsigned int *slot;
+
+   if(!chan || !chan->ring || !data || !size) return e_bad_params;
+   ring = chan->ring;
+
+   tail = ring->tail;
+
+   /* wait for the producer to add an item */
+   while(ring->head == tail)
+   {
+      if(flags & DIOSIX_CHANNEL_NOWAIT) return e_would_block;
+
+      ring->consumer_waiting = 1;
+      CHANNEL_FULL_BARRIER();
+
+      head = ring->head;
+      if(head == tail) diosix_doorbell_wait(&(ring->head), head);
+
+      ring->consumer_waiting = 0;
+   }
+   CHANNEL_BARRIER();
+
+   /* read the item's size once: the producer could rewrite it under our feet */
+   slot = CHANNEL_SLOT(chan, tail);
+   item = slot[0];
+   if(item > chan->slot_size) return e_bad_params;
+   if(item > *size) return e_too_big; /* leave the item in the ring */
+
+   *size = item;
+   if(item) memcpy(data, (void *)&(slot[1]), item);
+
+   /* hand the slot back */
+   CHANNEL_BARRIER();
+   ring->tail = tail + 1;
+   CHANNEL_FULL_BARRIER();
+
+   /* ring the doorbell only if this made the ring non-full and the producer's asleep */
+   if(ring->producer_waiting && (ring->head - tail) == chan->slots)
+      diosix_doorbell_ring(&(ring->tail));
+
+   return success;
+}
@@ -54,7 +54,8 @@ typedef enum
    e_bad_params,
    e_vma_exists,
    e_exists,
-   e_max_layer
+   e_max_layer,
+   e_would_block        /* a non-blocking call couldn't complete without waiting */
 } kresult;
 
 #define POSIX_GENERIC_FAILURE   ((unsigned int)(-1))
@@ -77,6 +78,10 @@ typedef enum
 #define SYSCALL_ALARM         (14)
 #define SYSCALL_SET_ID        (15)
 #define SYSCALL_USRDEBUG      (16)
+#define SYSCALL_TIMER         (17)
+#define SYSCALL_MSG_FAST      (18)
+#define SYSCALL_DOORBELL      (19)
+#define SYSCALL_MSG_BATCH     (20)
 
 /* manage a process's POSIX-conformant ids */
 #define DIOSIX_SETPGID   (1) /* set process group id */
@@ -108,6 +113,7 @@ typedef struct
 /* calculate how many scheduling ticks there are per second */
 #define DIOSIX_TICKS_PER_SECOND(a) ((a) * DIOSIX_SCHED_TICK)
 #define DIOSIX_MSEC_PER_TICK       (1000 / DIOSIX_SCHED_TICK)
+#define DIOSIX_USEC_PER_TICK       (1000000 / DIOSIX_SCHED_TICK)
 /* define the number of scheduler ticks to sleep for inbetween trying to resend
    a DIOSIX_MSG_QUEUEME message to a process that isn't revceiving yet */
 #define DIOSIX_SCHED_MSGWAIT  (10)
@@ -122,6 +128,9 @@ typedef struct
 #define DIOSIX_MSG_QUEUEME     (1 << 25) /* queue a non-reply non-signal message and block until received */
 #define DIOSIX_MSG_INMYPROCGRP (1 << 24) /* send the signal to all processes in sender's process group */
 #define DIOSIX_MSG_INAPROCGRP  (1 << 23) /* send the signal to all processes in process group selected by pid */
+#define DIOSIX_MSG_REMAP       (1 << 20) /* move whole pages into the receiver rather than copy them */
+#define DIOSIX_MSG_BYPRIORITY  (1 << 19) /* queue senders to the receiving process by priority, not arrival */
+#define DIOSIX_MSG_IRQSET      (1 << 18) /* collect all pending IRQs into the recv buffer as a diosix_irq_set */
 /* simple type bits low (bits 0-3) */
 #define DIOSIX_MSG_GENERIC     (1)
 #define DIOSIX_MSG_SIGNAL      (2)
@@ -133,6 +142,37 @@ typedef struct
 /* the kernel will refuse to deliver individual messages greater than this size in bytes* */
 #define DIOSIX_MSG_MAX_SIZE    (4096 * 4)
 
+/* a sender can set DIOSIX_MSG_REMAP to have the kernel move the physical pages
+   behind its send buffer into the receiver's buffer instead of copying the data.
+   only whole pages that sit at the same offset within a page in both buffers, and
+   are private to each process, are moved - the rest are copied as normal. the
+   sender's moved pages are replaced with blank pages on its next access. the
+   receiver sees DIOSIX_MSG_REMAP set in its flags if any pages were moved.
+   smaller messages are always copied, and remapped messages can be larger than
+   the usual limit as they are not copied byte-by-byte */
+#define DIOSIX_MSG_REMAP_THRESHOLD (4096 * 2)
+#define DIOSIX_MSG_REMAP_MAX_SIZE  (4096 * 256)
+
+/* short messages of a few words can be passed entirely in registers using
+   diosix_msg_fast(). both ends of the conversation must use the fast path:
+   a thread blocked in diosix_msg_receive() won't see a fast message and vice versa.
+   a call made while no thread in the target is blocked on a fast receive is queued
+   until one is, and is killed with e_no_receiver if the target process exits */
+#define DIOSIX_MSG_FAST_MAX_WORDS  (4)
+#define DIOSIX_MSG_FAST_CALL       (0) /* send words to a thread and block for its reply */
+#define DIOSIX_MSG_FAST_RECV       (1) /* block until a call arrives */
+#define DIOSIX_MSG_FAST_REPLY      (2) /* reply to a blocked caller */
+#define DIOSIX_MSG_FAST_REPLY_RECV (3) /* reply to a caller and block until the next call arrives */
+#define DIOSIX_MSG_FAST_OPMASK     (3)
+#define DIOSIX_MSG_FAST_WORDS(a)     (((a) & 7) << 8) /* number of words in the message */
+#define DIOSIX_MSG_FAST_GET_WORDS(a) (((a) >> 8) & 7)
+#define DIOSIX_MSG_FAST_BYROLE     (1 << 22) /* the tag's pid is a role to look up */
+#define DIOSIX_MSG_FAST            (1 << 21) /* thread is waiting on the fast path (kernel use) */
+/* name the other end of a fast message */
+#define DIOSIX_MSG_FAST_TAG(pid, tid) ((((tid) & 0xffff) << 16) | ((pid) & 0xffff))
+#define DIOSIX_MSG_FAST_PID(a)        ((a) & 0xffff)
+#define DIOSIX_MSG_FAST_TID(a)        (((a) >> 16) & 0xffff)
+
 /* describe a queued asynchronous message */
 typedef struct
 {
@@ -178,6 +218,95 @@ typedef struct
    void *recv;             /* pointer to buffer for the reply/recv data */
 } diosix_msg_info;
 
+/* a short message passed in registers by diosix_msg_fast() */
+typedef struct
+{
+   unsigned int tag;     /* DIOSIX_MSG_FAST_TAG() of the thread to send to, or of the sender on return */
+   unsigned int control; /* DIOSIX_MSG_FAST_* operation, word count and flags */
+   unsigned int words[DIOSIX_MSG_FAST_MAX_WORDS];
+} diosix_msg_fast_info;
+
+/* interrupts raised for a driver process are gathered into a pending set rather
+   than queued as one SIGXIRQ signal each: repeats of a line coalesce into a count.
+   a thread receiving signals is handed a SIGXIRQ with the lowest pending line in
+   signal.extra. if it sets DIOSIX_MSG_IRQSET and has a receive buffer big enough for
+   a diosix_irq_set then it gets the whole pending set in that buffer, and the set is
+   emptied, otherwise just the lowest line is taken off the set. the interrupt
+   handler won't fault in the buffer: if it has been unmapped or write-protected
+   since the thread blocked then DIOSIX_MSG_IRQSET comes back cleared and only the
+   lowest line is handed over */
+#define DIOSIX_IRQ_LINES       (256)
+#define DIOSIX_IRQ_WORDS       (DIOSIX_IRQ_LINES / 32)
+#define DIOSIX_IRQ_COUNT_MAX   (255) /* counts stick at this value */
+#define DIOSIX_IRQ_PENDING(s, a) ((s)->pending[(a) >> 5] & (1 << ((a) & 31)))
+
+typedef struct
+{
+   unsigned int pending[DIOSIX_IRQ_WORDS]; /* bit set for each IRQ line raised */
+   unsigned char counts[DIOSIX_IRQ_LINES]; /* number of times each line was raised */
+} diosix_irq_set;
+
+/* a list of messages sent and received in one system call by diosix_msg_batch().
+   the kernel works through the entries in order, writing each entry's result into
+   it. only entries that can't block the caller are batched: replies without
+   DIOSIX_MSG_RECVONREPLY and signals. the last entry alone may be one that can
+   block - a send that isn't a reply, a reply with DIOSIX_MSG_RECVONREPLY set, or a
+   receive - and any such entry earlier in the list fails with e_would_block without
+   being processed. there is no completion queue: a blocking send's reply arrives
+   in its own block, as with diosix_msg_send() */
+#define DIOSIX_MSG_BATCH_SEND  (0)
+#define DIOSIX_MSG_BATCH_RECV  (1)
+#define DIOSIX_MSG_BATCH_MAX   (64) /* most entries the kernel will take in one call */
+
+typedef struct
+{
+   unsigned int op;         /* DIOSIX_MSG_BATCH_SEND or DIOSIX_MSG_BATCH_RECV */
+   diosix_msg_info *msg;    /* message to send, or block to receive into */
+   kresult result;          /* the entry's outcome, filled in when it's processed */
+} diosix_msg_batch_entry;
+
+/* a channel is a single-producer single-consumer ring of fixed-size slots in a
+   shared vma, set up with one DIOSIX_MSG_SHAREVMA exchange. items pass through
+   the ring without entering the kernel: the two ends only ring a doorbell to
+   wake the other when it has gone to sleep on an empty or full ring.
+   doorbells are words in shared memory that threads can block on until another
+   thread, in any process mapping the same page, rings them */
+#define DIOSIX_CHANNEL_MAGIC       (0xc4a77e15)
+#define DIOSIX_CHANNEL_NOWAIT      (1 << 0) /* return e_would_block rather than sleep */
+
+typedef struct
+{
+   /* fixed when the channel is created */
+   unsigned int magic;
+   unsigned int slot_size; /* max bytes of data per slot */
+   unsigned int slots;     /* number of slots in the ring, a power of two */
+   unsigned int reserved0[13];
+   
+   /* written only by the producer, on its own cache line */
+   volatile unsigned int head;             /* number of items written */
+   volatile unsigned int producer_waiting; /* set while the producer sleeps on a full ring */
+   unsigned int reserved1[14];
+   
+   /* written only by the consumer, on its own cache line */
+   volatile unsigned int tail;             /* number of items read */
+   volatile unsigned int consumer_waiting; /* set while the consumer sleeps on an empty ring */
+   unsigned int reserved2[14];
+} diosix_channel_header;
+
+/* each slot is a word holding the item's size followed by slot_size bytes of data */
+#define DIOSIX_CHANNEL_SLOT_STRIDE(a) ((((a) + 3) & ~3) + sizeof(unsigned int))
+
+/* the ring's geometry is copied out of the header when the channel is set up and
+   checked against the area's size, so the other end can't later trick this one
+   into reaching outside the area by rewriting the header */
+typedef struct
+{
+   diosix_channel_header *ring; /* the shared area as mapped into this process */
+   unsigned int size;           /* size of the shared area in bytes */
+   unsigned int slot_size;      /* max bytes of data per slot */
+   unsigned int slots;          /* number of slots in the ring */
+} diosix_channel;
+
 /* reason codes for priv/rights management */
 #define DIOSIX_PRIV_LAYER_UP   (0)
 #define DIOSIX_RIGHTS_CLEAR    (1)
@@ -185,6 +314,15 @@ typedef struct
 #define DIOSIX_IORIGHTS_CLEAR  (3)
 #define DIOSIX_UNIX_SIGNALS    (4)
 #define DIOSIX_KERNEL_SIGNALS  (5)
+#define DIOSIX_SCHED_REALTIME  (6)
+
+/* reason codes for high-resolution timers */
+#define DIOSIX_TIMER_SLEEP     (0)
+#define DIOSIX_TIMER_ALARM     (1)
+
+/* reason codes for doorbells */
+#define DIOSIX_DOORBELL_WAIT   (0)
+#define DIOSIX_DOORBELL_RING   (1)
 
 /* reason codes for debugging with the kernel */
 #define DIOSIX_DEBUG_WRITE     (0)
@@ -194,6 +332,7 @@ typedef struct
 #define DIOSIX_PROCESS_INFO      (1)
 #define DIOSIX_KERNEL_INFO       (2)
 #define DIOSIX_KERNEL_STATISTICS (3)
+#define DIOSIX_SCHED_TRACE       (4)
 
 /* reason codes for driver management */
 #define DIOSIX_DRIVER_REGISTER       (0)
@@ -257,12 +396,22 @@ typedef struct
    unsigned char flags; /* set the type of mapping using the above VMA flags */
 } diosix_phys_request;
 
+/* cpu time used by a thread or process, in cpu cycles (msec on arm) and in usec */
+typedef struct
+{
+   unsigned long long user, kernel, irq; /* running usermode code, in the kernel for syscalls and
+                                            faults, and handling interrupts that arrived meanwhile */
+   unsigned long long user_usec, kernel_usec, irq_usec;
+} diosix_cpu_time;
+
 /* thread information block */
 typedef struct
 {
    /* describe this thread */
    unsigned int tid, cpu;
    unsigned char priority;
+   unsigned int migrations; /* times the scheduler has moved this thread between cpus */
+   diosix_cpu_time time; /* cpu time used by this thread */
 } diosix_thread_info;
    
 typedef struct
@@ -278,6 +427,9 @@ typedef struct
    
    /* POSIX-conformant process group and session ids */
    unsigned int proc_group_id, session_id;
+   
+   diosix_cpu_time time;          /* cpu time used by all the process's threads, living and exited */
+   diosix_cpu_time children_time; /* cpu time used by the process's exited children */
 } diosix_process_info;
 
 typedef struct
@@ -291,8 +443,38 @@ typedef struct
 typedef struct
 {
    unsigned int kernel_uptime; /* rough uptime in msec */
+   unsigned int sched_migrations; /* threads moved between cpus by the scheduler */
+   unsigned long long uptime_usec; /* uptime in usec from the high-resolution clock */
 } diosix_kernel_stats;
 
+/* scheduler trace event types */
+#define DIOSIX_TRACE_SWITCH    (1) /* thread pid/tid switched in (0/0 for idle), arg[0]/arg[1] = pid/tid switched out */
+#define DIOSIX_TRACE_WAKEUP    (2) /* thread pid/tid queued to run, arg[0] = cpu queue, arg[1] = priority */
+#define DIOSIX_TRACE_BLOCK     (3) /* thread pid/tid taken off a run queue, arg[0] = new thread state, arg[1] = cpu queue */
+#define DIOSIX_TRACE_PRIORITY  (4) /* thread pid/tid changed priority, arg[0] = old priority, arg[1] = new priority */
+#define DIOSIX_TRACE_IRQ_ENTER (5) /* hardware interrupt arg[0] arrived while thread pid/tid was running */
+#define DIOSIX_TRACE_IRQ_EXIT  (6) /* finished handling hardware interrupt arg[0] */
+
+/* number of events each cpu keeps in its trace ring buffer, must be a power of 2 */
+#define DIOSIX_SCHED_TRACE_ENTRIES (256)
+
+typedef struct
+{
+   unsigned long long timestamp; /* cpu cycle count on i386, msec counter on arm */
+   unsigned short type, cpu;     /* DIOSIX_TRACE_* event type and the id of the cpu that recorded it */
+   unsigned int pid, tid;        /* thread concerned, or zero for none */
+   unsigned int arg[2];          /* event-specific data, see above */
+   unsigned int sequence;        /* event number on its cpu, written last */
+} diosix_sched_trace_entry;
+
+typedef struct
+{
+   unsigned int cpu;  /* in: id of the cpu whose trace is to be copied */
+   unsigned int head; /* out: number of events recorded by that cpu since boot - the latest
+                         is in entries[(head - 1) % DIOSIX_SCHED_TRACE_ENTRIES] */
+   diosix_sched_trace_entry entries[DIOSIX_SCHED_TRACE_ENTRIES];
+} diosix_sched_trace;
+
 typedef struct
 {
    union
@@ -52,12 +52,18 @@ unsigned int diosix_thread_exit(unsigned int code);
 int diosix_thread_fork(void);
 unsigned int diosix_thread_kill(unsigned int tid);
 unsigned int diosix_thread_sleep(unsigned int ticks);
+unsigned int diosix_thread_usleep(unsigned int usec);
 unsigned int diosix_alarm(unsigned int ticks);
+unsigned int diosix_ualarm(unsigned int usec);
 
 /* message sending */
 unsigned int diosix_msg_send(diosix_msg_info *info);
 unsigned int diosix_msg_receive(diosix_msg_info *info);
 unsigned int diosix_msg_reply(diosix_msg_info *info);
+unsigned int diosix_msg_fast(diosix_msg_fast_info *info);
+unsigned int diosix_msg_batch(diosix_msg_batch_entry *entries, unsigned int count, unsigned int *done);
+unsigned int diosix_doorbell_wait(volatile unsigned int *ptr, unsigned int value);
+unsigned int diosix_doorbell_ring(volatile unsigned int *ptr);
 
 /* rights and privilege layer management */
 unsigned int diosix_priv_layer_up(unsigned int count);
@@ -66,6 +72,7 @@ unsigned int diosix_iorights_remove(void);
 unsigned int diosix_iorights_clear(unsigned int index, unsigned int bits);
 unsigned int diosix_signals_unix(unsigned int mask);
 unsigned int diosix_signals_kernel(unsigned int mask);
+unsigned int diosix_sched_realtime(unsigned int period, unsigned int budget);
 
 /* user and group id and related management */
 unsigned int diosix_set_pg_id(unsigned int pid, unsigned int pgid);
@@ -91,6 +98,7 @@ unsigned int diosix_get_thread_info(diosix_thread_info *block);
 unsigned int diosix_get_process_info(diosix_process_info *block);
 unsigned int diosix_get_kernel_info(diosix_kernel_info *block);
 unsigned int diosix_get_kernel_stats(diosix_kernel_stats *block);
+unsigned int diosix_get_sched_trace(diosix_sched_trace *block);
 
 /* manage memory */
 unsigned int diosix_memory_create(void *ptr, unsigned int size);
@@ -126,4 +134,15 @@ void diosix_vfs_associate_handle(int filehandle, unsigned int pid);
 kresult diosix_vfs_register(char *path);
 kresult diosix_vfs_deregister(char *path);
 
+
+/* --------------------------------------------
+   shared-memory ring channels
+   -------------------------------------------- */
+
+kresult diosix_channel_create(diosix_channel *chan, void *base, unsigned int size, unsigned int slot_size);
+kresult diosix_channel_accept(diosix_channel *chan, diosix_msg_info *msg);
+kresult diosix_channel_attach(diosix_channel *chan, diosix_msg_info *msg, void *base, unsigned int size);
+kresult diosix_channel_send(diosix_channel *chan, void *data, unsigned int size, unsigned int flags);
+kresult diosix_channel_receive(diosix_channel *chan, void *data, unsigned int *size, unsigned int flags);
+
 #endif
@@ -0,0 +1,87 @@
+/* user/lib/newlib/libgloss/libnosys/getrusage.c
+ * portable interface of getrusage() between libc and the diosix microkernel
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.14:00:00
+ 
+ Copyright (c) Chris Williams and individual contributors
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+ 
+*/
+
+/* portable libc definitions */
+#include "config.h"
+#include <_ansi.h>
+#include <_syslist.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <errno.h>
+#undef errno
+extern int errno;
+
+/* diosix-specific definitions */
+#include "diosix.h"
+#include "functions.h"
+
+/* fill in a timeval from a count of microseconds */
+static void usec_to_timeval(unsigned long long usec, struct timeval *tv)
+{
+   tv->tv_sec  = (time_t)(usec / 1000000);
+   tv->tv_usec = (suseconds_t)(usec % 1000000);
+}
+
+/* getrusage()
+   summary: get the cpu time used by the process or its exited children.
+            only ru_utime and ru_stime are supported, the rest are zeroed
+   reference: http://pubs.opengroup.org/onlinepubs/009695399/functions/getrusage.html */
+
+int
+_DEFUN (getrusage, (who, usage),
+        int who _AND
+        struct rusage *usage)
+{
+   diosix_process_info info;
+   diosix_cpu_time *time;
+   
+   if(!usage)
+   {
+      errno = EFAULT;
+      return -1;
+   }
+   
+   switch(who)
+   {
+      case RUSAGE_SELF:
+         time = &(info.time);
+         break;
+         
+      case RUSAGE_CHILDREN:
+         time = &(info.children_time);
+         break;
+         
+      default:
+         errno = EINVAL;
+         return -1;
+   }
+   
+   if(diosix_get_process_info(&info))
+   {
+      errno = EFAULT;
+      return -1;
+   }
+   
+   memset(usage, 0, sizeof(struct rusage));
+   
+   /* time spent handling interrupts counts as system time */
+   usec_to_timeval(time->user_usec, &(usage->ru_utime));
+   usec_to_timeval(time->kernel_usec + time->irq_usec, &(usage->ru_stime));
+   
+   return 0;
+}
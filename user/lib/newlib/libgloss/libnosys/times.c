@@ -1,22 +1,64 @@
-/*
- * Stub version of times.
- */
+/* user/lib/newlib/libgloss/libnosys/times.c
+ * portable interface of the times() syscall between libc and the diosix microkernel
+ * Author : agent <agent@local>
+ * Date   : Sat,17 Oct 2026.14:00:00
+ * Replaces newlib's libnosys stub version of times(), which returned ENOSYS
+ 
+ Copyright (c) Chris Williams and individual contributors
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ 
+ Contact: chris@diodesign.co.uk / http://www.diodesign.co.uk/
+ 
+*/
 
+/* portable libc definitions */
 #include "config.h"
 #include <_ansi.h>
 #include <_syslist.h>
 #include <sys/times.h>
+#include <time.h>
 #include <errno.h>
 #undef errno
 extern int errno;
-#include "warning.h"
+
+/* diosix-specific definitions */
+#include "diosix.h"
+#include "functions.h"
+
+/* convert microseconds into clock ticks */
+#define USEC_TO_CLOCKS(a) ((clock_t)((a) / (1000000 / CLOCKS_PER_SEC)))
+
+/* times()
+   summary: get the process's cpu times and the elapsed real time
+   reference: http://pubs.opengroup.org/onlinepubs/009695399/functions/times.html */
 
 clock_t
 _DEFUN (_times, (buf),
         struct tms *buf)
 {
-  errno = ENOSYS;
-  return -1;
+   diosix_process_info info;
+   diosix_kernel_stats stats;
+   
+   if(diosix_get_process_info(&info) || diosix_get_kernel_stats(&stats))
+   {
+      errno = EFAULT;
+      return (clock_t)-1;
+   }
+   
+   /* time spent handling interrupts counts as system time */
+   if(buf)
+   {
+      buf->tms_utime  = USEC_TO_CLOCKS(info.time.user_usec);
+      buf->tms_stime  = USEC_TO_CLOCKS(info.time.kernel_usec + info.time.irq_usec);
+      buf->tms_cutime = USEC_TO_CLOCKS(info.children_time.user_usec);
+      buf->tms_cstime = USEC_TO_CLOCKS(info.children_time.kernel_usec + info.children_time.irq_usec);
+   }
+   
+   /* real time is measured from boot */
+   return USEC_TO_CLOCKS(stats.uptime_usec);
 }
-
-stub_warning(_times)
@@ -77,6 +77,18 @@ unsigned int diosix_alarm(unsigned int ticks)
    return retval;
 }
 
+unsigned int diosix_ualarm(unsigned int usec)
+/* send a SIGALRM signal to the calling process after the given number of microseconds */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (DIOSIX_TIMER_ALARM), "b" (usec), "d" (SYSCALL_TIMER));
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0" : "=r" (retval) : "i" (DIOSIX_TIMER_ALARM), "r" (usec), "i" (SYSCALL_TIMER));
+#endif
+   return retval;
+}
+
 /* --------------- threading basics -------------------- */
 
 void diosix_thread_yield(void)
@@ -146,6 +158,18 @@ unsigned int diosix_thread_sleep(unsigned int ticks)
    return retval;
 }
 
+unsigned int diosix_thread_usleep(unsigned int usec)
+/* block for the given number of microseconds */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (DIOSIX_TIMER_SLEEP), "b" (usec), "d" (SYSCALL_TIMER));
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0" : "=r" (retval) : "i" (DIOSIX_TIMER_SLEEP), "r" (usec), "i" (SYSCALL_TIMER));
+#endif
+   return retval;
+}
+
 /* --------------- message basics -------------------- */
 
 unsigned int diosix_msg_send(diosix_msg_info *info)
@@ -198,6 +222,97 @@ unsigned int diosix_msg_reply(diosix_msg_info *info)
    return diosix_msg_send(info);
 }
 
+unsigned int diosix_msg_batch(diosix_msg_batch_entry *entries, unsigned int count, unsigned int *done)
+/* send a list of replies and signals in one system call, optionally ending with one entry that blocks
+   => entries = array of batch entries, each updated with its result
+      count = number of entries in the array
+      done = if non-NULL, updated with the number of entries processed
+   <= result of the last entry processed
+*/
+{
+   unsigned int retval, processed;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval), "=b" (processed) : "a" (entries), "b" (count), "d" (SYSCALL_MSG_BATCH) : "memory");
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %4; mov r1, %3; mov r0, %2; swi $0x0; mov %0, r0; mov %1, r1"
+                        : "=r" (retval), "=r" (processed) : "r" (entries), "r" (count), "i" (SYSCALL_MSG_BATCH)
+                        : "r0", "r1", "r4", "memory");
+#endif
+   
+   /* the kernel can't write in the result of an entry that blocked, it comes back in retval */
+   if(processed) entries[processed - 1].result = retval;
+   if(done) *done = processed;
+   return retval;
+}
+
+unsigned int diosix_msg_fast(diosix_msg_fast_info *info)
+/* send and/or receive a short message entirely in registers, or return with a failure code
+   => info = pointer to fast msg block: its tag, control word and message words
+             are loaded into registers for the kernel and updated from them on return
+*/
+{
+   unsigned int retval;
+#if defined (__i386__)
+   /* eax = tag, ebx = control, ecx/esi/edi/ebp = words. the kernel returns the
+      result in eax and the sender's tag in edx. ebp is saved by hand as the
+      compiler may be using it as the frame pointer */
+   __asm__ __volatile__("pushl %%ebp\n\t"
+                        "pushl %%edx\n\t"
+                        "movl 8(%%edx), %%ecx\n\t"
+                        "movl 12(%%edx), %%esi\n\t"
+                        "movl 16(%%edx), %%edi\n\t"
+                        "movl 20(%%edx), %%ebp\n\t"
+                        "movl 0(%%edx), %%eax\n\t"
+                        "movl 4(%%edx), %%ebx\n\t"
+                        "movl %2, %%edx\n\t"
+                        "int $0x90\n\t"
+                        "xchgl %%edx, (%%esp)\n\t"
+                        "movl %%ebx, 4(%%edx)\n\t"
+                        "movl %%ecx, 8(%%edx)\n\t"
+                        "movl %%esi, 12(%%edx)\n\t"
+                        "movl %%edi, 16(%%edx)\n\t"
+                        "movl %%ebp, 20(%%edx)\n\t"
+                        "popl %%ebx\n\t"
+                        "movl %%ebx, 0(%%edx)\n\t"
+                        "popl %%ebp"
+                        : "=a" (retval), "+d" (info) : "i" (SYSCALL_MSG_FAST)
+                        : "ebx", "ecx", "esi", "edi", "memory");
+#elif defined (__arm__)
+   /* r0 = tag, r1 = control, r2/r3/r5/r6 = words. the kernel returns the
+      result in r0 and the sender's tag in r4 */
+   __asm__ __volatile__("mov r12, %1; ldmia r12, {r0, r1, r2, r3, r5, r6}; mov r4, %2; swi $0x0; "
+                        "str r4, [r12]; str r1, [r12, #4]; str r2, [r12, #8]; str r3, [r12, #12]; "
+                        "str r5, [r12, #16]; str r6, [r12, #20]; mov %0, r0"
+                        : "=r" (retval) : "r" (info), "i" (SYSCALL_MSG_FAST)
+                        : "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r12", "memory");
+#endif
+   return retval;
+}
+
+unsigned int diosix_doorbell_wait(volatile unsigned int *ptr, unsigned int value)
+/* block until the doorbell word at ptr is rung, or return at once if it no longer holds value */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (DIOSIX_DOORBELL_WAIT), "b" (ptr), "c" (value), "d" (SYSCALL_DOORBELL) : "memory");
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %4; mov r2, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0" : "=r" (retval) : "i" (DIOSIX_DOORBELL_WAIT), "r" (ptr), "r" (value), "i" (SYSCALL_DOORBELL) : "memory");
+#endif
+   return retval;
+}
+
+unsigned int diosix_doorbell_ring(volatile unsigned int *ptr)
+/* wake up all threads, in any process, waiting on the doorbell word at ptr */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (DIOSIX_DOORBELL_RING), "b" (ptr), "d" (SYSCALL_DOORBELL) : "memory");
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0" : "=r" (retval) : "i" (DIOSIX_DOORBELL_RING), "r" (ptr), "i" (SYSCALL_DOORBELL) : "memory");
+#endif
+   return retval;
+}
+
 /* -------------- process rights and privileges basics ------------ */
 unsigned int diosix_priv_layer_up(unsigned int count)
 /* move up the privilege stack by count number of layers: the higher a process the less privileged it is */
@@ -377,6 +492,19 @@ unsigned int diosix_signals_kernel(unsigned int mask)
    return retval;   
 }
 
+unsigned int diosix_sched_realtime(unsigned int period, unsigned int budget)
+/* reserve budget usec of cpu time in every period usec for the calling thread at real-time
+   priority, or leave the real-time class if period is zero - executive and drivers only */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (DIOSIX_SCHED_REALTIME), "b" (period), "c" (budget), "d" (SYSCALL_PRIVS));
+#elif defined (__arm__)
+   __asm__ __volatile__( "mov r4, %4; mov r2, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0" : "=r" (retval) : "i" (DIOSIX_SCHED_REALTIME), "r" (period), "r" (budget), "i" (SYSCALL_PRIVS));
+#endif
+   return retval;   
+}
+
 /* --------------------------- driver management -------------------- */
 unsigned int diosix_driver_register(void)
 /* request access to hardware from suerspace */
@@ -539,6 +667,18 @@ unsigned int diosix_get_kernel_stats(diosix_kernel_stats *block)
    return retval;
 }
 
+unsigned int diosix_get_sched_trace(diosix_sched_trace *block)
+/* copy the scheduler trace of cpu block->cpu - privileged processes only */
+{
+   unsigned int retval;
+#if defined (__i386__)
+   __asm__ __volatile__("int $0x90" : "=a" (retval) : "a" (block), "b" (DIOSIX_SCHED_TRACE), "d" (SYSCALL_INFO));  
+#elif defined (__arm__)
+   __asm__ __volatile__("mov r4, %3; mov r1, %2; mov r0, %1; swi $0x0; mov %0, r0"  : "=r" (retval) : "r" (block), "i" (DIOSIX_SCHED_TRACE), "i" (SYSCALL_INFO));
+#endif
+   return retval;
+}
+
 /* ----------------------- virtual memory management ---------------- */
 unsigned int diosix_memory_create(void *ptr, unsigned int size)
 /* create a new virtual memory area at address ptr of size bytes */
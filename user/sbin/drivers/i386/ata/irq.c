@@ -68,35 +68,41 @@ void sleep_on_irq(unsigned char flags)
 void wait_for_irq(void)
 {
    diosix_msg_info msg;
+   diosix_irq_set irqs;
+   unsigned char raised;
 
-   /* prepare to sleep until an interrupt comes in */
+   /* prepare to sleep until an interrupt comes in, and collect
+      both channels' IRQs in one go if they're both pending */
    msg.role = msg.pid = DIOSIX_MSG_ANY_PROCESS;
    msg.tid = DIOSIX_MSG_ANY_THREAD;
-   msg.flags = DIOSIX_MSG_SIGNAL | DIOSIX_MSG_KERNELONLY;
+   msg.recv = &irqs;
+   msg.recv_max_size = sizeof(diosix_irq_set);
 
    for(;;)
    {
+      msg.flags = DIOSIX_MSG_SIGNAL | DIOSIX_MSG_KERNELONLY | DIOSIX_MSG_IRQSET;
+      
       /* block until a signal comes in from the hardware */
-      if(diosix_msg_receive(&msg) == success)
+      if(diosix_msg_receive(&msg) == success && msg.signal.number == SIGXIRQ)
       {
-         switch(msg.signal.extra)
+         raised = 0;
+         if(msg.flags & DIOSIX_MSG_IRQSET)
+         {
+            if(DIOSIX_IRQ_PENDING(&irqs, ATA_IRQ_PRIMARY)) raised |= ATA_IRQ_PRIMARY_PENDING;
+            if(DIOSIX_IRQ_PENDING(&irqs, ATA_IRQ_SECONDARY)) raised |= ATA_IRQ_SECONDARY_PENDING;
+         }
+         else
          {
-            case ATA_IRQ_PRIMARY:
-               lock_spin(&irqs_lock);
-               
-               irqs_pending |= ATA_IRQ_PRIMARY_PENDING;
-               
-               unlock_spin(&irqs_lock);
-               break;
-          
-            case ATA_IRQ_SECONDARY:
-               lock_spin(&irqs_lock);
-
-               irqs_pending |= ATA_IRQ_SECONDARY_PENDING;
-               
-               unlock_spin(&irqs_lock);               
-               break;
+            /* only the lowest line was handed over */
+            if(msg.signal.extra == ATA_IRQ_PRIMARY) raised |= ATA_IRQ_PRIMARY_PENDING;
+            if(msg.signal.extra == ATA_IRQ_SECONDARY) raised |= ATA_IRQ_SECONDARY_PENDING;
          }
+         
+         lock_spin(&irqs_lock);
+         
+         irqs_pending |= raised;
+         
+         unlock_spin(&irqs_lock);
       }
    }
 }
@@ -82,6 +82,7 @@ u32_t sys_now(void)
    
    diosix_get_kernel_stats(&stats);
    
-   return stats.kernel_uptime;
+   /* use the high-resolution clock rather than the tick-granular uptime */
+   return (u32_t)(stats.uptime_usec / 1000);
 }
 